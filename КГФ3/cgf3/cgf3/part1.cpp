@@ -1,6 +1,9 @@
 // part1_mod.cpp
-// Build: g++ part1_mod.cpp glad.c -ldl -lglfw -lGL -I/path/to/glad/include -I/path/to/glm -o part1_mod
-// Run:   ./part1_mod bound-bunny_200.smf
+// Build: g++ part1_mod.cpp glad.c -pthread -ldl -lglfw -lGL -I/path/to/glad/include -I/path/to/glm -o part1_mod
+// Run:   ./part1_mod [--profile] [--profile-csv frames.csv] [--instances N] [--no-cull] [--lods N] [--lod-error PX] [--on-demand] [--fps-cap N] bound-bunny_200.smf [more.smf ...]
+//        ./part1_mod --shader-cache DIR | --no-shader-cache ...    (linked programs cached as driver binaries, default ./shader_cache)
+//        ./part1_mod --gpu-cull [--no-occlusion] --instances 20000 bound-bunny_200.smf    (GL 4.3: compute culling + indirect draws)
+//        ./part1_mod --bench [--bench-frames 1000] [--bench-size 1920x1080] [--gpu-cull] bound-bunny_200.smf
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -9,121 +12,51 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <vector>
 #include <string>
 #include <cmath>
-
-struct Vertex {
-    glm::vec3 pos;
-    glm::vec3 normal;
-    glm::vec3 color;
-};
-
-// --- SMF model loading ---
-bool loadSMF(const std::string& filename,
-    std::vector<glm::vec3>& out_positions,
-    std::vector<glm::uvec3>& out_faces)
-{
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Cannot open file: " << filename << "\n";
-        return false;
-    }
-
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::uvec3> faces;
-    std::string line;
-
-    while (std::getline(file, line)) {
-        if (line.empty()) continue;
-        std::istringstream iss(line);
-        char type;
-        iss >> type;
-
-        if (type == 'v') {
-            float x, y, z;
-            iss >> x >> y >> z;
-            vertices.emplace_back(x, y, z);
-        }
-        else if (type == 'f') {
-            unsigned int a, b, c;
-            iss >> a >> b >> c;
-            faces.emplace_back(a - 1, b - 1, c - 1);
-        }
-    }
-
-    out_positions = std::move(vertices);
-    out_faces = std::move(faces);
-    return true;
-}
-
-// --- Shader utilities ---
-GLuint compileShader(GLenum type, const char* src) {
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &src, nullptr);
-    glCompileShader(shader);
-
-    GLint success = 0;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char log[512];
-        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
-        std::cerr << "Shader compilation failed:\n" << log << "\n";
-    }
-    return shader;
-}
-
-GLuint createProgram(const char* vsrc, const char* fsrc) {
-    GLuint vs = compileShader(GL_VERTEX_SHADER, vsrc);
-    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fsrc);
-
-    GLuint program = glCreateProgram();
-    glAttachShader(program, vs);
-    glAttachShader(program, fs);
-    glLinkProgram(program);
-
-    GLint linked;
-    glGetProgramiv(program, GL_LINK_STATUS, &linked);
-    if (!linked) {
-        char info[512];
-        glGetProgramInfoLog(program, sizeof(info), nullptr, info);
-        std::cerr << "Shader linking failed:\n" << info << "\n";
-    }
-
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-    return program;
-}
+#include <algorithm>
+
+#include "../../common/async_loader.h"
+#include "../../common/bench.h"
+#include "../../common/frame_pacer.h"
+#include "../../common/frame_profiler.h"
+#include "../../common/gl_mesh.h"
+#include "../../common/gpu_culling.h"
+#include "../../common/mesh_cache.h"
+#include "../../common/program_cache.h"
+#include "../../common/scene.h"
 
 // --- Shaders ---
+// Flat shading from the shared indexed mesh: the face normal is rebuilt per
+// fragment from the screen-space derivatives of the world-space position,
+// so nothing has to be duplicated per triangle corner and no color or normal
+// is stored: abs(N) is the color. Positions arrive quantized to [0, 1]; the
+// per-instance model matrix (see scene.h) includes their dequantization.
 static const char* vertexShaderSrc = R"(
 #version 330 core
-layout(location=0) in vec3 aPos;
-layout(location=1) in vec3 aNormal;
-layout(location=2) in vec3 aColor;
+layout(location=0) in vec3 aPos; // unorm16, dequantized by aModel
+layout(location=2) in mat4 aModel;
 
-uniform mat4 uMVP;
-uniform mat4 uModel;
+uniform mat4 uViewProj;
 
-out vec3 vColor;
-out vec3 vNormal;
+out vec3 vPos;
 
 void main() {
-    vColor = aColor;
-    vNormal = mat3(transpose(inverse(uModel))) * aNormal;
-    gl_Position = uMVP * vec4(aPos, 1.0);
+    vec4 world = aModel * vec4(aPos, 1.0);
+    vPos = world.xyz;
+    gl_Position = uViewProj * world;
 }
 )";
 
 static const char* fragmentShaderSrc = R"(
 #version 330 core
-in vec3 vColor;
+in vec3 vPos;
 out vec4 FragColor;
 
 void main() {
-    FragColor = vec4(abs(vColor), 1.0);
+    vec3 N = normalize(cross(dFdx(vPos), dFdy(vPos)));
+    FragColor = vec4(abs(N), 1.0);
 }
 )";
 
@@ -132,6 +65,10 @@ float cameraTheta = 0.0f;
 float cameraRadius = 2.5f;
 float cameraHeight = 0.5f;
 bool usePerspective = true;
+bool useCulling = true;
+
+// --on-demand: frames are only drawn when something below asks for one
+FramePacer framePacer;
 
 void onKey(GLFWwindow* window, int key, int, int action, int) {
     if (action == GLFW_PRESS || action == GLFW_REPEAT) {
@@ -143,53 +80,62 @@ void onKey(GLFWwindow* window, int key, int, int action, int) {
         case GLFW_KEY_Q: cameraHeight += 0.05f; break;
         case GLFW_KEY_E: cameraHeight -= 0.05f; break;
         case GLFW_KEY_P: usePerspective = !usePerspective; break;
+        case GLFW_KEY_C: if (action == GLFW_PRESS) useCulling = !useCulling; break;
         case GLFW_KEY_ESCAPE: glfwSetWindowShouldClose(window, GLFW_TRUE); break;
-        default: break;
+        default: return;
         }
+        framePacer.request_redraw();
     }
 }
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " model.smf\n";
-        return -1;
-    }
+void onResize(GLFWwindow*, int, int) { framePacer.request_redraw(); }
+void onRefresh(GLFWwindow*) { framePacer.request_redraw(); }
 
-    std::string filename = argv[1];
-    std::vector<glm::vec3> positions;
-    std::vector<glm::uvec3> faces;
+// Meshes load in the background; more can be dropped onto the window at any time.
+AsyncMeshLoader meshLoader;
 
-    if (!loadSMF(filename, positions, faces)) return -1;
-
-    // centroid
-    glm::vec3 centroid(0.0f);
-    for (auto& p : positions) centroid += p;
-    centroid /= static_cast<float>(positions.size());
-
-    // vertex data
-    std::vector<Vertex> vertices;
-    vertices.reserve(faces.size() * 3);
-
-    for (auto& f : faces) {
-        glm::vec3 p0 = positions[f.x];
-        glm::vec3 p1 = positions[f.y];
-        glm::vec3 p2 = positions[f.z];
-
-        glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
-        glm::vec3 color = glm::abs(normal);
+void onDrop(GLFWwindow*, int count, const char** paths) {
+    for (int i = 0; i < count; ++i) meshLoader.request(paths[i]);
+}
 
-        vertices.push_back({ p0, normal, color });
-        vertices.push_back({ p1, normal, color });
-        vertices.push_back({ p2, normal, color });
+int main(int argc, char** argv) {
+    std::vector<std::string> filenames;
+    int instances = 1;
+    MeshLoadOptions loadOptions;
+    LodSelection lod;
+    bool profile = false;
+    bool gpuCull = false, occlusion = true;
+    std::string shaderCacheDir = "shader_cache";
+    std::string profileCsv;
+    BenchOptions bench;
+    RedrawOptions redraw;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (parse_bench_option(argc, argv, i, bench)) continue;
+        if (parse_redraw_option(argc, argv, i, redraw)) continue;
+        if (arg == "--profile") profile = true;
+        else if (arg == "--profile-csv" && i + 1 < argc) profileCsv = argv[++i];
+        else if (arg == "--instances" && i + 1 < argc) instances = std::max(1, atoi(argv[++i]));
+        else if (arg == "--no-cull") useCulling = false;
+        else if (arg == "--gpu-cull") gpuCull = true;
+        else if (arg == "--no-occlusion") occlusion = false;
+        else if (arg == "--shader-cache" && i + 1 < argc) shaderCacheDir = argv[++i];
+        else if (arg == "--no-shader-cache") shaderCacheDir.clear();
+        else if (arg == "--lods" && i + 1 < argc) loadOptions.lodLevels = (unsigned)std::max(0, atoi(argv[++i]));
+        else if (arg == "--lod-error" && i + 1 < argc) lod.maxErrorPixels = (float)atof(argv[++i]);
+        else filenames.push_back(arg);
+    }
+    if (filenames.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--profile] [--profile-csv file.csv] [--instances N] [--no-cull]"
+            " [--lods N] [--lod-error PX] [--gpu-cull] [--no-occlusion] [--shader-cache DIR] [--no-shader-cache] [--on-demand] [--fps-cap N] [--bench] [--bench-frames N] [--bench-size WxH] model.smf [more.smf ...]\n";
+        return -1;
     }
 
-    // init GLFW + GLAD
+    // init GLFW + GLAD: the window opens right away, the meshes follow
     if (!glfwInit()) return -1;
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (bench.enabled) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
-    GLFWwindow* window = glfwCreateWindow(1024, 768, "Flat Shading Viewer", nullptr, nullptr);
+    GLFWwindow* window = create_viewer_window(1024, 768, "Flat Shading Viewer", gpuCull);
     if (!window) { glfwTerminate(); return -1; }
     glfwMakeContextCurrent(window);
 
@@ -198,47 +144,85 @@ int main(int argc, char** argv) {
         return -1;
     }
 
+    // bench: render offscreen at a fixed size, without vsync
+    OffscreenTarget target;
+    if (bench.enabled) {
+        glfwSwapInterval(0);
+        if (!target.create(bench.width, bench.height)) return -1;
+    }
+
     glfwSetKeyCallback(window, onKey);
-    GLuint program = createProgram(vertexShaderSrc, fragmentShaderSrc);
-
-    // buffers
-    GLuint vao, vbo;
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, pos));
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
-    glEnableVertexAttribArray(2);
-    glBindVertexArray(0);
+    glfwSetFramebufferSizeCallback(window, onResize);
+    glfwSetWindowRefreshCallback(window, onRefresh);
+    glfwSetDropCallback(window, onDrop);
+    // a cached binary or a compile that runs while the loader starts; first
+    // waited on where its uniforms are looked up
+    ProgramCache programCache;
+    programCache.init(shaderCacheDir);
+    GLuint program = programCache.request(vertexShaderSrc, fragmentShaderSrc, "flat");
+
+    // --gpu-cull: culling and draw commands on the GPU; the scene then renders
+    // into a target whose depth the next frame's occlusion test can sample
+    GpuCuller gpuCuller;
+    DepthTextureTarget sceneTarget;
+    if (gpuCull && !(gpu_culling_supported() && gpuCuller.create())) {
+        std::cerr << "GPU culling needs GL 4.3, using the CPU path\n";
+        gpuCull = false;
+    }
+    gpuCuller.set_occlusion(occlusion);
+
+    // buffers (shared vertices + indices + instances, same layout as part2)
+    // are uploaded per mesh as the loader delivers them
+    Scene scene;
+    meshLoader.start(loadOptions, [] { glfwPostEmptyEvent(); });
+    for (auto& f : filenames) meshLoader.request(f);
+    if (bench.enabled) {
+        scene_wait_loads(scene, meshLoader, instances);
+        if (scene.meshes.empty()) return -1;
+    }
+    bool framed = false; // the camera follows the scene until the initial files are in
 
     glEnable(GL_DEPTH_TEST);
 
-    // initial camera
-    float maxRadius = 0.0f;
-    for (auto& p : positions)
-        maxRadius = std::max(maxRadius, glm::length(p - centroid));
-
-    cameraRadius = maxRadius * 2.0f;
+    GLint uViewProj = glGetUniformLocation(programCache.wait(program), "uViewProj");
 
-    GLint uMVP = glGetUniformLocation(program, "uMVP");
-    GLint uModel = glGetUniformLocation(program, "uModel");
+    FrameProfiler profiler;
+    profiler.set_collect(bench.enabled);
+    if (bench.enabled) profiler.set_report_stream(std::cerr); // stdout is left to the JSON
+    profiler.init(profile, profileCsv, bench.enabled ? (size_t)bench.frames : 300);
 
-    glm::mat4 model = glm::translate(glm::mat4(1.0f), -centroid);
+    framePacer.init(window, redraw);
 
-    while (!glfwWindowShouldClose(window)) {
+    int frame = 0;
+    double benchStart = glfwGetTime();
+    while (bench.enabled ? frame < bench.frames : !glfwWindowShouldClose(window)) {
+        profiler.begin_frame();
+        profiler.begin_stage(FrameProfiler::STAGE_EVENTS);
         glfwPollEvents();
+        framePacer.begin_frame();
+        if (scene_poll_loads(scene, meshLoader, instances) && !framed) cameraRadius = scene.radius * 2.0f;
+        if (meshLoader.idle()) framed = true;
+        profiler.end_stage(FrameProfiler::STAGE_EVENTS);
+
+        float maxRadius = scene.radius;
+        float farPlane = std::max(100.0f, maxRadius * 8.0f);
 
         int width, height;
-        glfwGetFramebufferSize(window, &width, &height);
+        if (bench.enabled) {
+            bench_camera(frame, bench.frames, maxRadius * 2.0f, cameraTheta, cameraRadius);
+            target.bind();
+            width = target.width; height = target.height;
+        }
+        else glfwGetFramebufferSize(window, &width, &height);
         float aspect = (float)width / (float)height;
+        GLuint outputFbo = bench.enabled ? target.fbo : 0;
+        if (gpuCull) {
+            sceneTarget.resize(width, height);
+            sceneTarget.bind();
+        }
 
         glViewport(0, 0, width, height);
+        profiler.begin_gpu();
         glClearColor(0.1f, 0.1f, 0.12f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -250,29 +234,60 @@ int main(int argc, char** argv) {
 
         glm::mat4 proj;
         if (usePerspective)
-            proj = glm::perspective(glm::radians(45.0f), aspect, 0.01f, 100.0f);
+            proj = glm::perspective(glm::radians(45.0f), aspect, 0.01f, farPlane);
         else {
             float s = maxRadius * 2.0f;
-            proj = glm::ortho(-s * aspect, s * aspect, -s, s, -100.0f, 100.0f);
+            proj = glm::ortho(-s * aspect, s * aspect, -s, s, -farPlane, farPlane);
         }
 
-        glm::mat4 mvp = proj * view * model;
+        glm::mat4 viewProj = proj * view;
+
+        profiler.begin_stage(FrameProfiler::STAGE_CULL);
+        scene.cull = useCulling;
+        lod.eye = camPos;
+        lod.perspective = usePerspective;
+        lod.pixelsPerUnit = usePerspective ? height / (2.0f * std::tan(glm::radians(45.0f) * 0.5f))
+            : height / (4.0f * maxRadius);
+        if (gpuCull) gpuCuller.cull(scene, viewProj, lod);
+        else scene_cull(scene, viewProj, lod);
+        profiler.end_stage(FrameProfiler::STAGE_CULL);
 
+        profiler.begin_stage(FrameProfiler::STAGE_UNIFORMS);
         glUseProgram(program);
-        glUniformMatrix4fv(uMVP, 1, GL_FALSE, glm::value_ptr(mvp));
-        glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(model));
+        glUniformMatrix4fv(uViewProj, 1, GL_FALSE, glm::value_ptr(viewProj));
+        profiler.end_stage(FrameProfiler::STAGE_UNIFORMS);
+
+        profiler.begin_triangles();
+        if (gpuCull) gpuCuller.draw(scene);
+        else draw_scene(scene);
+        profiler.end_triangles();
+        if (gpuCull) {
+            gpuCuller.build_hiz(sceneTarget.depth, width, height);
+            sceneTarget.blit_to(outputFbo);
+        }
+        profiler.end_gpu();
 
-        glBindVertexArray(vao);
-        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
-        glBindVertexArray(0);
+        if (!bench.enabled) glfwSwapBuffers(window);
+        ++frame;
+
+        profiler.end_frame();
+        if (!bench.enabled) framePacer.wait(false, [] { return meshLoader.has_results(); });
+    }
 
-        glfwSwapBuffers(window);
+    if (bench.enabled) {
+        profiler.flush();
+        print_bench_json(std::cout, "part1", scene_name(scene), bench, scene_vertex_count(scene), scene_triangle_count(scene),
+            glfwGetTime() - benchStart, profiler, std::string("\"gpu_cull\": ") + (gpuCull ? "true" : "false"));
+        target.destroy();
     }
 
     // cleanup
+    meshLoader.stop();
+    profiler.shutdown();
     glDeleteProgram(program);
-    glDeleteBuffers(1, &vbo);
-    glDeleteVertexArrays(1, &vao);
+    gpuCuller.destroy();
+    sceneTarget.destroy();
+    destroy_scene(scene);
     glfwDestroyWindow(window);
     glfwTerminate();
 
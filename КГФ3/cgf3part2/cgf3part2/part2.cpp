@@ -1,6 +1,19 @@
 // part2.cpp
-// Build: g++ part2.cpp glad.c -ldl -lglfw -lGL -I/path/to/glad/include -I/path/to/glm -o part2
-// Run: ./part2 bound-bunny_200.smf
+// Build: g++ part2.cpp glad.c -pthread -ldl -lglfw -lGL -I/path/to/glad/include -I/path/to/glm -o part2
+// Run: ./part2 [--optimize] [--normals uniform|area|angle] [--adjacency] [--profile] [--profile-csv frames.csv] bound-bunny_200.smf
+//      ./part2 [--instances N] [--no-cull] [--lods N] [--lod-error PX] a.smf b.smf ...    (several meshes, N copies of each)
+//      ./part2 --on-demand [--fps-cap 60] bound-bunny_200.smf    (redraw only on input / resize / load)
+//      Meshes load in the background; drop more .smf files onto the window to add them.
+//      ./part2 --deform bound-bunny_200.smf    (vertices rewritten every frame through a persistent mapped ring)
+//      ./part2 --shading 4 [--lights 256] bound-bunny_200.smf    (deferred: G-buffer + instanced point-light volumes)
+//      ./part2 --shading 2 --depth-prepass bound-bunny_200.smf    (depth-only pass first, then shade with GL_EQUAL)
+//      ./part2 --shading 2 --shadows point|directional bound-bunny_200.smf    (PCF shadows from the orbiting light)
+//      ./part2 --shader-cache DIR | --no-shader-cache ...    (linked programs are cached as driver binaries, default ./shader_cache)
+//      ./part2 --gpu-cull [--no-occlusion] --instances 20000 bound-bunny_200.smf    (GL 4.3: compute culling + indirect draws)
+//      ./part2 --paged scan.smfp [--page-pool 256]    (out-of-core: pages streamed through a fixed GPU pool, see tools/smfpage.cpp)
+//      ./part2 --msaa 4 [--render-scale 0.75] [--dynamic-res 8] bound-bunny_200.smf    (offscreen target, upscaled; scale follows GPU time)
+//      ./part2 --thumbnails out_dir [--thumb-size 256x256] assets/ more.smf ...    (one PNG per file, one hidden GL context)
+//      ./part2 --bench [--bench-frames 1000] [--bench-size 1920x1080] [--shading 1|2|3|4] [--depth-prepass] bound-bunny_200.smf
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -9,16 +22,27 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <vector>
 #include <string>
 #include <cmath>
-
-struct Vertex {
-    glm::vec3 pos;
-    glm::vec3 normal;
-};
+#include <cstring>
+#include <algorithm>
+
+#include "../../common/async_loader.h"
+#include "../../common/bench.h"
+#include "../../common/deferred.h"
+#include "../../common/frame_pacer.h"
+#include "../../common/frame_profiler.h"
+#include "../../common/gl_mesh.h"
+#include "../../common/gpu_culling.h"
+#include "../../common/mesh_cache.h"
+#include "../../common/paged_mesh.h"
+#include "../../common/program_cache.h"
+#include "../../common/render_target.h"
+#include "../../common/scene.h"
+#include "../../common/shader_variant.h"
+#include "../../common/shadow_map.h"
+#include "../../common/thumbnail.h"
 
 struct Material {
     glm::vec4 ambient;
@@ -35,198 +59,390 @@ struct Light {
     bool inCameraSpace; // if true, position is relative to camera (eye)
 };
 
-// SMF loader
-bool load_smf(const std::string& filename,
-    std::vector<glm::vec3>& out_positions,
-    std::vector<glm::uvec3>& out_faces) {
-    std::ifstream in(filename);
-    if (!in) return false;
-    std::string line;
-    std::vector<glm::vec3> positions;
-    std::vector<glm::uvec3> faces;
-    while (std::getline(in, line)) {
-        if (line.size() == 0) continue;
-        std::istringstream iss(line);
-        char t;
-        iss >> t;
-        if (t == 'v') {
-            float x, y, z; iss >> x >> y >> z;
-            positions.emplace_back(x, y, z);
-        }
-        else if (t == 'f') {
-            unsigned a, b, c; iss >> a >> b >> c;
-            faces.emplace_back(a - 1, b - 1, c - 1);
-        }
-    }
-    out_positions = std::move(positions);
-    out_faces = std::move(faces);
-    return true;
-}
+// std140 mirrors of the MaterialBlock / LightBlock uniform blocks
+struct MaterialStd140 {
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    float shininess;
+    float pad[3];
+};
 
-GLuint compile_shader(GLenum type, const char* src) {
-    GLuint s = glCreateShader(type);
-    glShaderSource(s, 1, &src, nullptr);
-    glCompileShader(s);
-    GLint ok; glGetShaderiv(s, GL_COMPILE_STATUS, &ok);
-    if (!ok) {
-        char buf[1024]; glGetShaderInfoLog(s, 1024, nullptr, buf);
-        std::cerr << "Shader compile error: " << buf << "\n";
-    }
-    return s;
+struct LightStd140 {
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    glm::vec3 position;
+    float pad;
+};
+
+const int VIEWER_LIGHT_COUNT = 2; // the orbiting light and the one at the eye
+
+struct LightBlockStd140 {
+    LightStd140 lights[VIEWER_LIGHT_COUNT];
+    glm::vec3 eyePos;
+    float pad;
+};
+
+static_assert(sizeof(MaterialStd140) == 64 && sizeof(LightStd140) == 64 && sizeof(LightBlockStd140) == 144,
+    "uniform block mirrors must match std140 layout");
+
+const GLuint MATERIAL_BLOCK_BINDING = 0;
+const GLuint LIGHT_BLOCK_BINDING = 1;
+const GLuint MATERIAL_TABLE_BINDING = 2; // deferred path: every material, indexed by the G-buffer id
+const int MATERIAL_TABLE_SIZE = 8;
+const GLuint SHADOW_TEXTURE_UNIT = 3; // above the G-buffer's 0 and 1
+
+MaterialStd140 to_std140(const Material& m) {
+    return { m.ambient, m.diffuse, m.specular, m.shininess, { 0.0f, 0.0f, 0.0f } };
 }
 
-GLuint create_program(const char* vsrc, const char* fsrc) {
-    GLuint vs = compile_shader(GL_VERTEX_SHADER, vsrc);
-    GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fsrc);
-    GLuint p = glCreateProgram();
-    glAttachShader(p, vs);
-    glAttachShader(p, fs);
-    glLinkProgram(p);
-    GLint ok; glGetProgramiv(p, GL_LINK_STATUS, &ok);
-    if (!ok) {
-        char buf[1024]; glGetProgramInfoLog(p, 1024, nullptr, buf);
-        std::cerr << "Program link error: " << buf << "\n";
-    }
-    glDeleteShader(vs); glDeleteShader(fs);
-    return p;
+LightStd140 to_std140(const Light& l) {
+    // positions are always passed in world coords, whatever space the light follows
+    return { l.ambient, l.diffuse, l.specular, l.position, 0.0f };
 }
 
-// GLSL sources are provided below (gouraud and phong). We'll create two shader programs at runtime and switch.
+// Uniform locations, looked up once after linking. Model and normal matrices
+// are per-instance attributes (see scene.h).
+struct ProgramUniforms {
+    GLint uViewProj = -1;
+    GLint uInvViewProj = -1; // deferred lighting passes
+    GLint uMaterialId = -1;  // G-buffer pass
+    // shadowed variants (shadow_map.h)
+    GLint uShadowMatrix = -1;
+    GLint uShadowLightPos = -1;
+    GLint uShadowNearFar = -1;
+    GLint uShadowNormalOffset = -1;
+};
 
-static const char* gouraud_vert = R"(
-#version 330 core
-layout(location=0) in vec3 aPos;
-layout(location=1) in vec3 aNormal;
+ProgramUniforms get_program_uniforms(GLuint p) {
+    ProgramUniforms u;
+    u.uViewProj = glGetUniformLocation(p, "uViewProj");
+    u.uInvViewProj = glGetUniformLocation(p, "uInvViewProj");
+    u.uMaterialId = glGetUniformLocation(p, "uMaterialId");
+    u.uShadowMatrix = glGetUniformLocation(p, "uShadowMatrix");
+    u.uShadowLightPos = glGetUniformLocation(p, "uShadowLightPos");
+    u.uShadowNearFar = glGetUniformLocation(p, "uShadowNearFar");
+    u.uShadowNormalOffset = glGetUniformLocation(p, "uShadowNormalOffset");
+
+    GLuint mat = glGetUniformBlockIndex(p, "MaterialBlock");
+    GLuint lights = glGetUniformBlockIndex(p, "LightBlock");
+    if (mat != GL_INVALID_INDEX) glUniformBlockBinding(p, mat, MATERIAL_BLOCK_BINDING);
+    if (lights != GL_INVALID_INDEX) glUniformBlockBinding(p, lights, LIGHT_BLOCK_BINDING);
+    GLuint table = glGetUniformBlockIndex(p, "MaterialTable");
+    if (table != GL_INVALID_INDEX) glUniformBlockBinding(p, table, MATERIAL_TABLE_BINDING);
+
+    // G-buffer and shadow samplers (see GBuffer::bind_textures) never change
+    GLint gNormal = glGetUniformLocation(p, "gNormalMaterial");
+    GLint gDepth = glGetUniformLocation(p, "gDepth");
+    GLint shadow = glGetUniformLocation(p, "uShadowMap");
+    if (shadow < 0) shadow = glGetUniformLocation(p, "uShadowCube");
+    if (gNormal >= 0 || gDepth >= 0 || shadow >= 0) {
+        glUseProgram(p);
+        glUniform1i(gNormal, 0);
+        glUniform1i(gDepth, 1);
+        glUniform1i(shadow, SHADOW_TEXTURE_UNIT);
+        glUseProgram(0);
+    }
+    return u;
+}
 
-uniform mat4 uModel;
-uniform mat4 uView;
-uniform mat4 uProj;
+// Forward shading programs, specialized per mode by shader_variant.h: the
+// builder prepends the #defines and SUM_LIGHTS, then these chunks.
+//
+// The lighting model shared by the Gouraud vertex stage, the Phong / flat
+// fragment stages and the deferred lighting passes. Light positions are
+// always world space. Forward programs read one MaterialBlock; the deferred
+// ones (MATERIAL_COUNT > 0) get the whole table and readGBuffer() sets
+// `material` per pixel.
+static const char* lighting_glsl = R"(
+struct Light {
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec3 position;
+};
 
+#if MATERIAL_COUNT
 struct Material {
     vec4 ambient;
     vec4 diffuse;
     vec4 specular;
     float shininess;
 };
-struct Light {
+layout(std140) uniform MaterialTable {
+    Material materials[MATERIAL_COUNT];
+};
+Material material;
+#else
+layout(std140) uniform MaterialBlock {
     vec4 ambient;
     vec4 diffuse;
     vec4 specular;
-    vec3 position; // in same space as calculation
-    int inCameraSpace;
+    float shininess;
+} material;
+#endif
+layout(std140) uniform LightBlock {
+    Light lights[LIGHT_COUNT];
+    vec3 eyePos; // in world coords
 };
 
-uniform Material material;
-uniform Light light0;
-uniform Light light1;
-uniform vec3 eyePos; // in world coords
-
-out vec3 vColor;
-
-vec3 calcPhongColor(vec3 pos, vec3 N, Light light) {
+// visibility: 1 = lit, 0 = in shadow; ambient is never shadowed
+vec3 calcLight(Light light, vec3 pos, vec3 N, float visibility) {
     vec3 ambient = vec3(light.ambient * material.ambient);
-    vec3 L;
-    if (light.inCameraSpace == 1) {
-        // light in view space: transform pos to view and compute there (we pass light in view space to shader for simplicity)
-        // We'll assume light.position is provided in view space and pos is in view space.
-        // But for simplicity we'll convert both to world space externally; here we just compute with world-space positions.
-    }
-    vec3 lightDir = normalize(light.position - pos);
-    float diff = max(dot(N, lightDir), 0.0);
+    vec3 L = normalize(light.position - pos);
+    float diff = max(dot(N,L), 0.0);
     vec3 diffuse = vec3(light.diffuse * material.diffuse) * diff;
     vec3 V = normalize(eyePos - pos);
-    vec3 R = reflect(-lightDir, N);
+    vec3 R = reflect(-L, N);
     float spec = 0.0;
     if (diff>0.0) spec = pow(max(dot(R,V),0.0), material.shininess);
     vec3 specular = vec3(light.specular * material.specular) * spec;
-    return ambient + diffuse + specular;
+    return ambient + (diffuse + specular) * visibility;
 }
 
+// Light 0's shadow map. Every texture() on a shadow sampler is a 2x2 PCF tap
+// in hardware (linear filtering + compare mode); the loops add more taps.
+#if SHADOW_DIRECTIONAL
+uniform sampler2DShadow uShadowMap;
+uniform mat4 uShadowMatrix; // world -> shadow map coords and depth
+uniform float uShadowNormalOffset;
+
+float shadowVisibility(vec3 pos, vec3 N) {
+    vec4 p = uShadowMatrix * vec4(pos + N * uShadowNormalOffset, 1.0);
+    float ref = min(p.z, 1.0); // past the far plane counts as lit
+    vec2 texel = 1.0 / vec2(textureSize(uShadowMap, 0));
+    float lit = 0.0;
+    for (int y = -1; y <= 1; ++y)
+        for (int x = -1; x <= 1; ++x)
+            lit += texture(uShadowMap, vec3(p.xy + vec2(x, y) * texel, ref));
+    return lit / 9.0;
+}
+#endif
+#if SHADOW_POINT
+uniform samplerCubeShadow uShadowCube;
+uniform vec3 uShadowLightPos;
+uniform vec2 uShadowNearFar;
+uniform float uShadowNormalOffset;
+
+// The depth the cube face along the major axis of d stores at distance z.
+float cubeDepth(float z) {
+    float n = uShadowNearFar.x, f = uShadowNearFar.y;
+    return (f + n) / (2.0 * (f - n)) + 0.5 - f * n / ((f - n) * z);
+}
+
+float shadowVisibility(vec3 pos, vec3 N) {
+    vec3 d = pos + N * uShadowNormalOffset - uShadowLightPos;
+    float z = max(max(abs(d.x), abs(d.y)), abs(d.z));
+    float ref = cubeDepth(z);
+    float texel = 2.0 * z / float(textureSize(uShadowCube, 0).x); // one texel at that distance
+    float lit = 0.0;
+    for (int i = 0; i < 8; ++i) {
+        vec3 o = vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1) * 2.0 - 1.0;
+        lit += texture(uShadowCube, vec4(d + o * texel, ref));
+    }
+    return lit / 8.0;
+}
+#endif
+)";
+
+static const char* lit_vert = R"(
+layout(location=0) in vec3 aPos;    // quantized to [0, 1]; aModel includes the dequantization
+layout(location=1) in vec2 aNormal; // octahedral
+layout(location=2) in mat4 aModel;
+layout(location=6) in mat3 aNormalMatrix; // transpose(inverse(mat3(object-to-world))), computed on the CPU
+
+uniform mat4 uViewProj;
+
+invariant gl_Position; // must match depth_vert bit for bit, the pre-pass tests GL_EQUAL
+
+#if SHADING_GOURAUD
+out vec3 vColor;
+#else
+out vec3 FragPos;
+#if NORMALS_OCTAHEDRAL
+out vec3 Normal;
+#endif
+#endif
+
+#if NORMALS_OCTAHEDRAL
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+#endif
+
 void main(){
-    mat4 model = uModel;
-    vec3 worldPos = vec3(model * vec4(aPos,1.0));
-    vec3 worldN = normalize(mat3(transpose(inverse(model))) * aNormal);
-
-    vec3 color = vec3(0.0);
-    color += calcPhongColor(worldPos, worldN, light0);
-    color += calcPhongColor(worldPos, worldN, light1);
-    vColor = color;
-    gl_Position = uProj * uView * model * vec4(aPos, 1.0);
+    vec4 world = aModel * vec4(aPos,1.0);
+#if SHADING_GOURAUD
+    vec3 N = normalize(aNormalMatrix * octDecode(aNormal));
+    vColor = SUM_LIGHTS(world.xyz, N);
+#else
+    FragPos = world.xyz;
+#if NORMALS_OCTAHEDRAL
+    Normal = aNormalMatrix * octDecode(aNormal);
+#endif
+#endif
+    gl_Position = uViewProj * world;
 }
 )";
 
-static const char* gouraud_frag = R"(
-#version 330 core
-in vec3 vColor;
+// Flat shading works on the same indexed buffers: the face normal comes from
+// the screen-space derivatives of the interpolated world position instead of
+// per-corner duplicated normals.
+static const char* lit_frag = R"(
 out vec4 FragColor;
+
+#if SHADING_GOURAUD
+in vec3 vColor;
+
 void main(){
     FragColor = vec4(vColor, 1.0);
 }
+#else
+in vec3 FragPos;
+#if NORMALS_OCTAHEDRAL
+in vec3 Normal;
+#endif
+
+void main(){
+#if NORMALS_OCTAHEDRAL
+    vec3 N = normalize(Normal);
+#else
+    // constant over the triangle, and always facing the viewer
+    vec3 N = normalize(cross(dFdx(FragPos), dFdy(FragPos)));
+#endif
+    FragColor = vec4(SUM_LIGHTS(FragPos, N), 1.0);
+}
+#endif
 )";
 
-static const char* phong_vert = R"(
+// shadingMode 1..3; each is built per shadow kind on first use
+static const ShadingModel FORWARD_MODELS[] = { SHADING_GOURAUD, SHADING_PHONG, SHADING_FLAT };
+static const char* FORWARD_NAMES[] = { "gouraud", "phong", "flat" };
+static const char* SHADOW_NAMES[] = { "off", "directional", "point" };
+
+// Depth pre-pass: positions only, computed exactly as in lit_vert, and no
+// colour output, so the shading pass can test GL_EQUAL and run once per pixel.
+static const char* depth_vert = R"(
 #version 330 core
 layout(location=0) in vec3 aPos;
-layout(location=1) in vec3 aNormal;
+layout(location=2) in mat4 aModel;
 
-uniform mat4 uModel;
-uniform mat4 uView;
-uniform mat4 uProj;
+uniform mat4 uViewProj;
 
-out vec3 FragPos;
-out vec3 Normal;
+invariant gl_Position;
 
 void main(){
-    FragPos = vec3(uModel * vec4(aPos,1.0));
-    Normal = mat3(transpose(inverse(uModel))) * aNormal;
-    gl_Position = uProj * uView * uModel * vec4(aPos,1.0);
+    vec4 world = aModel * vec4(aPos,1.0);
+    gl_Position = uViewProj * world;
 }
 )";
 
-static const char* phong_frag = R"(
+static const char* depth_frag = R"(
+#version 330 core
+void main(){}
+)";
+
+// Deferred path. The geometry pass runs the Phong lit_vert and stores the
+// world normal and material id; depth comes with the depth attachment.
+static const char* gbuffer_frag = R"(
 #version 330 core
 in vec3 FragPos;
 in vec3 Normal;
+uniform float uMaterialId;
+layout(location=0) out vec4 gNormalMaterial;
+
+void main(){
+    gNormalMaterial = vec4(normalize(Normal), uMaterialId);
+}
+)";
+
+// One triangle covering the screen, generated from gl_VertexID (no buffers).
+static const char* fullscreen_vert = R"(
+#version 330 core
+void main(){
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// Shared head of both lighting passes, after lighting_glsl: reads the
+// G-buffer at this pixel and rebuilds the world position from depth.
+static const char* deferred_common = R"(
 out vec4 FragColor;
 
-struct Material {
-    vec4 ambient;
-    vec4 diffuse;
-    vec4 specular;
-    float shininess;
-};
-struct Light {
-    vec4 ambient;
-    vec4 diffuse;
-    vec4 specular;
-    vec3 position;
-    int inCameraSpace;
-};
+uniform sampler2D gNormalMaterial;
+uniform sampler2D gDepth;
+uniform mat4 uInvViewProj;
+
+vec3 FragPos;
+vec3 N;
+
+// false for background pixels
+bool readGBuffer(){
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, p, 0).r;
+    if (depth >= 1.0) return false;
+    vec4 nm = texelFetch(gNormalMaterial, p, 0);
+    vec2 uv = gl_FragCoord.xy / vec2(textureSize(gDepth, 0));
+    vec4 world = uInvViewProj * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    FragPos = world.xyz / world.w;
+    N = normalize(nm.xyz);
+    material = materials[clamp(int(nm.w + 0.5), 0, MATERIAL_COUNT - 1)];
+    return true;
+}
+)";
 
-uniform Material material;
-uniform Light light0;
-uniform Light light1;
-uniform vec3 eyePos;
+// Full-screen pass: ambient plus the viewer lights, as in lit_frag.
+static const char* deferred_frag = R"(
+void main(){
+    if (!readGBuffer()) discard;
+    FragColor = vec4(SUM_LIGHTS(FragPos, N), 1.0);
+}
+)";
 
-vec3 calcLight(Light light, vec3 pos, vec3 N) {
-    vec3 ambient = vec3(light.ambient * material.ambient);
-    vec3 L = normalize(light.position - pos);
-    float diff = max(dot(N,L), 0.0);
-    vec3 diffuse = vec3(light.diffuse * material.diffuse) * diff;
-    vec3 V = normalize(eyePos - pos);
-    vec3 R = reflect(-L, N);
-    float spec = 0.0;
-    if (diff>0.0) spec = pow(max(dot(R,V),0.0), material.shininess);
-    vec3 specular = vec3(light.specular * material.specular) * spec;
-    return ambient + diffuse + specular;
+// Point lights: one instanced sphere per light (see deferred.h), added on top.
+static const char* light_volume_vert = R"(
+#version 330 core
+layout(location=0) in vec3 aPos; // unit volume
+layout(location=1) in vec4 aLightPosRadius;
+layout(location=2) in vec4 aLightColor;
+
+uniform mat4 uViewProj;
+
+flat out vec4 LightPosRadius;
+flat out vec3 LightColor;
+
+void main(){
+    LightPosRadius = aLightPosRadius;
+    LightColor = aLightColor.rgb;
+    gl_Position = uViewProj * vec4(aLightPosRadius.xyz + aPos * aLightPosRadius.w, 1.0);
 }
+)";
+
+static const char* light_volume_frag = R"(
+flat in vec4 LightPosRadius;
+flat in vec3 LightColor;
 
 void main(){
-    vec3 N = normalize(Normal);
-    vec3 color = vec3(0.0);
-    color += calcLight(light0, FragPos, N);
-    color += calcLight(light1, FragPos, N);
-    FragColor = vec4(color, 1.0);
+    if (!readGBuffer()) discard;
+    vec3 L = LightPosRadius.xyz - FragPos;
+    float d2 = dot(L, L), r2 = LightPosRadius.w * LightPosRadius.w;
+    if (d2 >= r2) discard;
+    // smooth falloff to exactly zero at the radius
+    float falloff = 1.0 - d2 / r2;
+    falloff *= falloff;
+    L *= inversesqrt(d2);
+    float diff = max(dot(N,L), 0.0);
+    vec3 V = normalize(eyePos - FragPos);
+    float spec = 0.0;
+    if (diff>0.0) spec = pow(max(dot(reflect(-L, N),V),0.0), material.shininess);
+    vec3 color = LightColor * (material.diffuse.rgb * diff + material.specular.rgb * spec);
+    FragColor = vec4(color * falloff, 1.0);
 }
 )";
 
@@ -234,14 +450,44 @@ void main(){
 float camAngle = 0.0f, camRadius = 2.0f, camHeight = 0.0f;
 float lightAngle = 0.0f, lightRadius = 2.0f, lightHeight = 0.0f;
 bool perspectiveProj = true;
-int shadingMode = 1; // 1=gouraud, 2=phong
+int shadingMode = 1; // 1=gouraud, 2=phong, 3=flat, 4=deferred
 int currentMaterial = 0;
+bool cullingEnabled = true;
+bool depthPrepass = false; // Phong / flat only: they shade per fragment
+ShadowKind shadowKind = SHADOW_NONE; // light 0, Phong / flat only
+
+// --on-demand: frames are only drawn when input or a window event asks for one
+FramePacer frame_pacer;
+
+// Live-deformation demo for the dynamic geometry path: every vertex is pulled
+// toward the centroid by a wave travelling up the mesh. Works on the packed
+// positions directly; scaling toward the centroid keeps them inside the AABB
+// they are quantized to. Normals are left as loaded.
+void deform_breathing(const CachedMesh& mesh, float time, SmfbVertex* out) {
+    glm::vec3 c = (mesh.centroid() - mesh.boundsMin()) / mesh.quantizeExtent();
+    const size_t block = 1u << 14;
+    size_t count = mesh.vertexCount();
+    thread_pool().parallel_for((count + block - 1) / block, [&](size_t b) {
+        size_t end = std::min(count, (b + 1) * block);
+        for (size_t i = b * block; i < end; ++i) {
+            SmfbVertex v = mesh.vertices[i];
+            glm::vec3 q(v.pos[0] / 65535.0f, v.pos[1] / 65535.0f, v.pos[2] / 65535.0f);
+            float s = 1.0f - 0.15f * (0.5f + 0.5f * std::sin(time * 3.0f - q.z * 12.0f));
+            glm::vec3 p = c + (q - c) * s;
+            for (int k = 0; k < 3; ++k) v.pos[k] = quantize_unorm16(p[k]);
+            out[i] = v;
+        }
+    });
+}
 
 void print_controls() {
     std::cout << "Controls:\n"
         << "A/D: camera angle  W/S: radius  Q/E: height\n"
         << "J/L: light angle  I/K: light radius  U/O: light height\n"
-        << "1: Gouraud  2: Phong  M: change material  P: toggle projection\n"
+        << "1: Gouraud  2: Phong  3: Flat  4: Deferred (point lights)  M: change material  P: toggle projection\n"
+        << "C: toggle frustum culling  Z: toggle depth pre-pass (Phong / Flat)\n"
+        << "H: light 0 shadows off / directional / point (Phong / Flat)\n"
+        << "Drop .smf files onto the window to add them\n"
         << "Esc: exit\n";
 }
 
@@ -264,60 +510,106 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         if (key == GLFW_KEY_P) perspectiveProj = !perspectiveProj;
         if (key == GLFW_KEY_1) shadingMode = 1;
         if (key == GLFW_KEY_2) shadingMode = 2;
+        if (key == GLFW_KEY_3) shadingMode = 3;
+        if (key == GLFW_KEY_4) shadingMode = 4;
         if (key == GLFW_KEY_M && action == GLFW_PRESS) currentMaterial = (currentMaterial + 1) % 3;
+        if (key == GLFW_KEY_C && action == GLFW_PRESS) cullingEnabled = !cullingEnabled;
+        if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+            depthPrepass = !depthPrepass;
+            std::cout << "Depth pre-pass " << (depthPrepass ? "on" : "off") << "\n";
+        }
+        if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+            shadowKind = (ShadowKind)((shadowKind + 1) % SHADOW_KIND_COUNT);
+            std::cout << "Shadows " << SHADOW_NAMES[shadowKind] << "\n";
+        }
         if (key == GLFW_KEY_ESCAPE) glfwSetWindowShouldClose(window, GLFW_TRUE);
+        frame_pacer.request_redraw(); // an unbound key just costs one frame
     }
 }
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " model.smf\n"; return -1;
-    }
-    std::string filename = argv[1];
-    std::vector<glm::vec3> positions;
-    std::vector<glm::uvec3> faces;
-    if (!load_smf(filename, positions, faces)) {
-        std::cerr << "Failed to open " << filename << "\n"; return -1;
-    }
+void framebuffer_size_callback(GLFWwindow* window, int w, int h) { frame_pacer.request_redraw(); }
+void refresh_callback(GLFWwindow* window) { frame_pacer.request_redraw(); }
 
-    // compute per-vertex averaged normals
-    std::vector<glm::vec3> faceNormals(faces.size());
-    for (size_t i = 0; i < faces.size(); ++i) {
-        glm::vec3 p0 = positions[faces[i].x], p1 = positions[faces[i].y], p2 = positions[faces[i].z];
-        glm::vec3 n = glm::normalize(glm::cross(p1 - p0, p2 - p0));
-        faceNormals[i] = n;
-    }
-    std::vector<glm::vec3> vertexNormals(positions.size(), glm::vec3(0.0f));
-    std::vector<int> counts(positions.size(), 0);
-    for (size_t i = 0; i < faces.size(); ++i) {
-        auto f = faces[i];
-        vertexNormals[f.x] += faceNormals[i];
-        vertexNormals[f.y] += faceNormals[i];
-        vertexNormals[f.z] += faceNormals[i];
-        counts[f.x]++; counts[f.y]++; counts[f.z]++;
+// background mesh loading; the window is usable while files are parsed
+AsyncMeshLoader mesh_loader;
 
+void drop_callback(GLFWwindow* window, int count, const char** paths) {
+    for (int i = 0; i < count; ++i) mesh_loader.request(paths[i]);
+}
 
+int main(int argc, char** argv) {
+    std::vector<std::string> filenames;
+    int instances = 1;
+    LodSelection lod;
+    MeshLoadOptions loadOptions;
+    bool profile = false;
+    bool deform = false;
+    int pointLightCount = 64;
+    bool gpu_cull = false, occlusion = true;
+    std::string shaderCacheDir = "shader_cache";
+    std::string profileCsv;
+    std::string pagedFile;
+    size_t pagePoolMb = PAGED_MESH_DEFAULT_POOL >> 20;
+    int msaaSamples = 0;
+    float renderScale = 1.0f;
+    double dynamicResMs = 0.0;
+    std::string thumbnailDir;
+    int thumbWidth = 256, thumbHeight = 256;
+    BenchOptions bench;
+    RedrawOptions redraw;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (parse_bench_option(argc, argv, i, bench)) continue;
+        if (parse_redraw_option(argc, argv, i, redraw)) continue;
+        if (arg == "--optimize") loadOptions.optimize = true;
+        else if (arg == "--adjacency") loadOptions.adjacency = true;
+        else if (arg == "--deform") deform = true;
+        else if (arg == "--normals" && i + 1 < argc) {
+            std::string w = argv[++i];
+            loadOptions.normalWeighting = w == "area" ? NORMAL_WEIGHT_AREA
+                : w == "angle" ? NORMAL_WEIGHT_ANGLE : NORMAL_WEIGHT_UNIFORM;
+        }
+        else if (arg == "--shading" && i + 1 < argc) shadingMode = std::min(4, std::max(1, atoi(argv[++i])));
+        else if (arg == "--lights" && i + 1 < argc) pointLightCount = std::max(0, atoi(argv[++i]));
+        else if (arg == "--profile") profile = true;
+        else if (arg == "--profile-csv" && i + 1 < argc) profileCsv = argv[++i];
+        else if (arg == "--instances" && i + 1 < argc) instances = std::max(1, atoi(argv[++i]));
+        else if (arg == "--no-cull") cullingEnabled = false;
+        else if (arg == "--depth-prepass") depthPrepass = true;
+        else if (arg == "--shadows" && i + 1 < argc) {
+            std::string k = argv[++i];
+            shadowKind = k == "point" ? SHADOW_POINT : k == "directional" ? SHADOW_DIRECTIONAL : SHADOW_NONE;
+        }
+        else if (arg == "--gpu-cull") gpu_cull = true;
+        else if (arg == "--no-occlusion") occlusion = false;
+        else if (arg == "--shader-cache" && i + 1 < argc) shaderCacheDir = argv[++i];
+        else if (arg == "--no-shader-cache") shaderCacheDir.clear();
+        else if (arg == "--paged" && i + 1 < argc) pagedFile = argv[++i];
+        else if (arg == "--page-pool" && i + 1 < argc) pagePoolMb = (size_t)std::max(1, atoi(argv[++i]));
+        else if (arg == "--msaa" && i + 1 < argc) msaaSamples = std::max(0, atoi(argv[++i]));
+        else if (arg == "--render-scale" && i + 1 < argc) renderScale = std::min(2.0f, std::max(0.25f, (float)atof(argv[++i])));
+        else if (arg == "--dynamic-res" && i + 1 < argc) dynamicResMs = std::max(0.0, atof(argv[++i]));
+        else if (arg == "--thumbnails" && i + 1 < argc) thumbnailDir = argv[++i];
+        else if (arg == "--thumb-size" && i + 1 < argc) {
+            int tw = 0, th = 0;
+            if (sscanf(argv[++i], "%dx%d", &tw, &th) == 2 && tw > 0 && th > 0) { thumbWidth = tw; thumbHeight = th; }
+        }
+        else if (arg == "--lods" && i + 1 < argc) loadOptions.lodLevels = (unsigned)std::max(0, atoi(argv[++i]));
+        else if (arg == "--lod-error" && i + 1 < argc) lod.maxErrorPixels = (float)atof(argv[++i]);
+        else if (is_directory(arg)) {
+            std::vector<std::string> found = list_smf_files(arg); // a directory stands for its .smf files
+            filenames.insert(filenames.end(), found.begin(), found.end());
+        }
+        else filenames.push_back(arg);
     }
-    for (size_t i = 0; i < vertexNormals.size(); ++i) {
-        if (counts[i] > 0) vertexNormals[i] = glm::normalize(vertexNormals[i] / (float)counts[i]);
-    }
-
-    // Build triangle list (positions + normals duplicated per triangle)
-    std::vector<Vertex> vertices;
-    vertices.reserve(faces.size() * 3);
-    for (auto& f : faces) {
-        vertices.push_back({ positions[f.x], vertexNormals[f.x] });
-        vertices.push_back({ positions[f.y], vertexNormals[f.y] });
-        vertices.push_back({ positions[f.z], vertexNormals[f.z] });
+    if (filenames.empty() && pagedFile.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--optimize] [--normals uniform|area|angle] [--adjacency] [--profile] [--profile-csv file.csv]"
+            " [--instances N] [--no-cull] [--lods N] [--lod-error PX] [--deform] [--on-demand] [--fps-cap N] [--bench] [--bench-frames N] [--bench-size WxH] [--shading 1|2|3|4] [--lights N] [--depth-prepass] [--shadows point|directional] [--gpu-cull] [--no-occlusion] [--shader-cache DIR] [--no-shader-cache] [--paged file.smfp] [--page-pool MB] [--msaa N] [--render-scale S] [--dynamic-res MS] [--thumbnails DIR] [--thumb-size WxH]"
+            " model.smf|dir [more.smf|dir ...]\n"; return -1;
     }
-
-    // find centroid & radius
-    glm::vec3 centroid(0.0f);
-    for (auto& p : positions) centroid += p;
-    centroid /= (float)positions.size();
-    float maxrad = 0.0f;
-    for (auto& p : positions) maxrad = std::max(maxrad, glm::length(p - centroid));
-    camRadius = maxrad * 2.5f;
+    const bool thumbnails = !thumbnailDir.empty();
+    if (thumbnails) bench.enabled = false;
+    const bool offscreen = bench.enabled || thumbnails;
     camAngle = 0.0f;
 
     // materials (3 distinct)
@@ -357,168 +649,497 @@ int main(int argc, char** argv) {
 
     // GLFW + GLAD init
     if (!glfwInit()) return -1;
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    GLFWwindow* window = glfwCreateWindow(1024, 768, "Part 2 - Shading", nullptr, nullptr);
+    if (offscreen) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = create_viewer_window(1024, 768, "Part 2 - Shading", gpu_cull);
     if (!window) { glfwTerminate(); return -1; }
     glfwMakeContextCurrent(window);
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) { std::cerr << "Failed to load GL\n"; return -1; }
     glfwSetKeyCallback(window, key_callback);
-    print_controls();
+    glfwSetDropCallback(window, drop_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, refresh_callback);
+
+    // bench / thumbnails: render offscreen at a fixed size, without vsync;
+    // stdout is left to the JSON
+    OffscreenTarget target;
+    if (offscreen) {
+        glfwSwapInterval(0);
+        if (!target.create(thumbnails ? thumbWidth : bench.width, thumbnails ? thumbHeight : bench.height)) return -1;
+    }
+    else print_controls();
 
     // Create shader programs
-    GLuint progG = create_program(gouraud_vert, gouraud_frag);
-    GLuint progP = create_program(phong_vert, phong_frag);
-
-    GLuint vao, vbo;
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
+    // Every program is requested before any is waited on, so uncached ones
+    // compile side by side (on driver threads with KHR_parallel_shader_compile)
+    ProgramCache program_cache;
+    program_cache.init(shaderCacheDir);
+    // forward[mode - 1][shadow kind]: the unshadowed ones and the startup
+    // --shadows kind are linked here, others requested when H first asks for
+    // them and used once the driver has linked them in the background
+    struct ForwardProgram {
+        GLuint program = 0;
+        bool ready = false;
+        ProgramUniforms u;
+    };
+    ForwardProgram forward[3][SHADOW_KIND_COUNT];
+    auto request_forward = [&](int k, ShadowKind s) {
+        ShaderVariant v = make_shader_variant(FORWARD_MODELS[k], VIEWER_LIGHT_COUNT, s);
+        ForwardProgram& f = forward[k][v.shadow]; // Gouraud ignores shadows
+        if (f.program) return;
+        bool perVertex = v.model == SHADING_GOURAUD; // which stage does the lighting
+        std::string name = std::string(FORWARD_NAMES[k]) + "/" + SHADOW_NAMES[v.shadow];
+        f.program = program_cache.request(shader_variant_source(v, { perVertex ? lighting_glsl : "", lit_vert }).c_str(),
+            shader_variant_source(v, { perVertex ? "" : lighting_glsl, lit_frag }).c_str(), name.c_str());
+    };
+    auto forward_program = [&](int k, ShadowKind s) -> const ForwardProgram& {
+        request_forward(k, s);
+        ForwardProgram& f = forward[k][make_shader_variant(FORWARD_MODELS[k], VIEWER_LIGHT_COUNT, s).shadow];
+        if (!f.ready) {
+            f.u = get_program_uniforms(program_cache.wait(f.program));
+            f.ready = true;
+        }
+        return f;
+    };
+    // Per frame: the variant if it is linked, nullptr while it still builds.
+    // Only waits without KHR_parallel_shader_compile, where nothing can tell.
+    auto forward_ready = [&](int k, ShadowKind s) -> const ForwardProgram* {
+        request_forward(k, s);
+        ForwardProgram& f = forward[k][make_shader_variant(FORWARD_MODELS[k], VIEWER_LIGHT_COUNT, s).shadow];
+        if (!f.ready) {
+            if (!program_cache.ready(f.program)) return nullptr;
+            f.u = get_program_uniforms(f.program);
+            f.ready = true;
+        }
+        return &f;
+    };
+    for (int k = 0; k < 3; ++k) {
+        request_forward(k, SHADOW_NONE);
+        request_forward(k, shadowKind);
+    }
+    GLuint progDepth = program_cache.request(depth_vert, depth_frag, "depth");
+    GLuint progGBuffer = program_cache.request(
+        shader_variant_source(make_shader_variant(SHADING_PHONG, VIEWER_LIGHT_COUNT), { lit_vert }).c_str(), gbuffer_frag,
+        "gbuffer");
+    const ShaderVariant deferredVariant = make_deferred_variant(VIEWER_LIGHT_COUNT, MATERIAL_TABLE_SIZE);
+    GLuint progDeferred = program_cache.request(fullscreen_vert,
+        shader_variant_source(deferredVariant, { lighting_glsl, deferred_common, deferred_frag }).c_str(), "deferred");
+    GLuint progLights = program_cache.request(light_volume_vert,
+        shader_variant_source(deferredVariant, { lighting_glsl, deferred_common, light_volume_frag }).c_str(), "light volumes");
+    for (int k = 0; k < 3; ++k) {
+        forward_program(k, SHADOW_NONE);
+        forward_program(k, shadowKind);
+    }
+    ProgramUniforms uniDepth = get_program_uniforms(program_cache.wait(progDepth));
+    ProgramUniforms uniGBuffer = get_program_uniforms(program_cache.wait(progGBuffer));
+    ProgramUniforms uniDeferred = get_program_uniforms(program_cache.wait(progDeferred));
+    ProgramUniforms uniLights = get_program_uniforms(program_cache.wait(progLights));
+    // --profile summaries; under --bench stdout only carries the JSON
+    std::ostream& info = bench.enabled ? std::cerr : std::cout;
+    if (profile)
+        info << "Programs: " << program_cache.hits() << " from cache, " << program_cache.misses() << " compiled"
+            << (program_cache.parallel() ? " in parallel" : "") << "\n";
+
+    // uniform buffers shared by all programs
+    GLuint materialUbo, lightUbo;
+    glGenBuffers(1, &materialUbo);
+    glGenBuffers(1, &lightUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, materialUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialStd140), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, lightUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlockStd140), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, materialUbo);
+    glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, lightUbo);
+    int uploadedMaterial = -1;
+    LightBlockStd140 uploadedLights;
+    bool lightsUploaded = false;
+
+    // deferred path: the material table is fixed, the G-buffer follows the
+    // framebuffer size and the point lights follow the scene radius
+    MaterialStd140 materialTable[MATERIAL_TABLE_SIZE] = {};
+    for (size_t i = 0; i < materials.size() && i < (size_t)MATERIAL_TABLE_SIZE; ++i) materialTable[i] = to_std140(materials[i]);
+    GLuint materialTableUbo;
+    glGenBuffers(1, &materialTableUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, materialTableUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(materialTable), materialTable, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_TABLE_BINDING, materialTableUbo);
+    GBuffer gbuffer;
+    LightVolumes lightVolumes;
+    lightVolumes.create();
+    float pointLightsRadius = -1.0f;
+    GLuint fullscreenVao; // core profile needs a VAO bound even with no attributes
+    glGenVertexArrays(1, &fullscreenVao);
+
+    // --gpu-cull: culling and draw commands on the GPU. Forward modes render
+    // into a target with sampleable depth for next frame's occlusion test;
+    // the deferred mode uses the G-buffer depth.
+    GpuCuller gpu_culler;
+    DepthTextureTarget scene_target;
+    if (gpu_cull && !(gpu_culling_supported() && gpu_culler.create())) {
+        std::cerr << "GPU culling needs GL 4.3, using the CPU path\n";
+        gpu_cull = false;
+    }
+    gpu_culler.set_occlusion(occlusion);
+
+    // light 0's shadow map, redrawn only when the light, the kind or the
+    // geometry changed; the depth pre-pass program renders it
+    ShadowMap shadow_map;
+    shadow_map.create();
+
+    // Shared vertices (12-byte packed) + element buffer (normals are per-vertex, so no duplication)
+    // plus the per-instance matrices, uploaded per mesh as the loader delivers them.
+    // Every instance is centered on its mesh centroid (precomputed with the mesh).
+    Scene scene;
+    mesh_loader.start(loadOptions, [] { glfwPostEmptyEvent(); });
+
+    // --thumbnails: each frame renders the next file alone and reads it back.
+    // The loader stays THUMBNAIL_PREFETCH files ahead, so the next meshes are
+    // parsed and preprocessed while the GPU draws this one
+    const size_t THUMBNAIL_PREFETCH = 2;
+    ThumbnailWriter thumbs;
+    size_t thumbRequested = 0, thumbFinished = 0;
+    std::set<std::string> thumbNames;
+    auto thumbnail_request = [&] {
+        while (thumbRequested < filenames.size() && thumbRequested - thumbFinished < THUMBNAIL_PREFETCH)
+            mesh_loader.request(filenames[thumbRequested++]);
+    };
+    // Swaps the scene for the next file that loads; false once all are done.
+    auto thumbnail_next = [&] {
+        destroy_scene(scene); // the last frame's draws are queued, GL frees the buffers after them
+        std::unique_ptr<LoadResult> r;
+        while (thumbFinished < filenames.size()) {
+            thumbs.poll();
+            if (!mesh_loader.poll(r)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (r->kind == LoadResult::LOAD_BOUNDS) continue; // no placeholder boxes here
+            ++thumbFinished;
+            thumbnail_request();
+            scene_apply_load(scene, *r, 1);
+            if (!scene.meshes.empty()) {
+                camRadius = scene.radius * 2.5f;
+                return true;
+            }
+            thumbs.note_failure();
+        }
+        return false;
+    };
+    if (thumbnails) {
+        make_directory(thumbnailDir);
+        thumbs.start();
+        thumbnail_request();
+    }
+    else
+        for (auto& f : filenames) mesh_loader.request(f);
+    // --paged: drawn next to the scene, centered like its instances; its
+    // pages never cast shadows, a shadow pass would have to stream them all
+    PagedMesh paged;
+    if (!pagedFile.empty()) {
+        if (!paged.open(pagedFile, pagePoolMb << 20, [] { glfwPostEmptyEvent(); })) return -1;
+        camRadius = paged.radius() * 2.5f;
+    }
+    if (bench.enabled) {
+        scene_wait_loads(scene, mesh_loader, instances);
+        if (scene.meshes.empty() && !paged.is_open()) return -1;
+    }
+    bool framed = false; // the camera follows the scene until the initial files are in
 
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0); glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, pos));
-    glEnableVertexAttribArray(1); glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-    glBindVertexArray(0);
+    // the pre-pass and the shading pass draw the same set, through either path
+    auto draw_all = [&] {
+        if (gpu_cull) gpu_culler.draw(scene);
+        else draw_scene(scene);
+        paged.draw();
+    };
 
     glEnable(GL_DEPTH_TEST);
 
-    // Uniform locations (we will query per program)
-    while (!glfwWindowShouldClose(window)) {
+    // --msaa / --render-scale / --dynamic-res: the scene renders into
+    // scaled_target, presented onto the output at the end of the frame.
+    // The G-buffer and the --gpu-cull depth target are single-sample, so
+    // those paths only scale; --dynamic-res moves the scale between half of
+    // --render-scale and --render-scale to keep GPU time under its budget
+    ScaledTarget scaled_target;
+    DynamicResolution dynamic_res;
+    dynamic_res.init(dynamicResMs, renderScale * 0.5f, renderScale);
+
+    FrameProfiler profiler;
+    profiler.set_collect(bench.enabled || dynamic_res.enabled());
+    if (bench.enabled) profiler.set_report_stream(std::cerr);
+    profiler.init(profile, profileCsv, bench.enabled ? (size_t)bench.frames : 300);
+
+    frame_pacer.init(window, redraw);
+
+    int frame = 0;
+    int renderedSamples = 0; // after the per-path override and the GL_MAX_SAMPLES clamp
+    double benchStart = glfwGetTime();
+    while (bench.enabled ? frame < bench.frames : thumbnails ? thumbnail_next() : !glfwWindowShouldClose(window)) {
+        profiler.begin_frame();
+        profiler.begin_stage(FrameProfiler::STAGE_EVENTS);
         glfwPollEvents();
+        frame_pacer.begin_frame();
+        if (!thumbnails && scene_poll_loads(scene, mesh_loader, instances) && !framed) camRadius = std::max(scene.radius, paged.radius()) * 2.5f;
+        if (mesh_loader.idle()) framed = true;
+        if (deform)
+            for (auto& m : scene.meshes)
+                if (!m->vertexStream.buffer()) scene_mesh_make_dynamic(*m);
+        profiler.end_stage(FrameProfiler::STAGE_EVENTS);
+        profiler.begin_gpu();
+
+        float maxrad = std::max(scene.radius, paged.radius());
+        float farPlane = std::max(100.0f, maxrad * 8.0f);
+
+        if (deform) {
+            // the CPU writes this frame's vertices while the GPU may still draw the last two;
+            // before the shadow pass, which has to see them
+            profiler.begin_stage(FrameProfiler::STAGE_GEOMETRY);
+            float t = bench.enabled ? frame / 60.0f : (float)glfwGetTime();
+            for (auto& m : scene.meshes) {
+                deform_breathing(m->mesh, t, scene_mesh_begin_vertices(*m));
+                scene_mesh_end_vertices(*m);
+            }
+            profiler.end_stage(FrameProfiler::STAGE_GEOMETRY);
+        }
 
-        int w, h; glfwGetFramebufferSize(window, &w, &h);
+        // compute light0 position in world/object coordinates (orbiting around object centroid)
+        glm::vec3 light0pos_world(lightRadius * cos(lightAngle), lightRadius * sin(lightAngle), lightHeight);
+        light0.position = glm::vec3(light0pos_world);
+
+        // light 0's shadow map: stale only when the light, the kind or the
+        // geometry changed, so camera moves never pay for a shadow pass. Runs
+        // before the camera cull, which then re-culls the shared visible set
+        ShadowKind shadows = (shadingMode == 2 || shadingMode == 3) ? shadowKind : SHADOW_NONE;
+        if (shadows != SHADOW_NONE) {
+            profiler.begin_stage(FrameProfiler::STAGE_SHADOWS);
+            if (deform) shadow_map.invalidate();
+            if (shadow_map.needs_update(shadows, light0.position, scene.radius, scene.layoutVersion)) {
+                shadow_map.update(shadows, light0.position, scene.radius, scene.layoutVersion,
+                    [&](const glm::mat4& lightViewProj, const glm::vec3& eye) {
+                        // casters off screen still cast: cull against the light instead. The six
+                        // cube faces share one unculled set, so its instances upload only once
+                        scene.cull = cullingEnabled && shadows == SHADOW_DIRECTIONAL;
+                        LodSelection casterLod = lod;
+                        casterLod.eye = eye;
+                        casterLod.perspective = shadows == SHADOW_POINT;
+                        casterLod.pixelsPerUnit = shadows == SHADOW_POINT ? shadow_map.size() * 0.5f
+                            : shadow_map.size() / (2.0f * maxrad);
+                        scene_cull(scene, lightViewProj, casterLod);
+                        glUseProgram(progDepth);
+                        glUniformMatrix4fv(uniDepth.uViewProj, 1, GL_FALSE, glm::value_ptr(lightViewProj));
+                        draw_scene(scene);
+                    });
+            }
+            profiler.end_stage(FrameProfiler::STAGE_SHADOWS);
+        }
+
+        int w, h;
+        if (offscreen) {
+            if (bench.enabled) bench_camera(frame, bench.frames, maxrad * 2.5f, camAngle, camRadius);
+            target.bind();
+            w = target.width; h = target.height;
+        }
+        else glfwGetFramebufferSize(window, &w, &h);
         float aspect = (float)w / (float)h;
-        glViewport(0, 0, w, h);
+        GLuint outputFbo = offscreen ? target.fbo : 0;
+
+        // render size: everything below draws at rw x rh into renderFbo
+        float scale = dynamic_res.enabled() ? dynamic_res.update(profiler) : renderScale;
+        int samples = gpu_cull || shadingMode == 4 ? 0 : msaaSamples;
+        bool scaled = scale != 1.0f || samples > 1;
+        int rw = scaled ? scaled_size(w, scale) : w, rh = scaled ? scaled_size(h, scale) : h;
+        if (scaled && !scaled_target.resize(rw, rh, samples)) {
+            scaled = false;
+            rw = w; rh = h;
+        }
+        GLuint renderFbo = scaled ? scaled_target.fbo : outputFbo;
+        renderedSamples = scaled ? scaled_target.samples : 0;
+        if (gpu_cull && shadingMode != 4) {
+            scene_target.resize(rw, rh);
+            scene_target.bind();
+        }
+        else glBindFramebuffer(GL_FRAMEBUFFER, renderFbo);
+        glViewport(0, 0, rw, rh);
         glClearColor(0.08f, 0.08f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // model transform (center model at origin)
-        glm::mat4 model = glm::translate(glm::mat4(1.0f), -centroid);
-
         // camera in world coords
         glm::vec3 camPos(camRadius * cos(camAngle), camRadius * sin(camAngle), camHeight);
         glm::mat4 view = glm::lookAt(camPos, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
         glm::mat4 proj;
-        if (perspectiveProj) proj = glm::perspective(glm::radians(45.0f), aspect, 0.01f, 100.0f);
+        if (perspectiveProj) proj = glm::perspective(glm::radians(45.0f), aspect, 0.01f, farPlane);
         else {
             float s = maxrad * 2.0f;
-            proj = glm::ortho(-s * aspect, s * aspect, -s, s, -100.0f, 100.0f);
+            proj = glm::ortho(-s * aspect, s * aspect, -s, s, -farPlane, farPlane);
         }
 
-        // compute light0 position in world/object coordinates (orbiting around object centroid)
-        glm::vec3 light0pos_world(lightRadius * cos(lightAngle), lightRadius * sin(lightAngle), lightHeight);
-        light0.position = glm::vec3(light0pos_world);
+        // per-frame constant; model / normal matrices are fixed per instance
+        glm::mat4 viewProj = proj * view;
+
+        profiler.begin_stage(FrameProfiler::STAGE_CULL);
+        scene.cull = cullingEnabled;
+        lod.eye = camPos;
+        lod.perspective = perspectiveProj;
+        lod.pixelsPerUnit = perspectiveProj ? rh / (2.0f * std::tan(glm::radians(45.0f) * 0.5f))
+            : rh / (4.0f * maxrad);
+        if (gpu_cull) gpu_culler.cull(scene, viewProj, lod);
+        else scene_cull(scene, viewProj, lod);
+        paged.update(viewProj, lod, cullingEnabled);
+        profiler.end_stage(FrameProfiler::STAGE_CULL);
 
         // light1 near eye (camera-space) - we want it in world coords so shaders use world positions
         glm::vec3 light1pos_world = camPos + glm::normalize(glm::vec3(0.0f) - camPos) * 0.1f + glm::vec3(0.0f, 0.0f, 0.1f);
         light1.position = light1pos_world;
 
-        // select program
-        GLuint activeProg = (shadingMode == 1) ? progG : progP;
+        // select program; a shadow variant that is still linking is stood in
+        // for by the unshadowed one (linked at startup) until it is done
+        const ForwardProgram* fp = nullptr;
+        if (shadingMode <= 3) {
+            fp = forward_ready(shadingMode - 1, shadows);
+            if (!fp) {
+                fp = &forward_program(shadingMode - 1, SHADOW_NONE);
+                shadows = SHADOW_NONE;
+                frame_pacer.request_redraw(); // look again next frame, also when idle
+            }
+        }
+        GLuint activeProg = fp ? fp->program : progGBuffer;
+        profiler.begin_stage(FrameProfiler::STAGE_UNIFORMS);
         glUseProgram(activeProg);
 
-        // set common uniforms depending on program
-        if (activeProg == progG) {
-            GLint loc_uModel = glGetUniformLocation(progG, "uModel");
-            GLint loc_uView = glGetUniformLocation(progG, "uView");
-            GLint loc_uProj = glGetUniformLocation(progG, "uProj");
-            glUniformMatrix4fv(loc_uModel, 1, GL_FALSE, glm::value_ptr(model));
-            glUniformMatrix4fv(loc_uView, 1, GL_FALSE, glm::value_ptr(view));
-            glUniformMatrix4fv(loc_uProj, 1, GL_FALSE, glm::value_ptr(proj));
-            // material uniform
-            Material& mat = materials[currentMaterial];
-            GLint m_amb = glGetUniformLocation(progG, "material.ambient");
-            GLint m_dif = glGetUniformLocation(progG, "material.diffuse");
-            GLint m_spec = glGetUniformLocation(progG, "material.specular");
-            GLint m_shi = glGetUniformLocation(progG, "material.shininess");
-            glUniform4fv(m_amb, 1, glm::value_ptr(mat.ambient));
-            glUniform4fv(m_dif, 1, glm::value_ptr(mat.diffuse));
-            glUniform4fv(m_spec, 1, glm::value_ptr(mat.specular));
-            glUniform1f(m_shi, mat.shininess);
-
-            // light0
-            GLint l0a = glGetUniformLocation(progG, "light0.ambient");
-            GLint l0d = glGetUniformLocation(progG, "light0.diffuse");
-            GLint l0s = glGetUniformLocation(progG, "light0.specular");
-            GLint l0p = glGetUniformLocation(progG, "light0.position");
-            GLint l0ic = glGetUniformLocation(progG, "light0.inCameraSpace");
-            glUniform4fv(l0a, 1, glm::value_ptr(light0.ambient));
-            glUniform4fv(l0d, 1, glm::value_ptr(light0.diffuse));
-            glUniform4fv(l0s, 1, glm::value_ptr(light0.specular));
-            glUniform3fv(l0p, 1, glm::value_ptr(light0.position));
-            glUniform1i(l0ic, 0);
-
-            // light1
-            GLint l1a = glGetUniformLocation(progG, "light1.ambient");
-            GLint l1d = glGetUniformLocation(progG, "light1.diffuse");
-            GLint l1s = glGetUniformLocation(progG, "light1.specular");
-            GLint l1p = glGetUniformLocation(progG, "light1.position");
-            GLint l1ic = glGetUniformLocation(progG, "light1.inCameraSpace");
-            glUniform4fv(l1a, 1, glm::value_ptr(light1.ambient));
-            glUniform4fv(l1d, 1, glm::value_ptr(light1.diffuse));
-            glUniform4fv(l1s, 1, glm::value_ptr(light1.specular));
-            glUniform3fv(l1p, 1, glm::value_ptr(light1.position));
-            glUniform1i(l1ic, 0); // we pass position in world coords here for simplicity
-
-            GLint eyeLoc = glGetUniformLocation(progG, "eyePos");
-            glUniform3fv(eyeLoc, 1, glm::value_ptr(camPos));
+        // material / light blocks: only re-uploaded when their contents change
+        if (currentMaterial != uploadedMaterial) {
+            MaterialStd140 block = to_std140(materials[currentMaterial]);
+            glBindBuffer(GL_UNIFORM_BUFFER, materialUbo);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+            uploadedMaterial = currentMaterial;
         }
-        else {
-            // Phong program
-            GLint loc_uModel = glGetUniformLocation(progP, "uModel");
-            GLint loc_uView = glGetUniformLocation(progP, "uView");
-            GLint loc_uProj = glGetUniformLocation(progP, "uProj");
-            glUniformMatrix4fv(loc_uModel, 1, GL_FALSE, glm::value_ptr(model));
-            glUniformMatrix4fv(loc_uView, 1, GL_FALSE, glm::value_ptr(view));
-            glUniformMatrix4fv(loc_uProj, 1, GL_FALSE, glm::value_ptr(proj));
-
-            Material& mat = materials[currentMaterial];
-            GLint m_amb = glGetUniformLocation(progP, "material.ambient");
-            GLint m_dif = glGetUniformLocation(progP, "material.diffuse");
-            GLint m_spec = glGetUniformLocation(progP, "material.specular");
-            GLint m_shi = glGetUniformLocation(progP, "material.shininess");
-            glUniform4fv(m_amb, 1, glm::value_ptr(mat.ambient));
-            glUniform4fv(m_dif, 1, glm::value_ptr(mat.diffuse));
-            glUniform4fv(m_spec, 1, glm::value_ptr(mat.specular));
-            glUniform1f(m_shi, mat.shininess);
-
-            GLint l0a = glGetUniformLocation(progP, "light0.ambient");
-            GLint l0d = glGetUniformLocation(progP, "light0.diffuse");
-            GLint l0s = glGetUniformLocation(progP, "light0.specular");
-            GLint l0p = glGetUniformLocation(progP, "light0.position");
-            GLint l0ic = glGetUniformLocation(progP, "light0.inCameraSpace");
-            glUniform4fv(l0a, 1, glm::value_ptr(light0.ambient));
-            glUniform4fv(l0d, 1, glm::value_ptr(light0.diffuse));
-            glUniform4fv(l0s, 1, glm::value_ptr(light0.specular));
-            glUniform3fv(l0p, 1, glm::value_ptr(light0.position));
-            glUniform1i(l0ic, 0);
-
-            GLint l1a = glGetUniformLocation(progP, "light1.ambient");
-            GLint l1d = glGetUniformLocation(progP, "light1.diffuse");
-            GLint l1s = glGetUniformLocation(progP, "light1.specular");
-            GLint l1p = glGetUniformLocation(progP, "light1.position");
-            GLint l1ic = glGetUniformLocation(progP, "light1.inCameraSpace");
-            glUniform4fv(l1a, 1, glm::value_ptr(light1.ambient));
-            glUniform4fv(l1d, 1, glm::value_ptr(light1.diffuse));
-            glUniform4fv(l1s, 1, glm::value_ptr(light1.specular));
-            glUniform3fv(l1p, 1, glm::value_ptr(light1.position));
-            glUniform1i(l1ic, 0);
-
-            GLint eyeLoc = glGetUniformLocation(progP, "eyePos");
-            glUniform3fv(eyeLoc, 1, glm::value_ptr(camPos));
+        LightBlockStd140 lightBlock = { { to_std140(light0), to_std140(light1) }, camPos, 0.0f };
+        if (!lightsUploaded || memcmp(&lightBlock, &uploadedLights, sizeof(lightBlock)) != 0) {
+            glBindBuffer(GL_UNIFORM_BUFFER, lightUbo);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(lightBlock), &lightBlock);
+            uploadedLights = lightBlock;
+            lightsUploaded = true;
         }
 
-        glBindVertexArray(vao);
-        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
-        glBindVertexArray(0);
+        const ProgramUniforms& u = fp ? fp->u : uniGBuffer;
+        glUniformMatrix4fv(u.uViewProj, 1, GL_FALSE, glm::value_ptr(viewProj));
+        if (u.uMaterialId >= 0) glUniform1f(u.uMaterialId, (float)currentMaterial);
+        if (shadows != SHADOW_NONE) {
+            shadow_map.bind(SHADOW_TEXTURE_UNIT);
+            glUniformMatrix4fv(u.uShadowMatrix, 1, GL_FALSE, glm::value_ptr(shadow_map.matrix()));
+            glUniform3fv(u.uShadowLightPos, 1, glm::value_ptr(shadow_map.light_position()));
+            glUniform2fv(u.uShadowNearFar, 1, glm::value_ptr(shadow_map.near_far()));
+            glUniform1f(u.uShadowNormalOffset, shadow_map.normal_offset());
+        }
+        if (shadingMode == 4 && maxrad != pointLightsRadius) {
+            lightVolumes.upload(make_point_lights(pointLightCount, maxrad));
+            pointLightsRadius = maxrad;
+        }
+        profiler.end_stage(FrameProfiler::STAGE_UNIFORMS);
+
+        bool prepass = depthPrepass && (shadingMode == 2 || shadingMode == 3);
+        if (prepass) {
+            // lay down the final depth cheaply; the shading pass below then
+            // only runs for the visible fragment of each pixel
+            profiler.begin_gpu_prepass();
+            glUseProgram(progDepth);
+            glUniformMatrix4fv(uniDepth.uViewProj, 1, GL_FALSE, glm::value_ptr(viewProj));
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            draw_all();
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            profiler.end_gpu_prepass();
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+            glUseProgram(activeProg);
+        }
+        if (shadingMode == 4) {
+            // geometry pass: the clear colour is irrelevant, background pixels keep depth 1
+            gbuffer.resize(rw, rh);
+            gbuffer.bind();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+        profiler.begin_triangles();
+        draw_all();
+        profiler.end_triangles();
+        if (prepass) {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+        if (shadingMode == 4) {
+            // lighting passes into the real target; each pixel is shaded once
+            // per light that reaches it, independent of the overdraw above
+            glBindFramebuffer(GL_FRAMEBUFFER, renderFbo);
+            glm::mat4 invViewProj = glm::inverse(viewProj);
+            gbuffer.bind_textures(0);
+            glDisable(GL_DEPTH_TEST);
+            glUseProgram(progDeferred);
+            glUniformMatrix4fv(uniDeferred.uInvViewProj, 1, GL_FALSE, glm::value_ptr(invViewProj));
+            glBindVertexArray(fullscreenVao);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+            glEnable(GL_DEPTH_TEST);
+            glUseProgram(progLights);
+            glUniformMatrix4fv(uniLights.uViewProj, 1, GL_FALSE, glm::value_ptr(viewProj));
+            glUniformMatrix4fv(uniLights.uInvViewProj, 1, GL_FALSE, glm::value_ptr(invViewProj));
+            lightVolumes.draw();
+        }
+        if (gpu_cull) {
+            gpu_culler.build_hiz(shadingMode == 4 ? gbuffer.depth : scene_target.depth, rw, rh);
+            if (shadingMode != 4) scene_target.blit_to(renderFbo);
+        }
+        if (scaled) scaled_target.present(outputFbo, w, h);
+        profiler.end_gpu();
+
+        if (thumbnails) thumbs.capture(target.fbo, w, h, thumbnail_path(thumbnailDir, scene.meshes[0]->path, thumbNames));
+        else if (!bench.enabled) glfwSwapBuffers(window);
+        ++frame;
 
-        glfwSwapBuffers(window);
+        profiler.end_frame();
+        if (!offscreen) frame_pacer.wait(deform, [&] { return mesh_loader.has_results() || paged.has_arrivals(); }); // deformation animates
     }
 
-    glDeleteProgram(progG); glDeleteProgram(progP);
-    glDeleteBuffers(1, &vbo); glDeleteVertexArrays(1, &vao);
+    if (bench.enabled) {
+        profiler.flush();
+        print_bench_json(std::cout, "part2", scene_name(scene), bench, scene_vertex_count(scene), scene_triangle_count(scene),
+            glfwGetTime() - benchStart, profiler,
+            "\"shading\": " + std::to_string(shadingMode) + ", \"depth_prepass\": " + (depthPrepass ? "true" : "false")
+            + ", \"gpu_cull\": " + (gpu_cull ? "true" : "false") + ", \"shadows\": \"" + SHADOW_NAMES[shadowKind]
+            + "\", \"shadow_updates\": " + std::to_string(shadow_map.updates())
+            + ", \"page_uploads\": " + std::to_string(paged.uploads())
+            + ", \"msaa\": " + std::to_string(renderedSamples) + ", \"msaa_requested\": " + std::to_string(msaaSamples)
+            + ", \"render_scale\": " + std::to_string(dynamic_res.enabled() ? dynamic_res.scale() : renderScale)
+            + ", \"scale_changes\": " + std::to_string(dynamic_res.changes()));
+        target.destroy();
+    }
+
+    if (thumbnails) {
+        thumbs.finish();
+        std::cout << "Thumbnails: " << thumbs.written() << " written to " << thumbnailDir;
+        if (thumbs.failed()) std::cout << ", " << thumbs.failed() << " failed";
+        std::cout << "\n";
+    }
+    mesh_loader.stop();
+    profiler.shutdown();
+    if (profile) info << "Shadow map passes: " << shadow_map.updates() << " over " << frame << " frames\n";
+    if (profile && dynamic_res.enabled())
+        info << "Dynamic resolution: scale " << dynamic_res.scale() << " after " << dynamic_res.changes() << " changes\n";
+    if (profile && paged.is_open())
+        info << "Paged mesh: " << paged.resident_count() << "/" << paged.slot_count() << " slots resident, "
+            << paged.uploads() << " page uploads, " << paged.evictions() << " evictions\n";
+    for (auto& modes : forward)
+        for (auto& f : modes) glDeleteProgram(f.program);
+    glDeleteProgram(progDepth);
+    glDeleteProgram(progGBuffer); glDeleteProgram(progDeferred); glDeleteProgram(progLights);
+    glDeleteBuffers(1, &materialUbo); glDeleteBuffers(1, &lightUbo); glDeleteBuffers(1, &materialTableUbo);
+    gbuffer.destroy();
+    shadow_map.destroy();
+    gpu_culler.destroy();
+    scene_target.destroy();
+    scaled_target.destroy();
+    lightVolumes.destroy();
+    glDeleteVertexArrays(1, &fullscreenVao);
+    destroy_scene(scene);
+    paged.destroy();
     glfwDestroyWindow(window);
     glfwTerminate();
     return 0;
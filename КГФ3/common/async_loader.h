@@ -0,0 +1,192 @@
+// async_loader.h
+// Loads meshes on a background thread while the viewer keeps rendering.
+//
+// The GL thread queues file names; one worker thread takes them in order,
+// probes the .smfb cache and, on a miss, parses the SMF and preprocesses it
+// (normals, optimization, LODs, all on the shared thread pool). Results come
+// back through a lock-free SPSC queue that the GL thread drains once per
+// frame: on a cache miss first the bounds (shown as a box placeholder), then
+// the finished mesh, which replaces the box. Cache hits skip the box.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mesh_cache.h"
+#include "scene.h"
+#include "smf_loader.h"
+#include "spsc_queue.h"
+
+struct LoadResult {
+    enum Kind { LOAD_BOUNDS, LOAD_MESH, LOAD_FAILED };
+    Kind kind = LOAD_FAILED;
+    std::string path;
+    MeshBounds bounds;                // LOAD_BOUNDS
+    std::unique_ptr<SceneMesh> mesh;  // LOAD_MESH: CPU side only, not uploaded yet
+};
+
+class AsyncMeshLoader {
+public:
+    ~AsyncMeshLoader() { stop(); }
+
+    // notify: called on the worker thread after each posted result, e.g. to
+    // wake a loop sleeping in glfwWaitEvents
+    void start(const MeshLoadOptions& options, std::function<void()> notify = nullptr) {
+        options_ = options;
+        notify_ = notify;
+        stop_ = false;
+        worker_ = std::thread([this] { run(); });
+    }
+
+    // GL thread: queues a file; results arrive through poll().
+    void request(const std::string& path) {
+        ++outstanding_; // before the worker can see it, so idle() never flickers
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            requests_.push_back(path);
+        }
+        cv_.notify_one();
+    }
+
+    // GL thread: next result, if any; never blocks.
+    bool poll(std::unique_ptr<LoadResult>& out) {
+        if (!results_.pop(out)) return false;
+        if (out->kind != LoadResult::LOAD_BOUNDS) --outstanding_;
+        return true;
+    }
+
+    // GL thread: poll() has something
+    bool has_results() const { return !results_.empty(); }
+
+    // every requested file has come back (loaded or failed)
+    bool idle() const { return outstanding_.load() == 0; }
+
+    // Joins the worker once it is done with the file it is working on.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) worker_.join();
+    }
+
+private:
+    void run() {
+        for (;;) {
+            std::string path;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+                if (stop_) return;
+                path = requests_.front();
+                requests_.pop_front();
+            }
+            load(path);
+        }
+    }
+
+    void load(const std::string& path) {
+        std::unique_ptr<SceneMesh> m(new SceneMesh());
+        m->path = path;
+        bool ok = load_mesh_cache(path, m->mesh, options_);
+        if (!ok) {
+            Mesh source;
+            ok = load_smf(path, source);
+            if (ok) {
+                std::unique_ptr<LoadResult> bounds(new LoadResult());
+                bounds->kind = LoadResult::LOAD_BOUNDS;
+                bounds->path = path;
+                bounds->bounds = compute_mesh_bounds(source);
+                post(std::move(bounds));
+                ok = build_mesh_cache(path, source, m->mesh, options_);
+            }
+        }
+        std::unique_ptr<LoadResult> result(new LoadResult());
+        result->kind = ok ? LoadResult::LOAD_MESH : LoadResult::LOAD_FAILED;
+        result->path = path;
+        if (ok) result->mesh = std::move(m);
+        post(std::move(result));
+    }
+
+    // The queue only fills up if the GL thread stops polling.
+    void post(std::unique_ptr<LoadResult> r) {
+        while (!results_.push(std::move(r))) {
+            if (stop_) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (notify_) notify_();
+    }
+
+    MeshLoadOptions options_;
+    std::function<void()> notify_;
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::string> requests_;
+    std::atomic<bool> stop_{ false };
+    std::atomic<int> outstanding_{ 0 };
+    SpscQueue<std::unique_ptr<LoadResult>, 64> results_;
+};
+
+// Applies one loader result to the scene (GL thread): adds a placeholder,
+// swaps the finished mesh in for it, or drops it on failure. Every mesh gets
+// `copies` instances and the grid is laid out again.
+inline void scene_apply_load(Scene& scene, LoadResult& r, int copies) {
+    size_t slot = scene.meshes.size();
+    for (size_t i = 0; i < scene.meshes.size(); ++i)
+        if (scene.meshes[i]->placeholder && scene.meshes[i]->path == r.path) slot = i;
+
+    std::unique_ptr<SceneMesh> incoming;
+    if (r.kind == LoadResult::LOAD_BOUNDS) {
+        incoming.reset(new SceneMesh());
+        incoming->path = r.path;
+        incoming->placeholder = true;
+        if (!make_bounds_mesh(r.bounds, incoming->mesh)) return;
+    }
+    else if (r.kind == LoadResult::LOAD_MESH) incoming = std::move(r.mesh);
+    else std::cerr << "Failed to load " << r.path << "\n";
+
+    if (slot < scene.meshes.size()) {
+        scene_destroy_mesh(*scene.meshes[slot]);
+        if (incoming) scene.meshes[slot] = std::move(incoming);
+        else scene.meshes.erase(scene.meshes.begin() + slot);
+    }
+    else if (incoming) {
+        slot = scene.meshes.size();
+        scene.meshes.push_back(std::move(incoming));
+    }
+    else return;
+
+    scene_layout_grid(scene, copies);
+    if (slot < scene.meshes.size() && !scene.meshes[slot]->gpu.vao) scene_upload_mesh(*scene.meshes[slot]);
+}
+
+// Drains the loader; true when the scene changed.
+inline bool scene_poll_loads(Scene& scene, AsyncMeshLoader& loader, int copies) {
+    bool changed = false;
+    std::unique_ptr<LoadResult> r;
+    while (loader.poll(r)) {
+        scene_apply_load(scene, *r, copies);
+        changed = true;
+    }
+    return changed;
+}
+
+// Blocks until every requested file has been applied (benchmarks).
+inline void scene_wait_loads(Scene& scene, AsyncMeshLoader& loader, int copies) {
+    while (!loader.idle()) {
+        if (!scene_poll_loads(scene, loader, copies))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
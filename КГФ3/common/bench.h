@@ -0,0 +1,129 @@
+// bench.h
+// Headless benchmark mode: render a fixed number of frames into an offscreen
+// framebuffer along a deterministic camera orbit, then print a JSON summary.
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "frame_profiler.h"
+
+struct BenchOptions {
+    bool enabled = false;
+    int frames = 1000;
+    int width = 1920, height = 1080;
+};
+
+// Consumes a bench option at argv[i] (and its value); false if not one.
+//   --bench  --bench-frames N  --bench-size WxH
+inline bool parse_bench_option(int argc, char** argv, int& i, BenchOptions& opt) {
+    std::string arg = argv[i];
+    if (arg == "--bench") { opt.enabled = true; return true; }
+    if (arg == "--bench-frames" && i + 1 < argc) {
+        opt.enabled = true;
+        opt.frames = std::max(1, atoi(argv[++i]));
+        return true;
+    }
+    if (arg == "--bench-size" && i + 1 < argc) {
+        opt.enabled = true;
+        int w = 0, h = 0;
+        if (sscanf(argv[++i], "%dx%d", &w, &h) == 2 && w > 0 && h > 0) { opt.width = w; opt.height = h; }
+        return true;
+    }
+    return false;
+}
+
+// Color + depth renderbuffers; stands in for the window's default framebuffer.
+struct OffscreenTarget {
+    GLuint fbo = 0, color = 0, depth = 0;
+    int width = 0, height = 0;
+
+    bool create(int w, int h) {
+        width = w; height = h;
+        glGenFramebuffers(1, &fbo);
+        glGenRenderbuffers(1, &color);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!ok) std::cerr << "Offscreen framebuffer incomplete\n";
+        return ok;
+    }
+
+    void bind() const { glBindFramebuffer(GL_FRAMEBUFFER, fbo); }
+
+    void destroy() {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+        fbo = color = depth = 0;
+    }
+};
+
+// Deterministic orbit: two full turns while the distance swings +-25%
+// around the framing radius, so near and far views are both covered.
+inline void bench_camera(int frame, int frames, float baseRadius, float& angle, float& radius) {
+    float t = (float)frame / (float)frames;
+    angle = t * 4.0f * 3.14159265f;
+    radius = baseRadius * (1.0f + 0.25f * std::sin(t * 2.0f * 3.14159265f));
+}
+
+inline void print_bench_stats(std::ostream& out, const char* name, const FrameProfiler& profiler, int field) {
+    out << "\"" << name << "\": {\"mean\": " << profiler.mean(field)
+        << ", \"p50\": " << profiler.percentile(0.50, field)
+        << ", \"p95\": " << profiler.percentile(0.95, field)
+        << ", \"p99\": " << profiler.percentile(0.99, field) << "}";
+}
+
+inline std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+// Prints the run summary as one JSON object; stats are -1 when unavailable.
+// vertices / triangles: the whole scene at full detail. Throughput uses the
+// triangles the frames actually submitted (profiler's begin_triangles()),
+// after culling and LOD. extraFields: more `"key": value` pairs describing
+// the configuration.
+inline void print_bench_json(std::ostream& out, const char* program, const std::string& mesh,
+    const BenchOptions& opt, size_t vertices, size_t triangles, double seconds,
+    const FrameProfiler& profiler, const std::string& extraFields = "")
+{
+    double fps = seconds > 0.0 ? opt.frames / seconds : 0.0;
+    double drawn = profiler.mean(FrameProfiler::FIELD_TRIANGLES);
+    out << "{\"program\": \"" << program << "\", \"mesh\": \"" << json_escape(mesh) << "\""
+        << ", \"frames\": " << opt.frames
+        << ", \"width\": " << opt.width << ", \"height\": " << opt.height
+        << ", \"vertices\": " << vertices << ", \"triangles\": " << triangles
+        << ", \"seconds\": " << seconds
+        << ", \"fps\": " << fps
+        << ", \"triangles_per_frame\": " << drawn
+        << ", \"triangles_per_second\": " << (drawn >= 0.0 ? fps * drawn : -1.0)
+        << ", ";
+    if (!extraFields.empty()) out << extraFields << ", ";
+    print_bench_stats(out, "cpu_ms", profiler, FrameProfiler::FIELD_CPU);
+    out << ", ";
+    print_bench_stats(out, "gpu_ms", profiler, FrameProfiler::FIELD_GPU);
+    out << ", ";
+    print_bench_stats(out, "gpu_prepass_ms", profiler, FrameProfiler::FIELD_GPU_PREPASS);
+    out << "}\n";
+}
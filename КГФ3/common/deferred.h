@@ -0,0 +1,235 @@
+// deferred.h
+// GPU side of the deferred shading path: the G-buffer and the point light
+// volumes.
+//
+// The geometry pass writes the surface normal and a material id per pixel
+// (RGBA16F) plus depth; positions are reconstructed from depth and the
+// inverse view-projection, which saves a full-precision target. Each point
+// light is then drawn as a sphere bounding its radius, all lights in one
+// instanced draw with additive blending; its fragments shade only the pixels
+// the volume covers, so lighting cost follows the lights that actually reach
+// a pixel instead of lights x fragments x overdraw. Volumes are drawn with
+// their back faces, which keeps working when the camera is inside one.
+
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+// One point light, laid out as its instance attributes.
+struct PointLight {
+    glm::vec4 positionRadius; // world position, radius of influence
+    glm::vec4 color;          // rgb intensity, w unused
+};
+
+static_assert(sizeof(PointLight) == 32, "light attributes assume tightly packed vec4s");
+
+// Light volume attributes: location 0 = unit sphere vertex, 1..2 = PointLight.
+const GLuint LIGHT_POSITION_LOCATION = 1;
+const GLuint LIGHT_COLOR_LOCATION = 2;
+
+// `count` lights scattered over a disc of `sceneRadius` around the origin
+// (the scene's XY plane, Z up), with radii that shrink as the count grows so
+// the coverage stays similar. Deterministic for a given seed.
+inline std::vector<PointLight> make_point_lights(int count, float sceneRadius, uint32_t seed = 1) {
+    std::vector<PointLight> lights;
+    uint32_t state = seed * 747796405u + 2891336453u;
+    auto next = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (float)(state >> 8) / 16777216.0f;
+    };
+    float radius = sceneRadius * std::max(0.25f, 1.5f / std::sqrt((float)std::max(1, count)));
+    for (int i = 0; i < count; ++i) {
+        float a = next() * 6.2831853f, d = std::sqrt(next()) * sceneRadius * 1.1f;
+        float z = (next() * 0.9f - 0.3f) * std::min(sceneRadius, radius * 2.0f);
+        // evenly spread hues, full saturation
+        float h = std::fmod(i * 0.618034f, 1.0f) * 6.0f;
+        glm::vec3 rgb(std::min(1.0f, std::max(0.0f, std::fabs(h - 3.0f) - 1.0f)),
+            std::min(1.0f, std::max(0.0f, 2.0f - std::fabs(h - 2.0f))),
+            std::min(1.0f, std::max(0.0f, 2.0f - std::fabs(h - 4.0f))));
+        PointLight l;
+        l.positionRadius = glm::vec4(d * std::cos(a), d * std::sin(a), z, radius * (0.75f + 0.5f * next()));
+        l.color = glm::vec4(rgb * 0.8f, 0.0f);
+        lights.push_back(l);
+    }
+    return lights;
+}
+
+// Normal + material id and depth, both sampled by the lighting passes.
+struct GBuffer {
+    GLuint fbo = 0, normalMaterial = 0, depth = 0;
+    int width = 0, height = 0;
+
+    // (Re)allocates for the given size; cheap when the size is unchanged.
+    bool resize(int w, int h) {
+        if (fbo && w == width && h == height) return true;
+        destroy();
+        width = w; height = h;
+
+        glGenTextures(1, &normalMaterial);
+        glBindTexture(GL_TEXTURE_2D, normalMaterial);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        set_nearest();
+        glGenTextures(1, &depth);
+        glBindTexture(GL_TEXTURE_2D, depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, w, h, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        set_nearest();
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, normalMaterial, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!ok) std::cerr << "G-buffer incomplete\n";
+        return ok;
+    }
+
+    void bind() const { glBindFramebuffer(GL_FRAMEBUFFER, fbo); }
+
+    // texture units read by the lighting shaders (gNormalMaterial, gDepth)
+    void bind_textures(GLuint unit0 = 0) const {
+        glActiveTexture(GL_TEXTURE0 + unit0);
+        glBindTexture(GL_TEXTURE_2D, normalMaterial);
+        glActiveTexture(GL_TEXTURE0 + unit0 + 1);
+        glBindTexture(GL_TEXTURE_2D, depth);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void destroy() {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &normalMaterial);
+        glDeleteTextures(1, &depth);
+        fbo = normalMaterial = depth = 0;
+    }
+
+private:
+    static void set_nearest() {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+};
+
+// Once-subdivided icosahedron (80 faces), pushed out so its faces, not just
+// its vertices, enclose the unit sphere: a volume never cuts off its light.
+inline void make_light_volume_mesh(std::vector<glm::vec3>& positions, std::vector<glm::uvec3>& faces) {
+    const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+    positions = {
+        { -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 }, { 0, -1, t }, { 0, 1, t },
+        { 0, -1, -t }, { 0, 1, -t }, { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 },
+    };
+    std::vector<glm::uvec3> ico = {
+        { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 }, { 1, 5, 9 }, { 5, 11, 4 },
+        { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 }, { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 },
+        { 3, 8, 9 }, { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 },
+    };
+    for (auto& p : positions) p = glm::normalize(p);
+
+    // split every edge once; shared edges share their midpoint
+    std::vector<std::pair<uint64_t, uint32_t>> midpoints;
+    auto midpoint = [&](uint32_t a, uint32_t b) {
+        uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+        for (auto& m : midpoints)
+            if (m.first == key) return m.second;
+        uint32_t index = (uint32_t)positions.size();
+        positions.push_back(glm::normalize(positions[a] + positions[b]));
+        midpoints.push_back(std::make_pair(key, index));
+        return index;
+    };
+    faces.clear();
+    for (auto& f : ico) {
+        uint32_t ab = midpoint(f.x, f.y), bc = midpoint(f.y, f.z), ca = midpoint(f.z, f.x);
+        faces.push_back(glm::uvec3(f.x, ab, ca));
+        faces.push_back(glm::uvec3(f.y, bc, ab));
+        faces.push_back(glm::uvec3(f.z, ca, bc));
+        faces.push_back(glm::uvec3(ab, bc, ca));
+    }
+
+    float inradius = 1.0f;
+    for (auto& f : faces) {
+        glm::vec3 n = glm::normalize(glm::cross(positions[f.y] - positions[f.x], positions[f.z] - positions[f.x]));
+        inradius = std::min(inradius, std::fabs(glm::dot(n, positions[f.x])));
+    }
+    for (auto& p : positions) p /= inradius;
+}
+
+// The light volume mesh plus the per-light instance buffer.
+struct LightVolumes {
+    GLuint vao = 0, vbo = 0, ebo = 0, instanceVbo = 0;
+    GLsizei indexCount = 0;
+    GLsizei lightCount = 0;
+
+    void create() {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::uvec3> faces;
+        make_light_volume_mesh(positions, faces);
+        indexCount = (GLsizei)(faces.size() * 3);
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        glGenBuffers(1, &instanceVbo);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * sizeof(glm::uvec3), faces.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        glEnableVertexAttribArray(LIGHT_POSITION_LOCATION);
+        glVertexAttribPointer(LIGHT_POSITION_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(PointLight),
+            (void*)offsetof(PointLight, positionRadius));
+        glVertexAttribDivisor(LIGHT_POSITION_LOCATION, 1);
+        glEnableVertexAttribArray(LIGHT_COLOR_LOCATION);
+        glVertexAttribPointer(LIGHT_COLOR_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(PointLight),
+            (void*)offsetof(PointLight, color));
+        glVertexAttribDivisor(LIGHT_COLOR_LOCATION, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void upload(const std::vector<PointLight>& lights) {
+        lightCount = (GLsizei)lights.size();
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        glBufferData(GL_ARRAY_BUFFER, lights.size() * sizeof(PointLight), lights.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Additive, back faces only, no depth test; restores the default state.
+    void draw() const {
+        if (lightCount == 0) return;
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(vao);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr, lightCount);
+        glBindVertexArray(0);
+        glCullFace(GL_BACK);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    void destroy() {
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+        glDeleteBuffers(1, &instanceVbo);
+        glDeleteVertexArrays(1, &vao);
+        vao = vbo = ebo = instanceVbo = 0;
+    }
+};
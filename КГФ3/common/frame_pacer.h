@@ -0,0 +1,76 @@
+// frame_pacer.h
+// Decides when the interactive viewers draw the next frame.
+//
+// By default they redraw continuously, as before. With --on-demand the loop
+// sleeps in glfwWaitEvents after presenting a frame until something asks for
+// a redraw (input that changes the view, a resize or expose, a finished
+// load); while something animates it keeps drawing. --fps-cap N bounds the
+// rate of continuous drawing in either mode.
+
+#pragma once
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+struct RedrawOptions {
+    bool onDemand = false;
+    double fpsCap = 0.0; // 0 = uncapped
+};
+
+// Consumes a redraw option at argv[i] (and its value); false if not one.
+//   --on-demand  --fps-cap N
+inline bool parse_redraw_option(int argc, char** argv, int& i, RedrawOptions& opt) {
+    std::string arg = argv[i];
+    if (arg == "--on-demand") { opt.onDemand = true; return true; }
+    if (arg == "--fps-cap" && i + 1 < argc) {
+        opt.fpsCap = std::max(0.0, atof(argv[++i]));
+        return true;
+    }
+    return false;
+}
+
+class FramePacer {
+public:
+    void init(GLFWwindow* window, const RedrawOptions& options) {
+        window_ = window;
+        options_ = options;
+        dirty_ = true;
+        nextFrame_ = glfwGetTime();
+    }
+
+    // From input / window callbacks, or from the frame itself: the next frame
+    // differs from the last one.
+    void request_redraw() { dirty_ = true; }
+
+    // Call once events are handled, before drawing: the frame about to be
+    // drawn covers every request so far. Requests made while it is drawn
+    // keep the next wait() from sleeping.
+    void begin_frame() { dirty_ = false; }
+
+    // Call after presenting a frame. `animating`: the next frame differs
+    // anyway. `pending()` is checked after every event, for work that wakes
+    // the loop with glfwPostEmptyEvent (e.g. loader results).
+    template <class Pending>
+    void wait(bool animating, Pending pending) {
+        if (options_.fpsCap > 0.0) {
+            double now = glfwGetTime();
+            nextFrame_ = std::max(now, nextFrame_ + 1.0 / options_.fpsCap);
+            if (nextFrame_ > now)
+                std::this_thread::sleep_for(std::chrono::duration<double>(nextFrame_ - now));
+        }
+        if (options_.onDemand && !animating)
+            while (!dirty_ && !pending() && !glfwWindowShouldClose(window_))
+                glfwWaitEvents();
+    }
+
+private:
+    GLFWwindow* window_ = nullptr;
+    RedrawOptions options_;
+    bool dirty_ = true;
+    double nextFrame_ = 0.0;
+};
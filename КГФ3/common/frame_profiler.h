@@ -0,0 +1,305 @@
+// frame_profiler.h
+// Per-frame CPU / GPU timing with rolling percentiles and optional CSV dump.
+//
+// CPU time is measured from begin_frame() to the next begin_frame() (or to
+// end_frame()), plus named stages inside the frame. GPU draw time comes from GL_TIME_ELAPSED queries
+// kept in a small ring: a frame's result is read back frames later, only
+// once GL reports it available. The profiler only waits when the CPU gets a
+// whole ring ahead, which a loop that never swaps (--bench) otherwise would;
+// so every frame gets its GPU time and that loop stays close to the GPU.
+// The depth pre-pass is timed inside that bracket with a pair of
+// GL_TIMESTAMP queries per ring slot (elapsed queries cannot nest), and a
+// GL_PRIMITIVES_GENERATED query per slot counts the triangles the shading
+// pass submits, whichever path (CPU or GPU culling) chose them.
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class FrameProfiler {
+public:
+    enum Stage { STAGE_EVENTS, STAGE_CULL, STAGE_GEOMETRY, STAGE_UNIFORMS, STAGE_SHADOWS, STAGE_COUNT };
+
+    struct Sample {
+        uint64_t frame = 0;
+        double cpuMs = 0.0;
+        double stageMs[STAGE_COUNT] = {};
+        double gpuMs = -1.0; // < 0 while unknown (or dropped)
+        double gpuPrepassMs = -1.0; // < 0 also when the frame had no pre-pass
+        double triangles = -1.0;    // submitted by the counted pass; < 0 while unknown
+        int querySlot = -1;
+        bool prepassTimed = false;
+        bool trianglesCounted = false;
+    };
+
+    // report: print percentiles every second; csvPath: per-frame rows ("" = off);
+    // window: frames kept for the rolling statistics
+    void init(bool report, const std::string& csvPath, size_t window = 300) {
+        report_ = report;
+        windowSize_ = std::max<size_t>(1, window);
+        if (!csvPath.empty()) {
+            csv_ = fopen(csvPath.c_str(), "w");
+            if (csv_) fprintf(csv_, "frame,cpu_ms,events_ms,cull_ms,geometry_ms,uniforms_ms,shadows_ms,gpu_ms,gpu_prepass_ms,triangles\n");
+            else std::cerr << "Cannot open profile CSV " << csvPath << "\n";
+        }
+        if (enabled()) {
+            glGenQueries(QUERY_RING, queries_);
+            glGenQueries(QUERY_RING * 2, &stamps_[0][0]);
+            glGenQueries(QUERY_RING, primitives_);
+        }
+        lastReport_ = Clock::now();
+    }
+
+    bool enabled() const { return report_ || csv_ || collect_; }
+
+    // Where the periodic report goes; benchmarks keep stdout for their JSON.
+    void set_report_stream(std::ostream& out) { reportOut_ = &out; }
+
+    // Keeps timing even without report / CSV output, e.g. for benchmarks.
+    void set_collect(bool collect) { collect_ = collect; }
+
+    void begin_frame() {
+        if (!enabled()) return;
+        Clock::time_point now = Clock::now();
+        close_frame(now);
+        frameOpen_ = true;
+        frameStart_ = now;
+        current_ = Sample();
+        current_.frame = frame_++;
+        collect();
+        maybe_report(now);
+    }
+
+    void begin_stage(Stage s) { if (enabled()) stageStart_[s] = Clock::now(); }
+    void end_stage(Stage s) { if (enabled()) current_.stageMs[s] += ms(stageStart_[s], Clock::now()); }
+
+    // Brackets the GPU work of the frame; at most one pair per frame.
+    void begin_gpu() {
+        if (!enabled()) return;
+        int slot = (int)(current_.frame % QUERY_RING);
+        // the slot's previous frame is still outstanding: wait for it rather
+        // than drop its time (blocks on the query, then reads the ring)
+        if (slot_pending(slot)) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries_[slot], GL_QUERY_RESULT, &ns);
+            collect();
+        }
+        for (auto& p : pending_)
+            if (p.querySlot == slot) p.querySlot = -1; // an older one is still not in: give up on it
+        current_.querySlot = slot;
+        glBeginQuery(GL_TIME_ELAPSED, queries_[slot]);
+    }
+
+    void end_gpu() { if (enabled() && current_.querySlot >= 0) glEndQuery(GL_TIME_ELAPSED); }
+
+    // Brackets the depth pre-pass, inside begin_gpu() / end_gpu().
+    void begin_gpu_prepass() {
+        if (!enabled() || current_.querySlot < 0) return;
+        glQueryCounter(stamps_[current_.querySlot][0], GL_TIMESTAMP);
+        current_.prepassTimed = true;
+    }
+
+    void end_gpu_prepass() {
+        if (enabled() && current_.prepassTimed) glQueryCounter(stamps_[current_.querySlot][1], GL_TIMESTAMP);
+    }
+
+    // Brackets the pass whose triangles count as drawn (the shading pass,
+    // not the pre-pass or shadows), inside begin_gpu() / end_gpu().
+    void begin_triangles() {
+        if (!enabled() || current_.querySlot < 0) return;
+        glBeginQuery(GL_PRIMITIVES_GENERATED, primitives_[current_.querySlot]);
+        current_.trianglesCounted = true;
+    }
+
+    void end_triangles() { if (enabled() && current_.trianglesCounted) glEndQuery(GL_PRIMITIVES_GENERATED); }
+
+    // Closes the frame still open, keeps what the GPU finished and prints
+    // the last report.
+    void shutdown() {
+        if (!enabled()) return;
+        close_frame(Clock::now());
+        glFinish();
+        collect();
+        for (auto& p : pending_) finish(p);
+        pending_.clear();
+        if (report_ && !window_.empty()) print_report();
+        glDeleteQueries(QUERY_RING, queries_);
+        glDeleteQueries(QUERY_RING * 2, &stamps_[0][0]);
+        glDeleteQueries(QUERY_RING, primitives_);
+        if (csv_) fclose(csv_);
+        csv_ = nullptr;
+        report_ = collect_ = false;
+    }
+
+    // Ends the current frame early, so time spent waiting for the next one
+    // (frame pacing) is not counted as frame time.
+    void end_frame() { if (enabled()) close_frame(Clock::now()); }
+
+    // Ends the current frame and waits for every outstanding GPU timing.
+    void flush() {
+        if (!enabled()) return;
+        close_frame(Clock::now());
+        glFinish();
+        collect();
+    }
+
+    size_t sample_count() const { return window_.size(); }
+
+    double mean(int field) const {
+        double sum = 0.0;
+        size_t n = 0;
+        for (auto& s : window_) {
+            double x = field_value(s, field);
+            if (x >= 0.0) { sum += x; ++n; }
+        }
+        return n ? sum / (double)n : -1.0;
+    }
+
+    // p in [0, 1] over the rolling window; field selects cpu / stage / gpu
+    double percentile(double p, int field) const {
+        std::vector<double> v;
+        v.reserve(window_.size());
+        for (auto& s : window_) {
+            double x = field_value(s, field);
+            if (x >= 0.0) v.push_back(x);
+        }
+        if (v.empty()) return -1.0;
+        size_t k = std::min(v.size() - 1, (size_t)(p * (double)(v.size() - 1) + 0.5));
+        std::nth_element(v.begin(), v.begin() + k, v.end());
+        return v[k];
+    }
+
+    // fields for percentile()
+    enum { FIELD_CPU = -1, FIELD_GPU = -2, FIELD_GPU_PREPASS = -3, FIELD_TRIANGLES = -4 };
+
+    // index of the frame begun last
+    uint64_t frame_index() const { return current_.frame; }
+
+    // Newest frame with a GPU time read back (a few frames behind
+    // frame_index()); false before the first one.
+    bool latest_gpu(uint64_t& frame, double& gpuMs) const {
+        for (auto s = window_.rbegin(); s != window_.rend(); ++s)
+            if (s->gpuMs >= 0.0) {
+                frame = s->frame;
+                gpuMs = s->gpuMs;
+                return true;
+            }
+        return false;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    static const int QUERY_RING = 4;  // the GPU may run up to 3 frames behind
+
+    static double ms(Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    }
+
+    bool slot_pending(int slot) const {
+        for (auto& p : pending_)
+            if (p.querySlot == slot) return true;
+        return false;
+    }
+
+    static double field_value(const Sample& s, int field) {
+        if (field == FIELD_CPU) return s.cpuMs;
+        if (field == FIELD_GPU) return s.gpuMs;
+        if (field == FIELD_GPU_PREPASS) return s.gpuPrepassMs;
+        if (field == FIELD_TRIANGLES) return s.triangles;
+        return s.stageMs[field];
+    }
+
+    void close_frame(Clock::time_point now) {
+        if (!frameOpen_) return;
+        current_.cpuMs = ms(frameStart_, now);
+        pending_.push_back(current_);
+        frameOpen_ = false;
+    }
+
+    // Moves finished frames (GPU result read or abandoned) out of pending_.
+    void collect() {
+        while (!pending_.empty()) {
+            Sample& s = pending_.front();
+            if (s.querySlot >= 0) {
+                GLint available = 0;
+                glGetQueryObjectiv(queries_[s.querySlot], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available && s.prepassTimed)
+                    glGetQueryObjectiv(stamps_[s.querySlot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available && s.trianglesCounted)
+                    glGetQueryObjectiv(primitives_[s.querySlot], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available) break; // later frames cannot be ready either
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(queries_[s.querySlot], GL_QUERY_RESULT, &ns);
+                s.gpuMs = (double)ns * 1e-6;
+                if (s.prepassTimed) {
+                    GLuint64 begin = 0, end = 0;
+                    glGetQueryObjectui64v(stamps_[s.querySlot][0], GL_QUERY_RESULT, &begin);
+                    glGetQueryObjectui64v(stamps_[s.querySlot][1], GL_QUERY_RESULT, &end);
+                    s.gpuPrepassMs = (double)(end - begin) * 1e-6;
+                }
+                if (s.trianglesCounted) {
+                    GLuint64 n = 0;
+                    glGetQueryObjectui64v(primitives_[s.querySlot], GL_QUERY_RESULT, &n);
+                    s.triangles = (double)n;
+                }
+            }
+            finish(s);
+            pending_.pop_front();
+        }
+    }
+
+    void finish(const Sample& s) {
+        window_.push_back(s);
+        if (window_.size() > windowSize_) window_.pop_front();
+        if (csv_)
+            fprintf(csv_, "%llu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.0f\n", (unsigned long long)s.frame, s.cpuMs,
+                s.stageMs[STAGE_EVENTS], s.stageMs[STAGE_CULL], s.stageMs[STAGE_GEOMETRY], s.stageMs[STAGE_UNIFORMS],
+                s.stageMs[STAGE_SHADOWS], s.gpuMs, s.gpuPrepassMs, s.triangles);
+    }
+
+    void maybe_report(Clock::time_point now) {
+        if (!report_ || ms(lastReport_, now) < 1000.0 || window_.empty()) return;
+        lastReport_ = now;
+        print_report();
+    }
+
+    void print_report() const {
+        static const char* names[] = { "frame", "events", "cull", "geometry", "uniforms", "shadows", "gpu", "gpu-prepass" };
+        static const int fields[] = { FIELD_CPU, STAGE_EVENTS, STAGE_CULL, STAGE_GEOMETRY, STAGE_UNIFORMS, STAGE_SHADOWS,
+            FIELD_GPU, FIELD_GPU_PREPASS };
+        char line[512];
+        int n = snprintf(line, sizeof(line), "[profile] p50/p95/p99 ms over %zu frames:", window_.size());
+        for (int i = 0; i < 8 && n < (int)sizeof(line); ++i) {
+            double p50 = percentile(0.50, fields[i]);
+            if (p50 < 0.0) continue;
+            n += snprintf(line + n, sizeof(line) - n, "  %s %.3f/%.3f/%.3f", names[i],
+                p50, percentile(0.95, fields[i]), percentile(0.99, fields[i]));
+        }
+        *reportOut_ << line << "\n";
+    }
+
+    bool report_ = false;
+    bool collect_ = false;
+    bool frameOpen_ = false;
+    size_t windowSize_ = 300;
+    FILE* csv_ = nullptr;
+    std::ostream* reportOut_ = &std::cout;
+    GLuint queries_[QUERY_RING] = {};
+    GLuint stamps_[QUERY_RING][2] = {}; // pre-pass begin / end
+    GLuint primitives_[QUERY_RING] = {};
+    uint64_t frame_ = 0;
+    Clock::time_point frameStart_, lastReport_;
+    Clock::time_point stageStart_[STAGE_COUNT];
+    Sample current_;
+    std::deque<Sample> pending_;
+    std::deque<Sample> window_;
+};
@@ -0,0 +1,192 @@
+// frustum_cull.h
+// View-frustum culling of bounding spheres through a small BVH.
+//
+// The frustum planes are extracted from the view-projection matrix. Nodes
+// hold an AABB around their spheres; a node entirely outside a plane is
+// skipped, a node entirely inside all planes is accepted without further
+// tests, and leaves test their (up to four) spheres against all six planes
+// at once with SSE.
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULL_SSE 1
+#include <xmmintrin.h>
+#endif
+
+struct BoundingSphere {
+    glm::vec3 center;
+    float radius;
+};
+
+// Planes as (n, d) with dot(n, p) + d >= 0 inside; n is unit length.
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Gribb / Hartmann extraction; works for both perspective and ortho.
+inline Frustum frustum_from_matrix(const glm::mat4& m) {
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; ++i) row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    Frustum f;
+    for (int i = 0; i < 3; ++i) {
+        f.planes[i * 2 + 0] = row[3] + row[i];
+        f.planes[i * 2 + 1] = row[3] - row[i];
+    }
+    for (auto& p : f.planes) {
+        float len = glm::length(glm::vec3(p));
+        if (len > 0.0f) p = p * (1.0f / len);
+    }
+    return f;
+}
+
+// Up to four spheres in SoA form; unused lanes have radius -1 and never pass.
+struct SpherePacket {
+    float x[4], y[4], z[4], r[4];
+};
+
+// Bitmask of the packet's spheres that intersect the frustum.
+inline unsigned frustum_test_packet(const Frustum& f, const SpherePacket& s) {
+#ifdef FRUSTUM_CULL_SSE
+    __m128 x = _mm_loadu_ps(s.x), y = _mm_loadu_ps(s.y), z = _mm_loadu_ps(s.z);
+    __m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(s.r));
+    __m128 inside = _mm_cmpge_ps(_mm_loadu_ps(s.r), _mm_setzero_ps());
+    for (const auto& p : f.planes) {
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p.x)), _mm_mul_ps(y, _mm_set1_ps(p.y))),
+            _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+    }
+    return (unsigned)_mm_movemask_ps(inside);
+#else
+    unsigned mask = 0;
+    for (int k = 0; k < 4; ++k) {
+        bool in = s.r[k] >= 0.0f;
+        for (const auto& p : f.planes)
+            in = in && p.x * s.x[k] + p.y * s.y[k] + p.z * s.z[k] + p.w >= -s.r[k];
+        if (in) mask |= 1u << k;
+    }
+    return mask;
+#endif
+}
+
+// Bounding-sphere BVH over items 0..n-1 (built once, culled every frame).
+class CullBvh {
+public:
+    void build(const std::vector<BoundingSphere>& spheres) {
+        nodes_.clear();
+        packets_.clear();
+        order_.resize(spheres.size());
+        for (uint32_t i = 0; i < (uint32_t)spheres.size(); ++i) order_[i] = i;
+        if (spheres.empty()) return;
+        nodes_.push_back(Node());
+        build_node(spheres, 0, 0, (uint32_t)spheres.size());
+    }
+
+    // Appends the ids of every item whose sphere touches the frustum. Ids
+    // come out in build order, so equal sets give equal lists.
+    void cull(const Frustum& f, std::vector<uint32_t>& visible) const {
+        if (nodes_.empty()) return;
+        uint32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& n = nodes_[stack[--top]];
+            int side = classify(f, n);
+            if (side < 0) continue;
+            if (side > 0) {
+                visible.insert(visible.end(), order_.begin() + n.first, order_.begin() + n.first + n.count);
+                continue;
+            }
+            if (n.leaf) {
+                unsigned mask = frustum_test_packet(f, packets_[n.child]);
+                for (uint32_t k = 0; k < n.count; ++k)
+                    if (mask & (1u << k)) visible.push_back(order_[n.first + k]);
+                continue;
+            }
+            // left child on top, so ids always come out in order_ order
+            stack[top++] = n.child + 1;
+            stack[top++] = n.child;
+        }
+    }
+
+    size_t size() const { return order_.size(); }
+
+private:
+    static const uint32_t LEAF_SIZE = 4;
+
+    struct Node {
+        glm::vec3 bmin, bmax;
+        uint32_t first = 0, count = 0; // range in order_
+        uint32_t child = 0;            // first child (the second follows), or packet
+        bool leaf = false;
+    };
+
+    // -1 outside, 0 intersecting, +1 fully inside
+    static int classify(const Frustum& f, const Node& n) {
+        int result = 1;
+        for (const auto& p : f.planes) {
+            glm::vec3 pos(p.x >= 0.0f ? n.bmax.x : n.bmin.x, p.y >= 0.0f ? n.bmax.y : n.bmin.y,
+                p.z >= 0.0f ? n.bmax.z : n.bmin.z);
+            glm::vec3 neg(p.x >= 0.0f ? n.bmin.x : n.bmax.x, p.y >= 0.0f ? n.bmin.y : n.bmax.y,
+                p.z >= 0.0f ? n.bmin.z : n.bmax.z);
+            if (glm::dot(glm::vec3(p), pos) + p.w < 0.0f) return -1;
+            if (glm::dot(glm::vec3(p), neg) + p.w < 0.0f) result = 0;
+        }
+        return result;
+    }
+
+    // Median split on the longest axis of the sphere centers. Depth stays
+    // around log2(n / LEAF_SIZE), far below the traversal stack size.
+    void build_node(const std::vector<BoundingSphere>& spheres, uint32_t index, uint32_t first, uint32_t count) {
+        glm::vec3 bmin(1e30f), bmax(-1e30f), cmin(1e30f), cmax(-1e30f);
+        for (uint32_t i = first; i < first + count; ++i) {
+            const BoundingSphere& s = spheres[order_[i]];
+            bmin = glm::min(bmin, s.center - glm::vec3(s.radius));
+            bmax = glm::max(bmax, s.center + glm::vec3(s.radius));
+            cmin = glm::min(cmin, s.center);
+            cmax = glm::max(cmax, s.center);
+        }
+        nodes_[index].bmin = bmin;
+        nodes_[index].bmax = bmax;
+        nodes_[index].first = first;
+        nodes_[index].count = count;
+
+        if (count <= LEAF_SIZE) {
+            SpherePacket p;
+            for (uint32_t k = 0; k < 4; ++k) {
+                bool used = k < count;
+                const BoundingSphere& s = spheres[order_[first + (used ? k : 0)]];
+                p.x[k] = s.center.x; p.y[k] = s.center.y; p.z[k] = s.center.z;
+                p.r[k] = used ? s.radius : -1.0f;
+            }
+            nodes_[index].leaf = true;
+            nodes_[index].child = (uint32_t)packets_.size();
+            packets_.push_back(p);
+            return;
+        }
+
+        glm::vec3 extent = cmax - cmin;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+        uint32_t half = count / 2;
+        std::nth_element(order_.begin() + first, order_.begin() + first + half, order_.begin() + first + count,
+            [&](uint32_t a, uint32_t b) { return spheres[a].center[axis] < spheres[b].center[axis]; });
+
+        uint32_t child = (uint32_t)nodes_.size();
+        nodes_[index].child = child;
+        nodes_.push_back(Node());
+        nodes_.push_back(Node());
+        build_node(spheres, child, first, half);
+        build_node(spheres, child + 1, first + half, count - half);
+    }
+
+    std::vector<Node> nodes_;
+    std::vector<SpherePacket> packets_;
+    std::vector<uint32_t> order_;
+};
@@ -0,0 +1,69 @@
+// gl_mesh.h
+// Indexed GPU mesh: shared vertices in a VBO plus an element buffer.
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <iostream>
+
+#include "mesh_cache.h"
+
+struct GpuMesh {
+    GLuint vao = 0, vbo = 0, ebo = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    GLsizei indexCount = 0;
+};
+
+inline GLenum gl_index_type(size_t indexSize) {
+    return indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+// Points locations 0 / 1 of the bound VAO at packed vertices starting at
+// byte `offset` of the buffer bound to GL_ARRAY_BUFFER.
+inline void bind_vertex_attributes(size_t offset) {
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(SmfbVertex), (void*)(offset + offsetof(SmfbVertex, pos)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(SmfbVertex), (void*)(offset + offsetof(SmfbVertex, normal)));
+}
+
+// Uploads the shared vertices and the index buffer of every LOD, using
+// whichever index width the mesh was stored with. indexCount covers level 0
+// only. The vertices stay packed (12 bytes, see vertex_pack.h):
+//   location 0 = position, unorm16 x3 -> vec3 in [0, 1] (mesh.dequantizeMatrix())
+//   location 1 = normal, snorm16 x2 octahedral -> vec2, decoded in the shader
+inline GpuMesh upload_indexed_mesh(const CachedMesh& mesh) {
+    GpuMesh gpu;
+    gpu.indexType = gl_index_type(mesh.indexSize());
+    gpu.indexCount = (GLsizei)(mesh.faceCount() * 3);
+
+    glGenVertexArrays(1, &gpu.vao);
+    glGenBuffers(1, &gpu.vbo);
+    glGenBuffers(1, &gpu.ebo);
+
+    glBindVertexArray(gpu.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, gpu.vbo);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount() * sizeof(SmfbVertex), mesh.vertices, GL_STATIC_DRAW);
+    bind_vertex_attributes(0);
+
+    // the element buffer binding is VAO state, so bind it while the VAO is bound
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.totalIndexCount() * mesh.indexSize(), mesh.indices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    return gpu;
+}
+
+inline void draw_indexed_mesh(const GpuMesh& gpu) {
+    glBindVertexArray(gpu.vao);
+    glDrawElements(GL_TRIANGLES, gpu.indexCount, gpu.indexType, nullptr);
+    glBindVertexArray(0);
+}
+
+inline void destroy_gpu_mesh(GpuMesh& gpu) {
+    glDeleteBuffers(1, &gpu.vbo);
+    glDeleteBuffers(1, &gpu.ebo);
+    glDeleteVertexArrays(1, &gpu.vao);
+    gpu = GpuMesh();
+}
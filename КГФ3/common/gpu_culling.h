@@ -0,0 +1,484 @@
+// gpu_culling.h
+// GPU-driven drawing (GL 4.3): culling, LOD selection and draw command
+// generation run in a compute shader, and every mesh is drawn with one
+// glMultiDrawElementsIndirect.
+//
+// All instances of the scene sit in storage buffers with their bounding
+// spheres. Each frame one dispatch tests every instance against the frustum
+// and against a Hi-Z pyramid (a max-depth mip chain) built from the previous
+// frame's depth, picks its level the way select_lod does, and appends the
+// survivor to the instance range of its (mesh, level) command through an
+// atomic counter. The commands' base instance points each level at its range,
+// so the CPU never touches per-instance results. Occlusion against the
+// previous frame can hide an instance for one frame after a fast camera move
+// uncovers it.
+//
+// The 4.3 code is compiled only when glad has the entry points; at run time
+// gpu_culling_supported() decides, and the viewers keep the 3.3 scene_cull /
+// draw_scene path otherwise.
+
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "scene.h"
+
+#ifdef GL_VERSION_4_3
+#define GPU_CULLING 1
+#endif
+
+inline bool gpu_culling_supported() {
+#ifdef GPU_CULLING
+    return GLAD_GL_VERSION_4_3 != 0;
+#else
+    return false;
+#endif
+}
+
+// Opens the viewer window on a 4.3 core context when the GPU path is wanted,
+// falling back to the 3.3 core context the viewers need at minimum.
+inline GLFWwindow* create_viewer_window(int width, int height, const char* title, bool wantGpuCulling) {
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (wantGpuCulling) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        GLFWwindow* window = glfwCreateWindow(width, height, title, nullptr, nullptr);
+        if (window) return window;
+        std::cerr << "No GL 4.3 context, using the 3.3 path\n";
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    return glfwCreateWindow(width, height, title, nullptr, nullptr);
+}
+
+// Colour + sampleable depth the forward passes render into when the GPU path
+// is on: Hi-Z needs the depth as a texture, the window's own depth is not one.
+struct DepthTextureTarget {
+    GLuint fbo = 0, color = 0, depth = 0;
+    int width = 0, height = 0;
+
+    // (Re)allocates for the given size; cheap when the size is unchanged.
+    bool resize(int w, int h) {
+        if (fbo && w == width && h == height) return true;
+        destroy();
+        width = w; height = h;
+
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glGenTextures(1, &depth);
+        glBindTexture(GL_TEXTURE_2D, depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, w, h, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!ok) std::cerr << "Depth texture target incomplete\n";
+        return ok;
+    }
+
+    void bind() const { glBindFramebuffer(GL_FRAMEBUFFER, fbo); }
+
+    // Copies the colour into `target` (0 = window) and leaves it bound.
+    void blit_to(GLuint target) const {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+
+    void destroy() {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteTextures(1, &depth);
+        fbo = color = depth = 0;
+    }
+};
+
+// std430 mirrors of the compute shader's buffers.
+struct GpuCullInstance {
+    glm::vec4 sphere; // world center, radius
+    uint32_t mesh;
+    uint32_t pad[3];
+};
+
+struct GpuCullMesh {
+    uint32_t commandBase; // first of its lodCount commands
+    uint32_t lodCount;
+    float maxRadius;
+    uint32_t pad;
+    float lodError[SCENE_MAX_LODS];
+};
+
+struct DrawElementsIndirectCommand {
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    uint32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+static_assert(sizeof(GpuCullInstance) == 32 && sizeof(GpuCullMesh) == 80 && sizeof(DrawElementsIndirectCommand) == 20,
+    "GPU culling buffers must match the std430 layout");
+
+// One invocation per instance. InstanceData is 25 floats, read and written
+// as float arrays so the output keeps the vertex attribute layout.
+static const char* gpu_cull_comp = R"(
+#version 430 core
+layout(local_size_x = 64) in;
+
+struct CullInstance { vec4 sphere; uint mesh; uint pad0, pad1, pad2; };
+struct MeshInfo { uint commandBase; uint lodCount; float maxRadius; uint pad; float lodError[16]; };
+
+layout(std430, binding = 0) readonly buffer Instances { CullInstance instances[]; };
+layout(std430, binding = 1) readonly buffer Meshes { MeshInfo meshes[]; };
+layout(std430, binding = 2) readonly buffer Source { float source[]; };
+layout(std430, binding = 3) writeonly buffer Visible { float visible[]; };
+layout(std430, binding = 4) buffer Commands { uint commands[]; }; // 5 uints each
+
+uniform uint uInstanceCount;
+uniform bool uFrustum;
+uniform vec4 uPlanes[6];
+uniform bool uOcclusion;
+uniform mat4 uPrevViewProj;
+uniform sampler2D uHiZ;
+uniform bool uLodEnabled;
+uniform bool uPerspective;
+uniform vec3 uEye;
+uniform float uPixelsPerUnit;
+uniform float uMaxErrorPixels;
+
+// The sphere's screen rectangle in the previous frame, tested at the mip
+// where it covers at most 2x2 texels against their farthest depth.
+bool occluded(vec3 c, float r) {
+    vec3 lo = vec3(1e30), hi = vec3(-1e30);
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = c + r * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 p = uPrevViewProj * vec4(corner, 1.0);
+        if (p.w <= 0.0) return false; // reaches behind the camera
+        vec3 ndc = p.xyz / p.w;
+        lo = min(lo, ndc);
+        hi = max(hi, ndc);
+    }
+    if (lo.z <= -1.0) return false; // touches the near plane
+    vec2 uvLo = clamp(lo.xy * 0.5 + 0.5, 0.0, 1.0), uvHi = clamp(hi.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 extent = (uvHi - uvLo) * vec2(textureSize(uHiZ, 0));
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, textureQueryLevels(uHiZ) - 1);
+    ivec2 size = textureSize(uHiZ, level);
+    ivec2 a = clamp(ivec2(uvLo * vec2(size)), ivec2(0), size - 1);
+    ivec2 b = clamp(ivec2(uvHi * vec2(size)), ivec2(0), size - 1);
+    float farthest = max(max(texelFetch(uHiZ, a, level).r, texelFetch(uHiZ, ivec2(b.x, a.y), level).r),
+        max(texelFetch(uHiZ, ivec2(a.x, b.y), level).r, texelFetch(uHiZ, b, level).r));
+    return lo.z * 0.5 + 0.5 > farthest;
+}
+
+void main(){
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= uInstanceCount) return;
+    vec3 c = instances[id].sphere.xyz;
+    float r = instances[id].sphere.w;
+    if (uFrustum)
+        for (int i = 0; i < 6; ++i)
+            if (dot(uPlanes[i].xyz, c) + uPlanes[i].w < -r) return;
+    if (uOcclusion && occluded(c, r)) return;
+
+    MeshInfo m = meshes[instances[id].mesh];
+    uint level = 0u;
+    if (uLodEnabled && m.lodCount > 1u) {
+        float scale = m.maxRadius > 0.0 ? r / m.maxRadius : 1.0;
+        float pixelsPerUnit = uPixelsPerUnit;
+        bool inside = false;
+        if (uPerspective) {
+            float dist = length(c - uEye) - r;
+            inside = dist <= 1e-4; // the camera is inside the bounds
+            pixelsPerUnit /= max(dist, 1e-4);
+        }
+        if (!inside)
+            while (level + 1u < m.lodCount && m.lodError[level + 1u] * scale * pixelsPerUnit <= uMaxErrorPixels) ++level;
+    }
+
+    uint cmd = (m.commandBase + level) * 5u;
+    uint slot = commands[cmd + 4u] + atomicAdd(commands[cmd + 1u], 1u);
+    for (uint k = 0u; k < 25u; ++k) visible[slot * 25u + k] = source[id * 25u + k];
+}
+)";
+
+// One Hi-Z level: each texel is the farthest depth of the source texels it
+// overlaps (up to 3x3 when the source size is odd), so coverage stays
+// conservative at every level.
+static const char* gpu_hiz_comp = R"(
+#version 430 core
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D uSource;
+uniform int uSourceLevel;
+layout(r32f) writeonly uniform image2D uDest;
+
+void main(){
+    ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 dstSize = imageSize(uDest);
+    if (any(greaterThanEqual(dst, dstSize))) return;
+    ivec2 srcSize = textureSize(uSource, uSourceLevel);
+    ivec2 lo = dst * srcSize / dstSize;
+    ivec2 hi = min(((dst + 1) * srcSize + dstSize - 1) / dstSize, srcSize);
+    float d = 0.0;
+    for (int y = lo.y; y < hi.y; ++y)
+        for (int x = lo.x; x < hi.x; ++x) d = max(d, texelFetch(uSource, ivec2(x, y), uSourceLevel).r);
+    imageStore(uDest, dst, vec4(d));
+}
+)";
+
+#ifdef GPU_CULLING
+
+// Texture unit the cull shader reads the pyramid from; the viewers' own
+// passes use the low units.
+const GLuint GPU_CULL_HIZ_UNIT = 4;
+
+class GpuCuller {
+public:
+    bool create() {
+        cullProgram_ = compile_compute(gpu_cull_comp, "cull");
+        hizProgram_ = compile_compute(gpu_hiz_comp, "Hi-Z");
+        if (!cullProgram_ || !hizProgram_) { destroy(); return false; }
+        glUseProgram(cullProgram_);
+        glUniform1i(glGetUniformLocation(cullProgram_, "uHiZ"), GPU_CULL_HIZ_UNIT);
+        glUseProgram(hizProgram_);
+        glUniform1i(glGetUniformLocation(hizProgram_, "uSource"), 0);
+        glUniform1i(glGetUniformLocation(hizProgram_, "uDest"), 0);
+        glUseProgram(0);
+        glGenBuffers(BUFFER_COUNT, buffers_);
+        return true;
+    }
+
+    // Occlusion against the previous frame; frustum culling follows scene.cull,
+    // either works without the other.
+    void set_occlusion(bool enabled) { occlusion_ = enabled; }
+
+    // Resets the commands and runs the cull dispatch for this frame. The
+    // instance buffers are rebuilt whenever the scene layout changed, and the
+    // pyramid of the old layout is not used for occlusion then.
+    void cull(const Scene& scene, const glm::mat4& viewProj, const LodSelection& lod) {
+        if (!built_ || version_ != scene.layoutVersion) build(scene);
+        viewProj_ = viewProj;
+        if (instanceCount_ == 0) return;
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers_[COMMANDS]);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, resetCommands_.size() * sizeof(DrawElementsIndirectCommand),
+            resetCommands_.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        for (GLuint b = 0; b < BUFFER_COUNT; ++b) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, b, buffers_[b]);
+
+        Frustum f = frustum_from_matrix(viewProj);
+        bool occlusion = occlusion_ && hiz_ != 0 && hizValid_;
+        glUseProgram(cullProgram_);
+        glUniform1ui(uniform("uInstanceCount"), instanceCount_);
+        glUniform1i(uniform("uFrustum"), scene.cull);
+        glUniform4fv(uniform("uPlanes"), 6, &f.planes[0].x);
+        glUniform1i(uniform("uOcclusion"), occlusion);
+        glUniformMatrix4fv(uniform("uPrevViewProj"), 1, GL_FALSE, &prevViewProj_[0][0]);
+        glUniform1i(uniform("uLodEnabled"), lod.enabled);
+        glUniform1i(uniform("uPerspective"), lod.perspective);
+        glUniform3fv(uniform("uEye"), 1, &lod.eye.x);
+        glUniform1f(uniform("uPixelsPerUnit"), lod.pixelsPerUnit);
+        glUniform1f(uniform("uMaxErrorPixels"), lod.maxErrorPixels);
+        glActiveTexture(GL_TEXTURE0 + GPU_CULL_HIZ_UNIT);
+        glBindTexture(GL_TEXTURE_2D, hiz_);
+        glActiveTexture(GL_TEXTURE0);
+
+        glDispatchCompute((instanceCount_ + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+        glUseProgram(0);
+    }
+
+    // Draws what the last cull() kept: one indirect multi-draw per mesh,
+    // one command per level. Fences the dynamic vertex streams it reads.
+    void draw(Scene& scene) const {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers_[COMMANDS]);
+        for (size_t i = 0; i < scene.meshes.size() && i < meshLevels_.size(); ++i) {
+            SceneMesh& m = *scene.meshes[i];
+            if (meshLevels_[i] == 0 || m.instances.empty()) continue;
+            glBindVertexArray(m.gpu.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, buffers_[VISIBLE]);
+            bind_instance_attributes(0); // the commands' base instance picks the range
+            glMultiDrawElementsIndirect(GL_TRIANGLES, m.gpu.indexType,
+                (void*)(meshCommandBase_[i] * sizeof(DrawElementsIndirectCommand)), (GLsizei)meshLevels_[i], 0);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        for (auto& m : scene.meshes) m->vertexStream.fence();
+    }
+
+    // Builds the pyramid next frame's cull tests against from this frame's
+    // depth texture (after every draw that writes it).
+    void build_hiz(GLuint depthTexture, int width, int height) {
+        if (!occlusion_ || width <= 0 || height <= 0) return;
+        if (width != hizWidth_ || height != hizHeight_) {
+            glDeleteTextures(1, &hiz_);
+            hizWidth_ = width; hizHeight_ = height;
+            hizLevels_ = 1;
+            while ((std::max(width, height) >> hizLevels_) > 0) ++hizLevels_;
+            glGenTextures(1, &hiz_);
+            glBindTexture(GL_TEXTURE_2D, hiz_);
+            glTexStorage2D(GL_TEXTURE_2D, hizLevels_, GL_R32F, width, height);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        glUseProgram(hizProgram_);
+        GLint sourceLevel = glGetUniformLocation(hizProgram_, "uSourceLevel");
+        for (int level = 0; level < hizLevels_; ++level) {
+            int w = std::max(1, width >> level), h = std::max(1, height >> level);
+            glBindTexture(GL_TEXTURE_2D, level == 0 ? depthTexture : hiz_);
+            glUniform1i(sourceLevel, level == 0 ? 0 : level - 1);
+            glBindImageTexture(0, hiz_, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute((w + 7) / 8, (h + 7) / 8, 1);
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+        prevViewProj_ = viewProj_;
+        hizValid_ = true;
+    }
+
+    void destroy() {
+        glDeleteProgram(cullProgram_);
+        glDeleteProgram(hizProgram_);
+        glDeleteBuffers(BUFFER_COUNT, buffers_);
+        glDeleteTextures(1, &hiz_);
+        cullProgram_ = hizProgram_ = hiz_ = 0;
+        for (auto& b : buffers_) b = 0;
+        hizWidth_ = hizHeight_ = 0;
+        hizValid_ = false;
+        built_ = false;
+    }
+
+private:
+    enum { INSTANCES, MESHES, SOURCE, VISIBLE, COMMANDS, BUFFER_COUNT }; // = SSBO bindings
+
+    static GLuint compile_compute(const char* src, const char* name) {
+        GLuint s = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(s, 1, &src, nullptr);
+        glCompileShader(s);
+        GLint ok; glGetShaderiv(s, GL_COMPILE_STATUS, &ok);
+        if (!ok) {
+            char buf[1024]; glGetShaderInfoLog(s, 1024, nullptr, buf);
+            std::cerr << "GPU " << name << " shader compile error: " << buf << "\n";
+            glDeleteShader(s);
+            return 0;
+        }
+        GLuint p = glCreateProgram();
+        glAttachShader(p, s);
+        glLinkProgram(p);
+        glDeleteShader(s);
+        glGetProgramiv(p, GL_LINK_STATUS, &ok);
+        if (!ok) {
+            char buf[1024]; glGetProgramInfoLog(p, 1024, nullptr, buf);
+            std::cerr << "GPU " << name << " program link error: " << buf << "\n";
+            glDeleteProgram(p);
+            return 0;
+        }
+        return p;
+    }
+
+    GLint uniform(const char* name) const { return glGetUniformLocation(cullProgram_, name); }
+
+    // Every (mesh, level) gets room for all of the mesh's instances, so the
+    // appends never need a second pass to place them.
+    void build(const Scene& scene) {
+        std::vector<GpuCullInstance> instances;
+        std::vector<GpuCullMesh> meshes;
+        std::vector<InstanceData> source;
+        resetCommands_.clear();
+        meshCommandBase_.clear();
+        meshLevels_.clear();
+
+        uint32_t slots = 0;
+        for (auto& m : scene.meshes) {
+            uint32_t levels = (uint32_t)std::min<size_t>(m->mesh.lodCount(), SCENE_MAX_LODS);
+            uint32_t count = (uint32_t)m->instances.size();
+            GpuCullMesh info = {};
+            info.commandBase = (uint32_t)resetCommands_.size();
+            info.lodCount = levels;
+            info.maxRadius = m->mesh.maxRadius();
+            for (uint32_t l = 0; l < levels; ++l) {
+                const SmfbLod& lod = m->mesh.lod(l);
+                info.lodError[l] = lod.error;
+                resetCommands_.push_back({ lod.indexCount, 0, lod.firstIndex, 0, slots + l * count });
+            }
+            slots += levels * count;
+            meshes.push_back(info);
+            meshCommandBase_.push_back(info.commandBase);
+            meshLevels_.push_back(levels);
+        }
+        for (size_t i = 0; i < scene.bounds.size(); ++i) {
+            const SceneMesh& m = *scene.meshes[scene.instanceMesh[i]];
+            GpuCullInstance inst = {};
+            inst.sphere = glm::vec4(scene.bounds[i].center, scene.bounds[i].radius);
+            inst.mesh = scene.instanceMesh[i];
+            instances.push_back(inst);
+            source.push_back(gpu_instance(m, m.instances[scene.instanceIndex[i]]));
+        }
+        instanceCount_ = (GLuint)instances.size();
+
+        upload(INSTANCES, instances.size() * sizeof(GpuCullInstance), instances.data(), GL_STATIC_DRAW);
+        upload(MESHES, meshes.size() * sizeof(GpuCullMesh), meshes.data(), GL_STATIC_DRAW);
+        upload(SOURCE, source.size() * sizeof(InstanceData), source.data(), GL_STATIC_DRAW);
+        upload(VISIBLE, (size_t)slots * sizeof(InstanceData), nullptr, GL_DYNAMIC_COPY);
+        upload(COMMANDS, resetCommands_.size() * sizeof(DrawElementsIndirectCommand), resetCommands_.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        version_ = scene.layoutVersion;
+        built_ = true;
+        hizValid_ = false; // instances moved: the last depth no longer matches them
+    }
+
+    void upload(int b, size_t bytes, const void* data, GLenum usage) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers_[b]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)std::max<size_t>(bytes, 16), data && bytes ? data : nullptr, usage);
+    }
+
+    GLuint cullProgram_ = 0, hizProgram_ = 0;
+    GLuint buffers_[BUFFER_COUNT] = {};
+    GLuint instanceCount_ = 0;
+    std::vector<DrawElementsIndirectCommand> resetCommands_;
+    std::vector<uint32_t> meshCommandBase_, meshLevels_;
+    uint32_t version_ = 0;
+    bool built_ = false;
+
+    bool occlusion_ = true;
+    GLuint hiz_ = 0;
+    bool hizValid_ = false; // built since the last layout change
+    int hizWidth_ = 0, hizHeight_ = 0, hizLevels_ = 0;
+    glm::mat4 viewProj_ = glm::mat4(1.0f), prevViewProj_ = glm::mat4(1.0f);
+};
+
+#else
+
+// Without the 4.3 headers the viewers only ever take the 3.3 path.
+class GpuCuller {
+public:
+    bool create() { return false; }
+    void set_occlusion(bool) {}
+    void cull(const Scene&, const glm::mat4&, const LodSelection&) {}
+    void draw(Scene&) const {}
+    void build_hiz(GLuint, int, int) {}
+    void destroy() {}
+};
+
+#endif
@@ -0,0 +1,161 @@
+// mapped_file.h
+// Read-only memory mapping of a whole file (Win32 file mapping / POSIX mmap),
+// and a writable one for scratch arrays larger than RAM should hold.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& filename) {
+        close();
+#ifdef _WIN32
+        file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size)) { close(); return false; }
+        size_ = (size_t)size.QuadPart;
+        if (size_ > 0) { // empty files cannot be mapped, but are valid
+            mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping_) { close(); return false; }
+            data_ = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+            if (!data_) { close(); return false; }
+        }
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) { ::close(fd); return false; }
+        size_ = (size_t)st.st_size;
+        if (size_ > 0) {
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) { ::close(fd); size_ = 0; return false; }
+            madvise(p, size_, MADV_SEQUENTIAL);
+            data_ = (const char*)p;
+        }
+        ::close(fd); // the mapping keeps its own reference
+#endif
+        open_ = true;
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap((void*)data_, size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        open_ = false;
+    }
+
+    bool is_open() const { return open_; }
+    const char* data() const { return data_; }
+    const char* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool open_ = false;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+// A new file of a fixed size, mapped read-write and shared, so the OS can
+// write its pages back and drop them instead of keeping them resident: a
+// file-backed array for out-of-core preprocessing (mesh_pages.h). The file
+// is deleted on close().
+class ScratchMappedFile {
+public:
+    ScratchMappedFile() = default;
+    ~ScratchMappedFile() { close(); }
+
+    ScratchMappedFile(const ScratchMappedFile&) = delete;
+    ScratchMappedFile& operator=(const ScratchMappedFile&) = delete;
+
+    bool create(const std::string& filename, size_t size) {
+        close();
+        path_ = filename;
+        size_ = size;
+        if (size_ == 0) size_ = 1; // zero-length views cannot be mapped
+#ifdef _WIN32
+        file_ = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size_ >> 32), (DWORD)size_, nullptr);
+        if (!mapping_) { close(); return false; }
+        data_ = (char*)MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0);
+        if (!data_) { close(); return false; }
+#else
+        int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) return false;
+        ::unlink(filename.c_str()); // gone from the directory already, freed with the mapping
+        if (ftruncate(fd, (off_t)size_) != 0) { ::close(fd); return false; }
+        void* p = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        data_ = (char*)p;
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap(data_, size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    char* data() const { return data_; }
+    size_t size() const { return size_; }
+    template <class T> T* as() const { return (T*)data_; }
+
+private:
+    std::string path_;
+    char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
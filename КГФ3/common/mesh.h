@@ -0,0 +1,123 @@
+// mesh.h
+// Working mesh of the load path: every array in one linear arena.
+//
+// The parser sizes the mesh from its counting pass, so allocate() makes a
+// single allocation up front and nothing grows or is copied afterwards.
+// Positions and vertex normals are stored as separate x / y / z arrays
+// (SoA), which is what the SIMD preprocessing passes read; indices are a
+// plain uint32 triple per face, layout-compatible with glm::uvec3 for the
+// passes that take faces. The mesh only lives until it has been packed into
+// the 12-byte GPU vertices (smfb_pack_vertices in mesh_cache.h) and streamed
+// into the .smfb cache, which is what the viewers upload from.
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+static_assert(sizeof(glm::uvec3) == 3 * sizeof(uint32_t), "faces are read as index triples");
+
+// Bump allocator over one block. Allocations are ARENA_ALIGN aligned and
+// only freed together, by reset() or release().
+class LinearArena {
+public:
+    static const size_t ARENA_ALIGN = 64; // cache line, and enough for any SIMD load
+
+    // Room for `bytes` (plus alignment padding of every allocation); replaces
+    // the previous block.
+    bool reserve(size_t bytes) {
+        release();
+        block_.reset(new (std::nothrow) char[bytes + ARENA_ALIGN]);
+        if (!block_) return false;
+        base_ = (char*)(((uintptr_t)block_.get() + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1));
+        capacity_ = bytes;
+        return true;
+    }
+
+    // nullptr once the block is full; the arena never grows
+    template <typename T>
+    T* alloc(size_t count) {
+        size_t offset = align(used_);
+        if (offset + count * sizeof(T) > capacity_) return nullptr;
+        used_ = offset + count * sizeof(T);
+        return (T*)(base_ + offset);
+    }
+
+    void reset() { used_ = 0; }
+    void release() {
+        block_.reset();
+        base_ = nullptr;
+        capacity_ = used_ = 0;
+    }
+
+    size_t capacity() const { return capacity_; }
+    size_t used() const { return used_; }
+
+    static size_t align(size_t bytes) { return (bytes + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1); }
+
+private:
+    std::unique_ptr<char[]> block_;
+    char* base_ = nullptr;
+    size_t capacity_ = 0, used_ = 0;
+};
+
+struct Mesh {
+    size_t vertexCount = 0;
+    size_t faceCount = 0;
+    float* px = nullptr; float* py = nullptr; float* pz = nullptr; // positions
+    float* nx = nullptr; float* ny = nullptr; float* nz = nullptr; // vertex normals (compute_vertex_normals)
+    uint32_t* indices = nullptr;                                    // 3 per face, 0-based
+
+    // Uninitialized arrays for the given counts, in one allocation.
+    bool allocate(size_t vertices, size_t faces) {
+        size_t floats = LinearArena::align(vertices * sizeof(float));
+        if (!arena.reserve(6 * floats + LinearArena::align(faces * 3 * sizeof(uint32_t)))) {
+            release();
+            return false;
+        }
+        vertexCount = vertices;
+        faceCount = faces;
+        px = arena.alloc<float>(vertices); py = arena.alloc<float>(vertices); pz = arena.alloc<float>(vertices);
+        nx = arena.alloc<float>(vertices); ny = arena.alloc<float>(vertices); nz = arena.alloc<float>(vertices);
+        indices = arena.alloc<uint32_t>(faces * 3);
+        return true;
+    }
+
+    void release() {
+        arena.release();
+        *this = Mesh();
+    }
+
+    glm::vec3 position(size_t i) const { return glm::vec3(px[i], py[i], pz[i]); }
+    void set_position(size_t i, const glm::vec3& p) { px[i] = p.x; py[i] = p.y; pz[i] = p.z; }
+    glm::vec3 normal(size_t i) const { return glm::vec3(nx[i], ny[i], nz[i]); }
+    glm::uvec3* faces() { return (glm::uvec3*)indices; }
+    const glm::uvec3* faces() const { return (const glm::uvec3*)indices; }
+    size_t bytes() const { return arena.capacity(); }
+
+    LinearArena arena;
+};
+
+// AoS copies for the passes that still take vectors (optimize_mesh,
+// build_lod_chain), and the way back once they have reordered them.
+inline std::vector<glm::vec3> mesh_positions(const Mesh& mesh) {
+    std::vector<glm::vec3> positions(mesh.vertexCount);
+    for (size_t i = 0; i < mesh.vertexCount; ++i) positions[i] = mesh.position(i);
+    return positions;
+}
+
+inline std::vector<glm::uvec3> mesh_faces(const Mesh& mesh) {
+    return std::vector<glm::uvec3>(mesh.faces(), mesh.faces() + mesh.faceCount);
+}
+
+// Counts must match the mesh.
+inline void mesh_assign(Mesh& mesh, const std::vector<glm::vec3>& positions, const std::vector<glm::uvec3>& faces) {
+    for (size_t i = 0; i < mesh.vertexCount; ++i) mesh.set_position(i, positions[i]);
+    std::copy(faces.begin(), faces.end(), mesh.faces());
+}
@@ -0,0 +1,196 @@
+// mesh_adjacency.h
+// Connectivity of an indexed triangle mesh, for the analysis passes.
+//
+// Corner c = 3 f + k of face f doubles as the half-edge from faces[f][k] to
+// faces[f][(k + 1) % 3]. Two structures describe the topology:
+//   opposite[c]                  the half-edge running the other way along the
+//                                same edge; ADJ_BOUNDARY on a border,
+//                                ADJ_NON_MANIFOLD where the edge has more than
+//                                two half-edges, or two running the same way
+//   vertexFirst / vertexCorners  CSR: the corners at each vertex, in face order
+// Both come from parallel sorts of packed keys (min << 32 | max per edge for
+// the twins, vertex << 32 | corner for the fans) rather than hash maps, so
+// the result is the same for any thread count. The preprocessing builds
+// one up front: the vertex cache optimizer walks its fans, the simplifier
+// starts from it and remap_mesh_adjacency keeps it in step when the faces
+// are reordered. The mesh cache can store it next to the faces
+// (MeshLoadOptions::adjacency), and consumers read either copy through an
+// AdjacencyView.
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "parallel.h"
+
+const uint32_t ADJ_BOUNDARY = 0xFFFFFFFFu;
+const uint32_t ADJ_NON_MANIFOLD = 0xFFFFFFFEu;
+
+// Read-only view of a MeshAdjacency, or of the arrays in a mapped cache.
+struct AdjacencyView {
+    const uint32_t* opposite = nullptr;      // [cornerCount]
+    const uint32_t* vertexFirst = nullptr;   // [vertexCount + 1]
+    const uint32_t* vertexCorners = nullptr; // [cornerCount]
+    size_t vertexCount = 0;
+    size_t cornerCount = 0;
+
+    bool valid() const { return opposite != nullptr; }
+
+    static uint32_t face(uint32_t c) { return c / 3; }
+    static uint32_t next(uint32_t c) { return c % 3 == 2 ? c - 2 : c + 1; }
+    static uint32_t prev(uint32_t c) { return c % 3 == 0 ? c + 2 : c - 1; }
+
+    bool has_twin(uint32_t c) const { return opposite[c] < ADJ_NON_MANIFOLD; }
+    bool is_boundary(uint32_t c) const { return opposite[c] == ADJ_BOUNDARY; }
+    // The face across edge k of face f, or ADJ_BOUNDARY / ADJ_NON_MANIFOLD.
+    uint32_t neighbor_face(uint32_t f, int k) const {
+        uint32_t o = opposite[f * 3 + k];
+        return o < ADJ_NON_MANIFOLD ? o / 3 : o;
+    }
+
+    // corners (and so faces) around vertex v
+    const uint32_t* corners_begin(uint32_t v) const { return vertexCorners + vertexFirst[v]; }
+    const uint32_t* corners_end(uint32_t v) const { return vertexCorners + vertexFirst[v + 1]; }
+    uint32_t face_count(uint32_t v) const { return vertexFirst[v + 1] - vertexFirst[v]; }
+};
+
+struct MeshAdjacency {
+    std::vector<uint32_t> opposite;
+    std::vector<uint32_t> vertexFirst;
+    std::vector<uint32_t> vertexCorners;
+    uint32_t boundaryEdges = 0;    // edges with a single half-edge
+    uint32_t nonManifoldEdges = 0; // edges marked ADJ_NON_MANIFOLD
+
+    AdjacencyView view() const {
+        AdjacencyView v;
+        v.opposite = opposite.data();
+        v.vertexFirst = vertexFirst.data();
+        v.vertexCorners = vertexCorners.data();
+        v.vertexCount = vertexFirst.empty() ? 0 : vertexFirst.size() - 1;
+        v.cornerCount = opposite.size();
+        return v;
+    }
+};
+
+// corners per parallel task
+const size_t ADJACENCY_BLOCK = 1u << 16;
+
+inline MeshAdjacency build_mesh_adjacency(const glm::uvec3* faces, size_t faceCount, size_t vertexCount) {
+    ThreadPool& pool = thread_pool();
+    const uint32_t* index = (const uint32_t*)faces;
+    const size_t corners = faceCount * 3;
+    const size_t blocks = (corners + ADJACENCY_BLOCK - 1) / ADJACENCY_BLOCK;
+    MeshAdjacency adj;
+
+    // twins: half-edges sorted by their undirected edge, then resolved run by run
+    {
+        struct EdgeKey {
+            uint64_t edge;
+            uint32_t corner;
+        };
+        std::vector<EdgeKey> edges(corners);
+        pool.parallel_for(blocks, [&](size_t b) {
+            size_t end = std::min(corners, (b + 1) * ADJACENCY_BLOCK);
+            for (size_t c = b * ADJACENCY_BLOCK; c < end; ++c) {
+                uint32_t a = index[c], z = index[AdjacencyView::next((uint32_t)c)];
+                edges[c].edge = ((uint64_t)std::min(a, z) << 32) | std::max(a, z);
+                edges[c].corner = (uint32_t)c;
+            }
+        });
+        parallel_sort(edges.data(), corners, [](const EdgeKey& x, const EdgeKey& y) {
+            return x.edge != y.edge ? x.edge < y.edge : x.corner < y.corner;
+        });
+
+        adj.opposite.assign(corners, ADJ_BOUNDARY);
+        std::vector<uint32_t> boundary(blocks, 0), nonManifold(blocks, 0);
+        pool.parallel_for(blocks, [&](size_t b) {
+            // a block resolves the runs that start inside it, to their end
+            size_t i = b * ADJACENCY_BLOCK, end = std::min(corners, (b + 1) * ADJACENCY_BLOCK);
+            while (i > 0 && i < end && edges[i].edge == edges[i - 1].edge) ++i;
+            while (i < end) {
+                size_t j = i + 1;
+                while (j < corners && edges[j].edge == edges[i].edge) ++j;
+                uint32_t c0 = edges[i].corner;
+                if (j - i == 1) ++boundary[b];
+                else if (j - i == 2 && index[c0] != index[edges[i + 1].corner]) {
+                    // consistently oriented: the two half-edges start at opposite ends
+                    uint32_t c1 = edges[i + 1].corner;
+                    adj.opposite[c0] = c1;
+                    adj.opposite[c1] = c0;
+                }
+                else {
+                    for (size_t k = i; k < j; ++k) adj.opposite[edges[k].corner] = ADJ_NON_MANIFOLD;
+                    ++nonManifold[b];
+                }
+                i = j;
+            }
+        });
+        for (size_t b = 0; b < blocks; ++b) {
+            adj.boundaryEdges += boundary[b];
+            adj.nonManifoldEdges += nonManifold[b];
+        }
+    }
+
+    // fans: corners sorted by vertex, which keeps each vertex's corners in order
+    std::vector<uint64_t> keys(corners);
+    pool.parallel_for(blocks, [&](size_t b) {
+        size_t end = std::min(corners, (b + 1) * ADJACENCY_BLOCK);
+        for (size_t c = b * ADJACENCY_BLOCK; c < end; ++c) keys[c] = ((uint64_t)index[c] << 32) | c;
+    });
+    parallel_sort(keys.data(), corners);
+
+    adj.vertexCorners.resize(corners);
+    adj.vertexFirst.resize(vertexCount + 1);
+    pool.parallel_for(blocks, [&](size_t b) {
+        size_t end = std::min(corners, (b + 1) * ADJACENCY_BLOCK);
+        for (size_t i = b * ADJACENCY_BLOCK; i < end; ++i) {
+            adj.vertexCorners[i] = (uint32_t)keys[i];
+            // vertices between the previous corner's and this one's start here
+            uint32_t v = (uint32_t)(keys[i] >> 32);
+            uint32_t u = i == 0 ? 0 : (uint32_t)(keys[i - 1] >> 32) + 1;
+            for (; u <= v; ++u) adj.vertexFirst[u] = (uint32_t)i;
+        }
+    });
+    uint32_t last = corners ? (uint32_t)(keys[corners - 1] >> 32) + 1 : 0;
+    for (size_t u = last; u <= vertexCount; ++u) adj.vertexFirst[u] = (uint32_t)corners;
+    return adj;
+}
+
+// Follows a reorder of the faces (order[i] = old index of face i) and a
+// renumbering of the vertices (remap[old] = new) without rebuilding; the
+// result equals build_mesh_adjacency on the reordered faces.
+inline void remap_mesh_adjacency(MeshAdjacency& adj, const std::vector<uint32_t>& order, const std::vector<uint32_t>& remap) {
+    const size_t corners = adj.opposite.size();
+    const size_t vertexCount = remap.size();
+    std::vector<uint32_t> newFace(order.size());
+    for (uint32_t f = 0; f < (uint32_t)order.size(); ++f) newFace[order[f]] = f;
+    auto corner = [&](uint32_t c) { return newFace[c / 3] * 3 + c % 3; };
+
+    std::vector<uint32_t> opposite(corners);
+    for (uint32_t c = 0; c < (uint32_t)corners; ++c) {
+        uint32_t o = adj.opposite[c];
+        opposite[corner(c)] = o < ADJ_NON_MANIFOLD ? corner(o) : o;
+    }
+
+    // each fan moves to its vertex's new number and is put back in face order
+    std::vector<uint32_t> first(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) first[remap[v] + 1] = adj.vertexFirst[v + 1] - adj.vertexFirst[v];
+    for (size_t v = 0; v < vertexCount; ++v) first[v + 1] += first[v];
+    std::vector<uint32_t> fans(corners);
+    thread_pool().parallel_for((vertexCount + ADJACENCY_BLOCK - 1) / ADJACENCY_BLOCK, [&](size_t b) {
+        size_t end = std::min(vertexCount, (b + 1) * ADJACENCY_BLOCK);
+        for (size_t v = b * ADJACENCY_BLOCK; v < end; ++v) {
+            uint32_t* out = fans.data() + first[remap[v]];
+            uint32_t* fill = out;
+            for (uint32_t i = adj.vertexFirst[v]; i < adj.vertexFirst[v + 1]; ++i) *fill++ = corner(adj.vertexCorners[i]);
+            std::sort(out, fill);
+        }
+    });
+    adj.opposite.swap(opposite);
+    adj.vertexFirst.swap(first);
+    adj.vertexCorners.swap(fans);
+}
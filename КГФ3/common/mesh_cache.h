@@ -0,0 +1,600 @@
+// mesh_cache.h
+// Versioned binary mesh cache (.smfb) written next to the source .smf.
+//
+// The cache holds everything the viewers would otherwise recompute on every
+// launch, already in the layout the vertex buffers use:
+//   SmfbVertex[vertexCount]        12 bytes: AABB-quantized position + octahedral
+//                                  weighted average vertex normal (vertex_pack.h)
+//   SmfbLod[lodCount]              index range + error of every level of detail
+//   uint16_t/uint32_t[...]         triangle indices of all levels, 16-bit when they fit
+//   uint32_t[...]                  optional half-edge adjacency of level 0
+//                                  (mesh_adjacency.h): opposite[3 * faceCount],
+//                                  vertexFirst[vertexCount + 1], vertexCorners[3 * faceCount]
+// plus the framing bounds (centroid, max radius, AABB). Level 0 is the full
+// mesh (faceCount triangles); coarser levels index the same vertices. A
+// cache hit is one mmap; the section pointers go straight to glBufferData.
+// Flat shading derives face normals in the fragment shader, so it uses the
+// same buffers.
+//
+// A miss parses into an arena-backed SoA Mesh (mesh.h), computes the normals
+// in place and streams the packed image to disk in small blocks; the mesh is
+// then freed and the written file mapped like a hit, so the load never holds
+// more than the working mesh plus one block.
+//
+// The cache is valid while the source size and content hash match. The
+// hash is only recomputed when the mtime changed, so an untouched source
+// costs one stat on a hit.
+// When requested, the mesh is run through the vertex cache optimizer first
+// and the reordered result is what gets cached; likewise the LOD chain
+// (mesh_simplify.h) is built once and stored.
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "mapped_file.h"
+#include "mesh.h"
+#include "mesh_adjacency.h"
+#include "mesh_normals.h"
+#include "mesh_optimize.h"
+#include "mesh_simplify.h"
+#include "parallel.h"
+#include "smf_loader.h"
+#include "vertex_pack.h"
+
+const uint32_t SMFB_VERSION = 6;
+
+// SmfbHeader::flags
+const uint32_t SMFB_FLAG_OPTIMIZED = 1;      // triangle / vertex order from optimize_mesh
+const uint32_t SMFB_FLAG_AREA_WEIGHTED = 2;  // vertex normals weighted by face area
+const uint32_t SMFB_FLAG_ANGLE_WEIGHTED = 4; // ... or by corner angle; neither = uniform
+const uint32_t SMFB_WEIGHT_FLAGS = SMFB_FLAG_AREA_WEIGHTED | SMFB_FLAG_ANGLE_WEIGHTED;
+const uint32_t SMFB_FLAG_ADJACENCY = 8;      // adjacency section present
+
+inline uint32_t smfb_weight_flags(NormalWeighting weighting) {
+    if (weighting == NORMAL_WEIGHT_AREA) return SMFB_FLAG_AREA_WEIGHTED;
+    if (weighting == NORMAL_WEIGHT_ANGLE) return SMFB_FLAG_ANGLE_WEIGHTED;
+    return 0;
+}
+
+// Read by GL as unorm16 x3 (location 0) and snorm16 x2 (location 1).
+struct SmfbVertex {
+    uint16_t pos[3];        // (p - boundsMin) / extent, see vertex_pack.h
+    uint16_t pad;
+    int16_t normal[2];      // octahedral
+};
+
+struct SmfbLod {
+    uint32_t firstIndex;    // into the index section
+    uint32_t indexCount;
+    float error;            // object-space deviation bound, 0 for level 0
+    uint32_t pad;
+};
+
+struct SmfbHeader {
+    char magic[4];          // "SMFB"
+    uint32_t version;
+    uint64_t fileSize;      // size of the whole cache file
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint64_t sourceHash;
+    uint32_t vertexCount;
+    uint32_t faceCount;
+    uint32_t indexSize;     // bytes per index, 2 or 4
+    uint32_t flags;         // SMFB_FLAG_*
+    float centroid[3];
+    float maxRadius;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint32_t lodCount;      // >= 1
+    uint32_t lodRequested;  // coarser levels asked for (the chain may stop early)
+    uint64_t lodOffset;
+    uint64_t adjacencyOffset; // 0 without SMFB_FLAG_ADJACENCY
+    uint32_t boundaryEdges;   // from the adjacency, when present
+    uint32_t nonManifoldEdges;
+};
+
+static_assert(sizeof(SmfbVertex) == 12, "unexpected vertex padding");
+
+// A loaded mesh: sections point either into the mapped cache file or into
+// `image` when the cache was just built.
+struct CachedMesh {
+    const SmfbHeader* header = nullptr;
+    const SmfbVertex* vertices = nullptr;
+    const void* indices = nullptr;          // indexSize() bytes each
+    const SmfbLod* lods = nullptr;
+    const uint32_t* adjacency = nullptr;    // SMFB_FLAG_ADJACENCY only
+
+    size_t vertexCount() const { return header ? header->vertexCount : 0; }
+    size_t faceCount() const { return header ? header->faceCount : 0; }
+    size_t indexSize() const { return header ? header->indexSize : 4; }
+    uint32_t index(size_t i) const {
+        return indexSize() == 2 ? ((const uint16_t*)indices)[i] : ((const uint32_t*)indices)[i];
+    }
+    size_t lodCount() const { return header ? header->lodCount : 0; }
+    // level 0 connectivity; not valid() unless loaded with MeshLoadOptions::adjacency
+    AdjacencyView adjacency_view() const {
+        AdjacencyView v;
+        if (!adjacency) return v;
+        v.vertexCount = vertexCount();
+        v.cornerCount = faceCount() * 3;
+        v.opposite = adjacency;
+        v.vertexFirst = adjacency + v.cornerCount;
+        v.vertexCorners = v.vertexFirst + v.vertexCount + 1;
+        return v;
+    }
+    const SmfbLod& lod(size_t level) const { return lods[level]; }
+    size_t totalIndexCount() const {
+        return header ? (size_t)lods[header->lodCount - 1].firstIndex + lods[header->lodCount - 1].indexCount : 0;
+    }
+    glm::vec3 centroid() const { return glm::vec3(header->centroid[0], header->centroid[1], header->centroid[2]); }
+    float maxRadius() const { return header->maxRadius; }
+    glm::vec3 boundsMin() const { return glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]); }
+    glm::vec3 quantizeExtent() const {
+        return aabb_quantize_extent(boundsMin(),
+            glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]));
+    }
+    // maps the stored [0, 1] positions back to object space
+    glm::mat4 dequantizeMatrix() const { return aabb_dequantize_matrix(boundsMin(), quantizeExtent()); }
+    glm::vec3 position(size_t i) const {
+        const uint16_t* q = vertices[i].pos;
+        return boundsMin() + glm::vec3(q[0] / 65535.0f, q[1] / 65535.0f, q[2] / 65535.0f) * quantizeExtent();
+    }
+    glm::vec3 normal(size_t i) const { return oct_decode(vertices[i].normal); }
+
+    MappedFile mapped;
+    std::vector<char> image;
+};
+
+// --- source identity ---
+struct SmfSourceStamp {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+};
+
+inline bool smf_source_stamp(const std::string& filename, SmfSourceStamp& out) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(filename.c_str(), &st) != 0) return false;
+#else
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) return false;
+#endif
+    out.size = (uint64_t)st.st_size;
+    out.mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+// 64-bit content hash. The data is hashed in fixed 1 MiB blocks on the thread
+// pool and the block hashes are hashed again, so the result does not depend
+// on the thread count.
+inline uint64_t smfb_hash_block(const char* data, size_t size, uint64_t h) {
+    const uint64_t prime = 0x100000001b3ull;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        h = (h ^ w) * prime;
+        h ^= h >> 29;
+    }
+    for (; i < size; ++i) h = (h ^ (unsigned char)data[i]) * prime;
+    return h ^ (h >> 32);
+}
+
+inline uint64_t smfb_hash(const char* data, size_t size) {
+    const size_t block = 1u << 20;
+    size_t blocks = (size + block - 1) / block;
+    std::vector<uint64_t> partial(blocks);
+    thread_pool().parallel_for(blocks, [&](size_t b) {
+        size_t begin = b * block;
+        partial[b] = smfb_hash_block(data + begin, std::min(block, size - begin), 0xcbf29ce484222325ull + b);
+    });
+    return smfb_hash_block((const char*)partial.data(), blocks * sizeof(uint64_t), 0xcbf29ce484222325ull ^ size);
+}
+
+inline std::string smfb_cache_path(const std::string& smfPath) {
+    const std::string ext = ".smf";
+    if (smfPath.size() >= ext.size() && smfPath.compare(smfPath.size() - ext.size(), ext.size(), ext) == 0)
+        return smfPath + "b";
+    return smfPath + ".smfb";
+}
+
+// --- image layout ---
+// uint32 words of the adjacency section
+inline uint64_t smfb_adjacency_words(uint64_t vertexCount, uint64_t faceCount) { return faceCount * 6 + vertexCount + 1; }
+
+// 16-bit indices halve the index buffer whenever every vertex is addressable.
+inline uint32_t smfb_index_size(size_t vertexCount) { return vertexCount <= 0x10000 ? 2 : 4; }
+
+inline uint64_t smfb_align(uint64_t offset) { return (offset + 15) & ~(uint64_t)15; }
+
+// Framing bounds of a point set, as cached in the header.
+struct MeshBounds {
+    glm::vec3 bmin = glm::vec3(0.0f), bmax = glm::vec3(0.0f);
+    glm::vec3 centroid = glm::vec3(0.0f); // mean of the vertices
+    float radius = 0.0f;                  // max distance from the centroid
+};
+
+inline MeshBounds compute_mesh_bounds(const Mesh& mesh) {
+    MeshBounds b;
+    const size_t n = mesh.vertexCount;
+    if (n == 0) return b;
+    // one component at a time, so every loop is a plain vectorizable reduction
+    const float* axes[3] = { mesh.px, mesh.py, mesh.pz };
+    for (int a = 0; a < 3; ++a) {
+        const float* v = axes[a];
+        float lo = v[0], hi = v[0], sum = 0.0f;
+        for (size_t i = 0; i < n; ++i) {
+            sum += v[i];
+            lo = std::min(lo, v[i]);
+            hi = std::max(hi, v[i]);
+        }
+        b.bmin[a] = lo;
+        b.bmax[a] = hi;
+        b.centroid[a] = sum / (float)n;
+    }
+    for (size_t i = 0; i < n; ++i) b.radius = std::max(b.radius, glm::length(mesh.position(i) - b.centroid));
+    return b;
+}
+
+// Points the mesh sections into a complete cache image; false if the image
+// is truncated, from another version, or internally inconsistent.
+inline bool smfb_attach(const char* data, size_t size, CachedMesh& mesh) {
+    if (size < sizeof(SmfbHeader)) return false;
+    const SmfbHeader* h = (const SmfbHeader*)data;
+    if (memcmp(h->magic, "SMFB", 4) != 0 || h->version != SMFB_VERSION || h->fileSize != size) return false;
+    if (h->indexSize != smfb_index_size(h->vertexCount)) return false;
+
+    if (h->lodCount == 0 || h->vertexOffset + (uint64_t)h->vertexCount * sizeof(SmfbVertex) > size ||
+        h->lodOffset + (uint64_t)h->lodCount * sizeof(SmfbLod) > size) return false;
+    const SmfbLod* lods = (const SmfbLod*)(data + h->lodOffset);
+    if (lods[0].firstIndex != 0 || lods[0].indexCount != (uint64_t)h->faceCount * 3) return false;
+    for (uint32_t l = 0; l < h->lodCount; ++l)
+        if (h->indexOffset + ((uint64_t)lods[l].firstIndex + lods[l].indexCount) * h->indexSize > size) return false;
+    bool adjacency = (h->flags & SMFB_FLAG_ADJACENCY) != 0;
+    if (adjacency && (h->adjacencyOffset == 0 ||
+        h->adjacencyOffset + smfb_adjacency_words(h->vertexCount, h->faceCount) * sizeof(uint32_t) > size)) return false;
+
+    mesh.header = h;
+    mesh.vertices = (const SmfbVertex*)(data + h->vertexOffset);
+    mesh.indices = data + h->indexOffset;
+    mesh.lods = lods;
+    mesh.adjacency = adjacency ? (const uint32_t*)(data + h->adjacencyOffset) : nullptr;
+    return true;
+}
+
+// Header and LOD table of the image of `mesh`; `lods` are the levels below
+// the full mesh, coarsest last. `adjacency` (of level 0) is optional.
+inline SmfbHeader smfb_layout(const Mesh& mesh, const MeshBounds& bounds, const std::vector<LodLevel>& lods,
+    const MeshAdjacency* adjacency, uint32_t lodRequested, const SmfSourceStamp& stamp, uint64_t sourceHash, uint32_t flags,
+    std::vector<SmfbLod>& table)
+{
+    SmfbHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "SMFB", 4);
+    h.version = SMFB_VERSION;
+    h.sourceSize = stamp.size;
+    h.sourceMtime = stamp.mtime;
+    h.sourceHash = sourceHash;
+    h.vertexCount = (uint32_t)mesh.vertexCount;
+    h.faceCount = (uint32_t)mesh.faceCount;
+    h.indexSize = smfb_index_size(mesh.vertexCount);
+    h.flags = flags;
+    h.lodCount = (uint32_t)lods.size() + 1;
+    h.lodRequested = lodRequested;
+
+    table.assign(h.lodCount, SmfbLod());
+    uint64_t corners = 0;
+    for (uint32_t l = 0; l < h.lodCount; ++l) {
+        size_t faces = l == 0 ? mesh.faceCount : lods[l - 1].faces.size();
+        table[l].firstIndex = (uint32_t)corners;
+        table[l].indexCount = (uint32_t)(faces * 3);
+        table[l].error = l == 0 ? 0.0f : lods[l - 1].error;
+        table[l].pad = 0;
+        corners += faces * 3;
+    }
+
+    h.vertexOffset = smfb_align(sizeof(SmfbHeader));
+    h.lodOffset = smfb_align(h.vertexOffset + mesh.vertexCount * sizeof(SmfbVertex));
+    h.indexOffset = smfb_align(h.lodOffset + table.size() * sizeof(SmfbLod));
+    h.fileSize = h.indexOffset + corners * h.indexSize;
+    if (adjacency) {
+        h.flags |= SMFB_FLAG_ADJACENCY;
+        h.adjacencyOffset = smfb_align(h.fileSize);
+        h.fileSize = h.adjacencyOffset + smfb_adjacency_words(mesh.vertexCount, mesh.faceCount) * sizeof(uint32_t);
+        h.boundaryEdges = adjacency->boundaryEdges;
+        h.nonManifoldEdges = adjacency->nonManifoldEdges;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        h.centroid[i] = bounds.centroid[i];
+        h.boundsMin[i] = bounds.bmin[i];
+        h.boundsMax[i] = bounds.bmax[i];
+    }
+    h.maxRadius = bounds.radius;
+    return h;
+}
+
+// Packs vertices [first, first + count) of the mesh (positions and the
+// normals from compute_vertex_normals) into `out`: a cache block, or a
+// mapped GL buffer directly.
+inline void smfb_pack_vertices(const Mesh& mesh, const glm::vec3& bmin, const glm::vec3& extent,
+    size_t first, size_t count, SmfbVertex* out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        size_t v = first + i;
+        quantize_position(mesh.position(v), bmin, extent, out[i].pos);
+        out[i].pad = 0;
+        oct_encode(mesh.normal(v), out[i].normal);
+    }
+}
+
+// Vertices / indices per emitted block: small enough to stay in cache.
+const size_t SMFB_EMIT_BLOCK = 4096;
+
+// Produces the image laid out by smfb_layout, front to back, through
+// write(const void* data, size_t size), which returns false to abort.
+template <typename Write>
+inline bool smfb_emit(const SmfbHeader& h, const std::vector<SmfbLod>& table, const Mesh& mesh,
+    const std::vector<LodLevel>& lods, const MeshAdjacency* adjacency, Write write)
+{
+    static const char zeros[16] = {};
+    uint64_t offset = 0;
+    auto pad_to = [&](uint64_t target) {
+        bool ok = write(zeros, (size_t)(target - offset));
+        offset = target;
+        return ok;
+    };
+    auto put = [&](const void* data, size_t size) {
+        offset += size;
+        return write(data, size);
+    };
+
+    if (!put(&h, sizeof(h)) || !pad_to(h.vertexOffset)) return false;
+    glm::vec3 bmin = glm::vec3(h.boundsMin[0], h.boundsMin[1], h.boundsMin[2]);
+    glm::vec3 extent = aabb_quantize_extent(bmin, glm::vec3(h.boundsMax[0], h.boundsMax[1], h.boundsMax[2]));
+    SmfbVertex vertices[SMFB_EMIT_BLOCK];
+    for (size_t v = 0; v < mesh.vertexCount; v += SMFB_EMIT_BLOCK) {
+        size_t count = std::min(SMFB_EMIT_BLOCK, mesh.vertexCount - v);
+        smfb_pack_vertices(mesh, bmin, extent, v, count, vertices);
+        if (!put(vertices, count * sizeof(SmfbVertex))) return false;
+    }
+
+    if (!pad_to(h.lodOffset) || !put(table.data(), table.size() * sizeof(SmfbLod)) || !pad_to(h.indexOffset))
+        return false;
+    uint32_t indices[SMFB_EMIT_BLOCK];
+    for (uint32_t l = 0; l < h.lodCount; ++l) {
+        const uint32_t* src = l == 0 ? mesh.indices : (const uint32_t*)lods[l - 1].faces.data();
+        size_t total = table[l].indexCount;
+        for (size_t i = 0; i < total; i += SMFB_EMIT_BLOCK) {
+            size_t count = std::min(SMFB_EMIT_BLOCK, total - i);
+            if (h.indexSize == 2) {
+                uint16_t* narrow = (uint16_t*)indices;
+                for (size_t k = 0; k < count; ++k) narrow[k] = (uint16_t)src[i + k];
+            }
+            else memcpy(indices, src + i, count * sizeof(uint32_t));
+            if (!put(indices, count * h.indexSize)) return false;
+        }
+    }
+    if (adjacency) {
+        if (!pad_to(h.adjacencyOffset)) return false;
+        for (const std::vector<uint32_t>* a : { &adjacency->opposite, &adjacency->vertexFirst, &adjacency->vertexCorners })
+            if (!put(a->data(), a->size() * sizeof(uint32_t))) return false;
+    }
+    return offset == h.fileSize;
+}
+
+// The whole image in memory (small meshes, or when the cache cannot be written).
+inline std::vector<char> smfb_build_image(const SmfbHeader& h, const std::vector<SmfbLod>& table, const Mesh& mesh,
+    const std::vector<LodLevel>& lods, const MeshAdjacency* adjacency)
+{
+    std::vector<char> image;
+    image.reserve((size_t)h.fileSize);
+    smfb_emit(h, table, mesh, lods, adjacency, [&](const void* data, size_t size) {
+        image.insert(image.end(), (const char*)data, (const char*)data + size);
+        return true;
+    });
+    return image;
+}
+
+// Streams the image to a temporary file first so a crash never leaves a
+// truncated cache.
+inline bool smfb_write(const std::string& path, const SmfbHeader& h, const std::vector<SmfbLod>& table,
+    const Mesh& mesh, const std::vector<LodLevel>& lods, const MeshAdjacency* adjacency)
+{
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = smfb_emit(h, table, mesh, lods, adjacency, [&](const void* data, size_t size) {
+        return fwrite(data, 1, size, f) == size;
+    });
+    ok = (fclose(f) == 0) && ok;
+    if (ok) {
+        std::remove(path.c_str()); // rename does not replace on Windows
+        ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+    if (!ok) std::remove(tmp.c_str());
+    return ok;
+}
+
+// Overwrites the source mtime recorded in an existing cache file, in place.
+// The file must not be mapped (Windows refuses the write while it is).
+inline bool smfb_restamp(const std::string& path, int64_t mtime) {
+    FILE* f = fopen(path.c_str(), "r+b");
+    if (!f) return false;
+    bool ok = fseek(f, offsetof(SmfbHeader, sourceMtime), SEEK_SET) == 0 &&
+        fwrite(&mtime, sizeof(mtime), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    return ok;
+}
+
+// --- cached loading ---
+struct MeshLoadOptions {
+    bool optimize = false; // reorder for the post-transform cache and vertex fetch
+    NormalWeighting normalWeighting = NORMAL_WEIGHT_UNIFORM;
+    unsigned lodLevels = 0; // coarser levels of detail to generate (0 = none)
+    bool adjacency = false; // build and cache the half-edge adjacency (mesh_adjacency.h)
+};
+
+// Cache probe: true when `mesh` now holds the up-to-date .smfb of `smfPath`
+// for these options. Quiet on a miss.
+inline bool load_mesh_cache(const std::string& smfPath, CachedMesh& mesh, const MeshLoadOptions& options) {
+    SmfSourceStamp stamp;
+    if (!smf_source_stamp(smfPath, stamp) || !mesh.mapped.open(smfb_cache_path(smfPath))) return false;
+    if (smfb_attach(mesh.mapped.data(), mesh.mapped.size(), mesh) &&
+        mesh.header->sourceSize == stamp.size &&
+        (!options.optimize || (mesh.header->flags & SMFB_FLAG_OPTIMIZED)) &&
+        (!options.adjacency || (mesh.header->flags & SMFB_FLAG_ADJACENCY)) &&
+        (mesh.header->flags & SMFB_WEIGHT_FLAGS) == smfb_weight_flags(options.normalWeighting) &&
+        mesh.header->lodRequested == options.lodLevels) {
+        if (mesh.header->sourceMtime == stamp.mtime) return true;
+        // touched (checkout, copy): still a hit if the content is the same
+        MappedFile source;
+        if (source.open(smfPath) && mesh.header->sourceHash == smfb_hash(source.data(), source.size())) {
+            // record the new mtime so the next load takes the fast path again
+            const std::string cachePath = smfb_cache_path(smfPath);
+            mesh.header = nullptr;
+            mesh.mapped.close();
+            if (!smfb_restamp(cachePath, stamp.mtime))
+                std::cerr << "Warning: could not update mesh cache " << cachePath << "\n";
+            return mesh.mapped.open(cachePath) && smfb_attach(mesh.mapped.data(), mesh.mapped.size(), mesh);
+        }
+    }
+    mesh.header = nullptr;
+    mesh.mapped.close();
+    return false;
+}
+
+// Cache miss: preprocesses the parsed mesh (consumed), writes the .smfb and
+// points `mesh` at the result, mapped back from the file. Failing to write
+// the cache is not an error; the image is kept in memory instead.
+inline bool build_mesh_cache(const std::string& smfPath, Mesh& source, CachedMesh& mesh, const MeshLoadOptions& options) {
+    SmfSourceStamp stamp;
+    uint64_t sourceHash;
+    {
+        MappedFile text;
+        if (!smf_source_stamp(smfPath, stamp) || !text.open(smfPath)) {
+            std::cerr << "Cannot open file: " << smfPath << "\n";
+            return false;
+        }
+        sourceHash = smfb_hash(text.data(), text.size());
+    }
+
+    uint32_t flags = smfb_weight_flags(options.normalWeighting);
+    std::vector<LodLevel> lods;
+    // built once, first: the optimizer and the simplifier read it, and it
+    // follows the optimized order into the cache
+    MeshAdjacency adjacency;
+    if (options.optimize || options.lodLevels) {
+        // these passes work on AoS vectors; the arena is given back while
+        // they run and refilled with their result
+        std::vector<glm::vec3> positions = mesh_positions(source);
+        std::vector<glm::uvec3> faces = mesh_faces(source);
+        source.release();
+        adjacency = build_mesh_adjacency(faces.data(), faces.size(), positions.size());
+        if (options.optimize) {
+            VertexCacheStats before, after;
+            optimize_mesh(positions, faces, &before, &after, &adjacency);
+            std::cerr << "Vertex cache optimization: ACMR " << before.acmr << " -> " << after.acmr
+                << ", ATVR " << before.atvr << " -> " << after.atvr << "\n";
+            flags |= SMFB_FLAG_OPTIMIZED;
+        }
+
+        AdjacencyView view = adjacency.view();
+        lods = build_lod_chain(positions, faces, options.lodLevels, 64, nullptr, &view);
+        if (options.lodLevels) {
+            std::cerr << "LOD chain: " << faces.size();
+            for (auto& l : lods) std::cerr << " -> " << l.faces.size();
+            std::cerr << " triangles\n";
+        }
+        if (options.optimize)
+            for (auto& l : lods) optimize_triangle_order(positions, l.faces);
+        if (!options.adjacency) adjacency = MeshAdjacency(); // not stored: give it back before the refill
+        if (!source.allocate(positions.size(), faces.size())) {
+            std::cerr << "Out of memory preprocessing " << smfPath << "\n";
+            return false;
+        }
+        mesh_assign(source, positions, faces);
+    }
+
+    compute_vertex_normals(source, options.normalWeighting);
+    if (options.adjacency) {
+        if (adjacency.vertexFirst.empty())
+            adjacency = build_mesh_adjacency(source.faces(), source.faceCount, source.vertexCount);
+        std::cerr << "Adjacency: " << adjacency.boundaryEdges << " boundary edges, " << adjacency.nonManifoldEdges
+            << " non-manifold edges\n";
+    }
+    const MeshAdjacency* stored = options.adjacency ? &adjacency : nullptr;
+    std::vector<SmfbLod> table;
+    SmfbHeader h = smfb_layout(source, compute_mesh_bounds(source), lods, stored, options.lodLevels, stamp, sourceHash,
+        flags, table);
+
+    const std::string cachePath = smfb_cache_path(smfPath);
+    if (smfb_write(cachePath, h, table, source, lods, stored)) {
+        source.release();
+        if (mesh.mapped.open(cachePath) && smfb_attach(mesh.mapped.data(), mesh.mapped.size(), mesh)) return true;
+        std::cerr << "Cannot read back mesh cache " << cachePath << "\n";
+        return false;
+    }
+    std::cerr << "Warning: could not write mesh cache " << cachePath << "\n";
+    mesh.image = smfb_build_image(h, table, source, lods, stored);
+    source.release();
+    return smfb_attach(mesh.image.data(), mesh.image.size(), mesh);
+}
+
+// Loads `smfPath` through its .smfb cache, rebuilding the cache when it is
+// missing or stale (or unoptimized when optimization is requested, or built
+// with a different normal weighting or LOD count).
+inline bool load_cached_mesh(const std::string& smfPath, CachedMesh& mesh,
+    const MeshLoadOptions& options = MeshLoadOptions())
+{
+    if (load_mesh_cache(smfPath, mesh, options)) return true;
+
+    Mesh source;
+    if (!load_smf(smfPath, source)) return false;
+    return build_mesh_cache(smfPath, source, mesh, options);
+}
+
+// Stand-in while the real mesh loads: its bounding box as a 12-triangle
+// mesh. The header keeps the real centroid and radius, so the layout does
+// not move when the mesh is swapped in.
+inline bool make_bounds_mesh(const MeshBounds& b, CachedMesh& mesh) {
+    // two outward-facing triangles per side
+    static const uint32_t quads[6][4] = {
+        { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 2, 3, 1 }, { 4, 5, 7, 6 },
+    };
+    Mesh box;
+    if (!box.allocate(8, 12)) {
+        std::cerr << "Out of memory for a placeholder box\n";
+        return false;
+    }
+    for (int i = 0; i < 8; ++i)
+        box.set_position(i, glm::vec3(i & 1 ? b.bmax.x : b.bmin.x, i & 2 ? b.bmax.y : b.bmin.y, i & 4 ? b.bmax.z : b.bmin.z));
+    for (int q = 0; q < 6; ++q) {
+        box.faces()[q * 2] = glm::uvec3(quads[q][0], quads[q][1], quads[q][2]);
+        box.faces()[q * 2 + 1] = glm::uvec3(quads[q][0], quads[q][2], quads[q][3]);
+    }
+    compute_vertex_normals(box);
+    // the header keeps the real centroid and radius
+    MeshBounds framing = compute_mesh_bounds(box);
+    framing.centroid = b.centroid;
+    framing.radius = b.radius;
+    std::vector<SmfbLod> table;
+    SmfbHeader h = smfb_layout(box, framing, std::vector<LodLevel>(), nullptr, 0, SmfSourceStamp(), 0, 0, table);
+    mesh.image = smfb_build_image(h, table, box, std::vector<LodLevel>(), nullptr);
+    return smfb_attach(mesh.image.data(), mesh.image.size(), mesh);
+}
@@ -0,0 +1,198 @@
+// mesh_normals.h
+// Face and per-vertex normals for an indexed triangle mesh.
+//
+// Face normals are computed four triangles at a time with SSE from SoA
+// position arrays. Vertex normals are accumulated in parallel without
+// atomics: every owner thread gets a contiguous vertex range and walks all
+// faces, summing the ones that touch its range in face order. The result is
+// therefore the same for any thread count, and the only memory is the
+// mesh's own normal arrays (mesh.h).
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_NORMALS_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include "mesh.h"
+#include "parallel.h"
+
+enum NormalWeighting {
+    NORMAL_WEIGHT_UNIFORM, // every adjacent face counts the same
+    NORMAL_WEIGHT_AREA,    // by face area
+    NORMAL_WEIGHT_ANGLE,   // by the face's corner angle at the vertex
+};
+
+struct SoaPositions {
+    std::vector<float> x, y, z;
+};
+
+// faces per parallel task
+const size_t NORMALS_BLOCK = 1u << 16;
+
+inline SoaPositions to_soa(const std::vector<glm::vec3>& positions) {
+    SoaPositions soa;
+    soa.x.resize(positions.size());
+    soa.y.resize(positions.size());
+    soa.z.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        soa.x[i] = positions[i].x;
+        soa.y[i] = positions[i].y;
+        soa.z[i] = positions[i].z;
+    }
+    return soa;
+}
+
+// Cross product of the edges of faces[0, count). Unnormalized, its length is
+// twice the triangle area; normalized, degenerate faces come out as zero.
+inline void face_normals_soa(const SoaPositions& p, const glm::uvec3* faces, size_t count,
+    float* nx, float* ny, float* nz, bool normalize)
+{
+    const float* X = p.x.data();
+    const float* Y = p.y.data();
+    const float* Z = p.z.data();
+    size_t i = 0;
+#ifdef MESH_NORMALS_SSE
+    for (; i + 4 <= count; i += 4) {
+        const glm::uvec3* f = faces + i;
+        // the index gather is scalar; the arithmetic runs on four faces at once
+#define GATHER(A, c) _mm_setr_ps(A[f[0].c], A[f[1].c], A[f[2].c], A[f[3].c])
+        __m128 x0 = GATHER(X, x), y0 = GATHER(Y, x), z0 = GATHER(Z, x);
+        __m128 ax = _mm_sub_ps(GATHER(X, y), x0), ay = _mm_sub_ps(GATHER(Y, y), y0), az = _mm_sub_ps(GATHER(Z, y), z0);
+        __m128 bx = _mm_sub_ps(GATHER(X, z), x0), by = _mm_sub_ps(GATHER(Y, z), y0), bz = _mm_sub_ps(GATHER(Z, z), z0);
+#undef GATHER
+        __m128 cx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+        __m128 cy = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+        __m128 cz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+        if (normalize) {
+            __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz));
+            __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len2));
+            inv = _mm_and_ps(inv, _mm_cmpgt_ps(len2, _mm_setzero_ps()));
+            cx = _mm_mul_ps(cx, inv); cy = _mm_mul_ps(cy, inv); cz = _mm_mul_ps(cz, inv);
+        }
+        _mm_storeu_ps(nx + i, cx);
+        _mm_storeu_ps(ny + i, cy);
+        _mm_storeu_ps(nz + i, cz);
+    }
+#endif
+    for (; i < count; ++i) {
+        const glm::uvec3& f = faces[i];
+        float ax = X[f.y] - X[f.x], ay = Y[f.y] - Y[f.x], az = Z[f.y] - Z[f.x];
+        float bx = X[f.z] - X[f.x], by = Y[f.z] - Y[f.x], bz = Z[f.z] - Z[f.x];
+        float cx = ay * bz - az * by, cy = az * bx - ax * bz, cz = ax * by - ay * bx;
+        if (normalize) {
+            float len2 = cx * cx + cy * cy + cz * cz;
+            float inv = len2 > 0.0f ? 1.0f / std::sqrt(len2) : 0.0f;
+            cx *= inv; cy *= inv; cz *= inv;
+        }
+        nx[i] = cx; ny[i] = cy; nz[i] = cz;
+    }
+}
+
+// Interior angle of corner k of face f.
+inline float corner_angle(const Mesh& mesh, const glm::uvec3& f, int k) {
+    glm::vec3 p = mesh.position(f[k]);
+    glm::vec3 a = mesh.position(f[(k + 1) % 3]) - p;
+    glm::vec3 b = mesh.position(f[(k + 2) % 3]) - p;
+    float la = glm::length(a), lb = glm::length(b);
+    float c = (la > 0.0f && lb > 0.0f) ? glm::dot(a, b) / (la * lb) : 1.0f;
+    return std::acos(std::min(1.0f, std::max(-1.0f, c)));
+}
+
+inline glm::vec3 face_normal(const std::vector<glm::vec3>& positions, const glm::uvec3& f) {
+    glm::vec3 p0 = positions[f.x], p1 = positions[f.y], p2 = positions[f.z];
+    return glm::normalize(glm::cross(p1 - p0, p2 - p0));
+}
+
+inline std::vector<glm::vec3> compute_face_normals(const std::vector<glm::vec3>& positions,
+    const std::vector<glm::uvec3>& faces)
+{
+    SoaPositions soa = to_soa(positions);
+    std::vector<float> nx(faces.size()), ny(faces.size()), nz(faces.size());
+    size_t blocks = (faces.size() + NORMALS_BLOCK - 1) / NORMALS_BLOCK;
+    thread_pool().parallel_for(blocks, [&](size_t b) {
+        size_t begin = b * NORMALS_BLOCK;
+        size_t count = std::min(NORMALS_BLOCK, faces.size() - begin);
+        face_normals_soa(soa, faces.data() + begin, count, &nx[begin], &ny[begin], &nz[begin], true);
+    });
+
+    std::vector<glm::vec3> faceNormals(faces.size());
+    for (size_t i = 0; i < faces.size(); ++i) faceNormals[i] = glm::vec3(nx[i], ny[i], nz[i]);
+    return faceNormals;
+}
+
+// Per-vertex normals into mesh.nx / ny / nz: normalized, weighted sum of
+// the normals of the faces around each vertex. Unreferenced vertices get a
+// zero normal.
+inline void compute_vertex_normals(Mesh& mesh, NormalWeighting weighting = NORMAL_WEIGHT_UNIFORM) {
+    const size_t vertexCount = mesh.vertexCount;
+    const size_t faceCount = mesh.faceCount;
+    const float* X = mesh.px;
+    const float* Y = mesh.py;
+    const float* Z = mesh.pz;
+    const glm::uvec3* faces = mesh.faces();
+    ThreadPool& pool = thread_pool();
+
+    // every owner reads all indices, so only split when the ranges are large
+    size_t owners = std::max<size_t>(1, std::min<size_t>(pool.size(), vertexCount / (NORMALS_BLOCK / 4)));
+    pool.parallel_for(owners, [&](size_t o) {
+        const uint32_t begin = (uint32_t)(vertexCount * o / owners);
+        const uint32_t span = (uint32_t)(vertexCount * (o + 1) / owners) - begin;
+        float* NX = mesh.nx;
+        float* NY = mesh.ny;
+        float* NZ = mesh.nz;
+        std::fill(NX + begin, NX + begin + span, 0.0f);
+        std::fill(NY + begin, NY + begin + span, 0.0f);
+        std::fill(NZ + begin, NZ + begin + span, 0.0f);
+        for (size_t i = 0; i < faceCount; ++i) {
+            const glm::uvec3& f = faces[i];
+            // unsigned wrap-around: one compare per corner for begin <= v < end
+            bool owned[3] = { f.x - begin < span, f.y - begin < span, f.z - begin < span };
+            if (!(owned[0] || owned[1] || owned[2])) continue;
+
+            // as face_normals_soa; area weighting keeps the normal unnormalized
+            float ax = X[f.y] - X[f.x], ay = Y[f.y] - Y[f.x], az = Z[f.y] - Z[f.x];
+            float bx = X[f.z] - X[f.x], by = Y[f.z] - Y[f.x], bz = Z[f.z] - Z[f.x];
+            float cx = ay * bz - az * by, cy = az * bx - ax * bz, cz = ax * by - ay * bx;
+            if (weighting != NORMAL_WEIGHT_AREA) {
+                float len2 = cx * cx + cy * cy + cz * cz;
+                float inv = len2 > 0.0f ? 1.0f / std::sqrt(len2) : 0.0f;
+                cx *= inv; cy *= inv; cz *= inv;
+            }
+            for (int k = 0; k < 3; ++k) {
+                if (!owned[k]) continue;
+                float w = weighting == NORMAL_WEIGHT_ANGLE ? corner_angle(mesh, f, k) : 1.0f;
+                NX[f[k]] += w * cx;
+                NY[f[k]] += w * cy;
+                NZ[f[k]] += w * cz;
+            }
+        }
+        for (uint32_t v = begin; v < begin + span; ++v) {
+            float len2 = NX[v] * NX[v] + NY[v] * NY[v] + NZ[v] * NZ[v];
+            if (len2 > 0.0f) {
+                float len = std::sqrt(len2);
+                NX[v] /= len; NY[v] /= len; NZ[v] /= len;
+            }
+        }
+    });
+}
+
+inline std::vector<glm::vec3> compute_vertex_normals(const std::vector<glm::vec3>& positions,
+    const std::vector<glm::uvec3>& faces, NormalWeighting weighting = NORMAL_WEIGHT_UNIFORM)
+{
+    Mesh mesh;
+    mesh.allocate(positions.size(), faces.size());
+    mesh_assign(mesh, positions, faces);
+    compute_vertex_normals(mesh, weighting);
+    std::vector<glm::vec3> normals(positions.size());
+    for (size_t v = 0; v < positions.size(); ++v) normals[v] = mesh.normal(v);
+    return normals;
+}
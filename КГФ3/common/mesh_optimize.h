@@ -0,0 +1,211 @@
+// mesh_optimize.h
+// Post-transform vertex cache and vertex fetch optimization.
+//
+// Triangles are reordered with Tipsify (Sander, Nehab, Barczak 2007), the
+// resulting clusters are sorted outside-in to reduce overdraw, and vertices
+// are then renumbered in order of first use so fetches walk memory linearly.
+// Tipsify walks the vertex fans of the mesh adjacency (mesh_adjacency.h).
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "mesh_adjacency.h"
+
+// FIFO cache size the orderings are tuned for; typical of current GPUs.
+const unsigned VCACHE_SIZE = 16;
+
+struct VertexCacheStats {
+    float acmr = 0.0f; // average cache misses per triangle (0.5 ideal, 3 worst)
+    float atvr = 0.0f; // average transforms per vertex (1.0 ideal)
+};
+
+// Simulates a FIFO post-transform cache over the triangle list.
+inline VertexCacheStats vertex_cache_stats(const std::vector<glm::uvec3>& faces, size_t vertexCount,
+    unsigned cacheSize = VCACHE_SIZE)
+{
+    std::vector<uint32_t> stamp(vertexCount, 0); // time the vertex entered the cache
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    for (const auto& f : faces) {
+        for (int k = 0; k < 3; ++k) {
+            if (time - stamp[f[k]] > cacheSize) {
+                stamp[f[k]] = time++;
+                ++misses;
+            }
+        }
+    }
+
+    size_t used = 0;
+    for (uint32_t s : stamp) used += (s != 0);
+    VertexCacheStats stats;
+    if (!faces.empty()) stats.acmr = (float)misses / (float)faces.size();
+    if (used) stats.atvr = (float)misses / (float)used;
+    return stats;
+}
+
+// Tipsify triangle order. Returns the new order as indices into `faces`, and
+// the start of every cluster (a point where the fan hit a dead end) in
+// `clusterStarts`. `adjacency` is that of `faces`.
+inline std::vector<uint32_t> tipsify_order(const std::vector<glm::uvec3>& faces, size_t vertexCount,
+    unsigned cacheSize, std::vector<uint32_t>& clusterStarts, const AdjacencyView& adjacency)
+{
+    std::vector<uint32_t> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) live[v] = adjacency.face_count((uint32_t)v);
+
+    std::vector<uint32_t> stamp(vertexCount, 0);
+    std::vector<char> emitted(faces.size(), 0);
+    std::vector<uint32_t> deadEnd; // recently used vertices, most recent last
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> order;
+    order.reserve(faces.size());
+    clusterStarts.clear();
+
+    uint32_t time = cacheSize + 1;
+    size_t cursor = 0;
+    long long fan = vertexCount ? 0 : -1;
+    bool restarted = true;
+
+    while (fan >= 0) {
+        if (restarted) clusterStarts.push_back((uint32_t)order.size());
+        candidates.clear();
+        for (const uint32_t* c = adjacency.corners_begin((uint32_t)fan); c != adjacency.corners_end((uint32_t)fan); ++c) {
+            uint32_t t = AdjacencyView::face(*c);
+            if (emitted[t]) continue;
+            emitted[t] = 1;
+            order.push_back(t);
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = faces[t][k];
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - stamp[v] > cacheSize) stamp[v] = time++;
+            }
+        }
+
+        // next fan: the oldest candidate that stays in the cache while its
+        // remaining triangles are emitted. Any live candidate beats none,
+        // even at priority 0 (no longer cached); only none is a dead end
+        long long best = -1;
+        long long bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) continue;
+            long long priority = 0;
+            if (time - stamp[v] + 2 * live[v] <= cacheSize) priority = time - stamp[v];
+            if (priority > bestPriority) { best = v; bestPriority = priority; }
+        }
+
+        // dead end: restart from a recently used vertex, or scan for any live
+        // one. Either way the fan sequence breaks, which starts a new cluster.
+        restarted = best < 0;
+        while (best < 0 && !deadEnd.empty()) {
+            uint32_t d = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[d] > 0) best = d;
+        }
+        if (best < 0) {
+            while (cursor < vertexCount && live[cursor] == 0) ++cursor;
+            if (cursor < vertexCount) best = (long long)cursor;
+        }
+        fan = best;
+    }
+    return order;
+}
+
+// Sorts the Tipsify clusters so that triangles facing away from the mesh
+// center (likely front-most from any direction) are drawn first.
+inline void sort_clusters_outside_in(const std::vector<glm::vec3>& positions,
+    const std::vector<glm::uvec3>& faces,
+    std::vector<uint32_t>& order, const std::vector<uint32_t>& clusterStarts)
+{
+    glm::vec3 center(0.0f);
+    for (auto& p : positions) center += p;
+    if (!positions.empty()) center /= (float)positions.size();
+
+    struct Cluster { uint32_t begin, end; float key; };
+    std::vector<Cluster> clusters;
+    for (size_t c = 0; c < clusterStarts.size(); ++c) {
+        uint32_t begin = clusterStarts[c];
+        uint32_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : (uint32_t)order.size();
+        if (begin == end) continue;
+
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        for (uint32_t i = begin; i < end; ++i) {
+            const glm::uvec3& f = faces[order[i]];
+            glm::vec3 p0 = positions[f.x], p1 = positions[f.y], p2 = positions[f.z];
+            centroid += (p0 + p1 + p2) / 3.0f;
+            normal += glm::cross(p1 - p0, p2 - p0); // area weighted
+        }
+        centroid /= (float)(end - begin);
+        clusters.push_back({ begin, end, glm::dot(centroid - center, normal) });
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(),
+        [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(order.size());
+    for (auto& c : clusters) sorted.insert(sorted.end(), order.begin() + c.begin, order.begin() + c.end);
+    order.swap(sorted);
+}
+
+// Renumbers vertices in order of first use; unreferenced vertices go last.
+// Returns the renumbering (old -> new).
+inline std::vector<uint32_t> reorder_vertices_for_fetch(std::vector<glm::vec3>& positions, std::vector<glm::uvec3>& faces) {
+    const uint32_t unused = 0xFFFFFFFFu;
+    std::vector<uint32_t> remap(positions.size(), unused);
+    uint32_t next = 0;
+    for (auto& f : faces)
+        for (int k = 0; k < 3; ++k) {
+            if (remap[f[k]] == unused) remap[f[k]] = next++;
+            f[k] = remap[f[k]];
+        }
+    for (auto& r : remap)
+        if (r == unused) r = next++;
+
+    std::vector<glm::vec3> reordered(positions.size());
+    for (size_t v = 0; v < positions.size(); ++v) reordered[remap[v]] = positions[v];
+    positions.swap(reordered);
+    return remap;
+}
+
+// Cache-optimized, overdraw-aware triangle order; vertices stay where they
+// are. `adjacency`: that of `faces`, built here when null. Returns the order
+// (old face index of each new face).
+inline std::vector<uint32_t> optimize_triangle_order(const std::vector<glm::vec3>& positions,
+    std::vector<glm::uvec3>& faces, const AdjacencyView* adjacency = nullptr)
+{
+    MeshAdjacency built;
+    if (!adjacency) built = build_mesh_adjacency(faces.data(), faces.size(), positions.size());
+    std::vector<uint32_t> clusterStarts;
+    std::vector<uint32_t> order = tipsify_order(faces, positions.size(), VCACHE_SIZE, clusterStarts,
+        adjacency ? *adjacency : built.view());
+    sort_clusters_outside_in(positions, faces, order, clusterStarts);
+
+    std::vector<glm::uvec3> reordered(faces.size());
+    for (size_t i = 0; i < order.size(); ++i) reordered[i] = faces[order[i]];
+    faces.swap(reordered);
+    return order;
+}
+
+// Full pass: cache-optimized triangle order, overdraw-aware cluster order,
+// then linear vertex order. Reports cache statistics for both orderings.
+// `adjacency` (optional, that of the input faces) is used for the ordering
+// and remapped to the result.
+inline void optimize_mesh(std::vector<glm::vec3>& positions, std::vector<glm::uvec3>& faces,
+    VertexCacheStats* before = nullptr, VertexCacheStats* after = nullptr, MeshAdjacency* adjacency = nullptr)
+{
+    if (before) *before = vertex_cache_stats(faces, positions.size());
+
+    AdjacencyView view;
+    if (adjacency) view = adjacency->view();
+    std::vector<uint32_t> order = optimize_triangle_order(positions, faces, adjacency ? &view : nullptr);
+    std::vector<uint32_t> remap = reorder_vertices_for_fetch(positions, faces);
+    if (adjacency) remap_mesh_adjacency(*adjacency, order, remap);
+
+    if (after) *after = vertex_cache_stats(faces, positions.size());
+}
@@ -0,0 +1,503 @@
+// mesh_pages.h
+// Paged mesh files (.smfp) for meshes too big for memory, and the out-of-core
+// preprocessor that writes them.
+//
+// The mesh is cut into spatially coherent pages of up to a few thousand
+// triangles. Each page carries its own bounding sphere and LOD chain and is
+// stored as one contiguous blob, so a viewer can cull, stream and evict
+// pages independently (paged_mesh.h):
+//   SmfpHeader                     global bounds, page count, largest page
+//   page blobs                     SmfbVertex[vertexCount] (quantized to the
+//                                  global AABB, see vertex_pack.h), then the
+//                                  16-bit local indices of every level
+//   SmfpPage[pageCount]            bounds, blob offset and LOD table per page
+//
+// build_paged_mesh never holds the mesh in RAM: the parsed positions, faces
+// and normals go to scratch files mapped with ScratchMappedFile, which the
+// OS pages out as needed. In memory it keeps a fixed-size face histogram,
+// the page table and one batch of pages while the batch is being built.
+//
+// Clustering: face centroids are binned into a SMFP_GRID^3 grid over the
+// AABB. An octree over the grid splits every node holding more than the
+// page budget, so pages follow the surface and are numbered in octree
+// order; a single cell still over budget is cut into consecutive pages.
+// Vertices on a page border are pinned while the page is simplified, so
+// neighbouring pages at different levels still meet without cracks.
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "mesh_normals.h"
+#include "mesh_simplify.h"
+#include "parallel.h"
+#include "smf_loader.h"
+#include "vertex_pack.h"
+
+const uint32_t SMFP_VERSION = 1;
+const uint32_t SMFP_MAX_LODS = 8;      // per page, level 0 included
+const uint32_t SMFP_PAGE_FACES = 4096; // default page budget
+const uint32_t SMFP_GRID = 64;         // clustering cells per axis
+
+struct SmfpHeader {
+    char magic[4];            // "SMFP"
+    uint32_t version;
+    uint64_t fileSize;
+    uint64_t vertexCount;     // of the source mesh
+    uint64_t faceCount;
+    uint32_t pageCount;
+    uint32_t flags;           // SMFB_FLAG_* normal weighting
+    uint32_t maxPageVertices; // the largest page: GPU pool slot sizes
+    uint32_t maxPageIndices;  // all levels together
+    float centroid[3];
+    float maxRadius;
+    float boundsMin[3];
+    float boundsMax[3];       // quantization box shared by every page
+    uint64_t pageTableOffset;
+};
+
+struct SmfpPage {
+    float center[3];
+    float radius;             // bounding sphere in object space
+    uint64_t offset;          // of the blob
+    uint32_t size;            // blob bytes
+    uint32_t vertexCount;
+    uint32_t lodCount;        // 1..SMFP_MAX_LODS
+    uint32_t pad;
+    SmfbLod lods[SMFP_MAX_LODS]; // index ranges within the page's indices
+};
+
+static_assert(sizeof(SmfpHeader) == 96 && sizeof(SmfpPage) == 168, "unexpected .smfp padding");
+
+// An opened .smfp; the page blobs stay in the mapping until read.
+struct PagedMeshFile {
+    const SmfpHeader* header = nullptr;
+    const SmfpPage* pages = nullptr;
+
+    size_t pageCount() const { return header ? header->pageCount : 0; }
+    const SmfpPage& page(size_t i) const { return pages[i]; }
+    const char* page_data(size_t i) const { return mapped.data() + pages[i].offset; }
+    glm::vec3 centroid() const { return glm::vec3(header->centroid[0], header->centroid[1], header->centroid[2]); }
+    float maxRadius() const { return header->maxRadius; }
+    glm::vec3 boundsMin() const { return glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]); }
+    glm::vec3 quantizeExtent() const {
+        return aabb_quantize_extent(boundsMin(),
+            glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]));
+    }
+    glm::mat4 dequantizeMatrix() const { return aabb_dequantize_matrix(boundsMin(), quantizeExtent()); }
+
+    MappedFile mapped;
+};
+
+// Maps and validates a .smfp; false (with a message) if it is not one.
+inline bool open_paged_mesh(const std::string& path, PagedMeshFile& file) {
+    if (!file.mapped.open(path)) {
+        std::cerr << "Cannot open file: " << path << "\n";
+        return false;
+    }
+    const char* data = file.mapped.data();
+    size_t size = file.mapped.size();
+    const SmfpHeader* h = (const SmfpHeader*)data;
+    bool ok = size >= sizeof(SmfpHeader) && memcmp(h->magic, "SMFP", 4) == 0 && h->version == SMFP_VERSION
+        && h->fileSize == size && h->pageTableOffset + (uint64_t)h->pageCount * sizeof(SmfpPage) <= size;
+    const SmfpPage* pages = ok ? (const SmfpPage*)(data + h->pageTableOffset) : nullptr;
+    for (uint32_t i = 0; ok && i < h->pageCount; ++i) {
+        const SmfpPage& p = pages[i];
+        uint64_t vertexBytes = (uint64_t)p.vertexCount * sizeof(SmfbVertex);
+        ok = p.lodCount >= 1 && p.lodCount <= SMFP_MAX_LODS && p.offset + p.size <= size
+            && p.vertexCount <= h->maxPageVertices && vertexBytes <= p.size;
+        const SmfbLod& last = ok ? p.lods[p.lodCount - 1] : p.lods[0];
+        ok = ok && last.firstIndex + last.indexCount <= h->maxPageIndices
+            && vertexBytes + (uint64_t)(last.firstIndex + last.indexCount) * 2 <= p.size;
+    }
+    if (!ok) {
+        std::cerr << "Not a valid paged mesh (version " << SMFP_VERSION << "): " << path << "\n";
+        file.mapped.close();
+        return false;
+    }
+    file.header = h;
+    file.pages = pages;
+    return true;
+}
+
+// --- out-of-core builder ---
+struct PageBuildOptions {
+    NormalWeighting normalWeighting = NORMAL_WEIGHT_UNIFORM;
+    unsigned lodLevels = 3;                // coarser levels per page
+    uint32_t pageFaces = SMFP_PAGE_FACES;  // clamped so a page always fits 16-bit indices
+};
+
+const uint32_t SMFP_VERTEX_SHARED = 0xFFFFFFFFu; // referenced by more than one page
+const uint32_t SMFP_VERTEX_UNUSED = 0xFFFFFFFEu;
+
+// The clustering grid over the mesh AABB.
+struct PageGrid {
+    glm::vec3 origin, cellScale; // cell = (p - origin) * cellScale
+
+    uint32_t cell(const glm::vec3& p) const {
+        uint32_t c[3];
+        for (int k = 0; k < 3; ++k)
+            c[k] = (uint32_t)std::min<float>((float)(SMFP_GRID - 1), std::max(0.0f, (p[k] - origin[k]) * cellScale[k]));
+        return (c[2] * SMFP_GRID + c[1]) * SMFP_GRID + c[0];
+    }
+    uint32_t face_cell(const glm::vec3* positions, const glm::uvec3& f) const {
+        return cell((positions[f.x] + positions[f.y] + positions[f.z]) * (1.0f / 3.0f));
+    }
+};
+
+// Splits octree nodes over budget. `sums` is the inclusive 3D prefix sum of
+// the per-cell face counts ((SMFP_GRID + 1)^3, zero-padded at 0), so any box
+// count is eight lookups. Leaves become pages in visiting order.
+struct PageOctree {
+    const std::vector<uint64_t>& sums;
+    uint32_t budget;
+    std::vector<uint32_t>& cellPage;       // first page of each cell
+    std::vector<uint32_t>& pageFaceCount;
+
+    uint64_t at(uint32_t x, uint32_t y, uint32_t z) const {
+        const uint32_t n = SMFP_GRID + 1;
+        return sums[((size_t)z * n + y) * n + x];
+    }
+    uint64_t count(const uint32_t lo[3], const uint32_t hi[3]) const {
+        return at(hi[0], hi[1], hi[2]) - at(lo[0], hi[1], hi[2]) - at(hi[0], lo[1], hi[2]) - at(hi[0], hi[1], lo[2])
+            + at(lo[0], lo[1], hi[2]) + at(lo[0], hi[1], lo[2]) + at(hi[0], lo[1], lo[2]) - at(lo[0], lo[1], lo[2]);
+    }
+
+    void split(const uint32_t lo[3], const uint32_t hi[3]) {
+        uint64_t n = count(lo, hi);
+        if (n == 0) return;
+        bool single = hi[0] - lo[0] == 1 && hi[1] - lo[1] == 1 && hi[2] - lo[2] == 1;
+        if (n <= budget || single) {
+            uint32_t first = (uint32_t)pageFaceCount.size();
+            for (uint32_t z = lo[2]; z < hi[2]; ++z)
+                for (uint32_t y = lo[1]; y < hi[1]; ++y)
+                    for (uint32_t x = lo[0]; x < hi[0]; ++x) cellPage[(z * SMFP_GRID + y) * SMFP_GRID + x] = first;
+            // an oversized single cell continues over consecutive pages
+            for (uint64_t left = n; left > 0; left -= std::min<uint64_t>(left, budget))
+                pageFaceCount.push_back((uint32_t)std::min<uint64_t>(left, budget));
+            return;
+        }
+        uint32_t mid[3];
+        for (int k = 0; k < 3; ++k) mid[k] = hi[k] - lo[k] > 1 ? (lo[k] + hi[k]) / 2 : hi[k];
+        for (int c = 0; c < 8; ++c) {
+            uint32_t clo[3], chi[3];
+            bool empty = false;
+            for (int k = 0; k < 3; ++k) {
+                bool upper = (c >> k) & 1;
+                clo[k] = upper ? mid[k] : lo[k];
+                chi[k] = upper ? hi[k] : mid[k];
+                empty = empty || clo[k] >= chi[k];
+            }
+            if (!empty) split(clo, chi);
+        }
+    }
+};
+
+// One finished page: table entry plus blob.
+struct BuiltPage {
+    SmfpPage entry;
+    std::vector<char> blob;
+};
+
+// Builds one page from its `count` bucketed faces (global vertex indices).
+inline BuiltPage build_page(const glm::uvec3* faces, size_t count, const glm::vec3* positions, const glm::vec3* normals,
+    const uint32_t* owner, const glm::vec3& bmin, const glm::vec3& extent, unsigned lodLevels)
+{
+    // global -> local vertex numbering, in sorted order
+    std::vector<uint32_t> globals;
+    globals.reserve(count * 3);
+    for (size_t i = 0; i < count; ++i)
+        for (int k = 0; k < 3; ++k) globals.push_back(faces[i][k]);
+    std::sort(globals.begin(), globals.end());
+    globals.erase(std::unique(globals.begin(), globals.end()), globals.end());
+    auto local = [&](uint32_t g) { return (uint32_t)(std::lower_bound(globals.begin(), globals.end(), g) - globals.begin()); };
+
+    std::vector<glm::vec3> localPositions(globals.size());
+    std::vector<char> pinned(globals.size());
+    for (size_t v = 0; v < globals.size(); ++v) {
+        localPositions[v] = positions[globals[v]];
+        pinned[v] = owner[globals[v]] == SMFP_VERTEX_SHARED;
+    }
+    std::vector<glm::uvec3> localFaces(count);
+    for (size_t i = 0; i < count; ++i) localFaces[i] = glm::uvec3(local(faces[i].x), local(faces[i].y), local(faces[i].z));
+    std::vector<LodLevel> lods = build_lod_chain(localPositions, localFaces,
+        std::min(lodLevels, SMFP_MAX_LODS - 1), 16, &pinned);
+
+    BuiltPage page;
+    SmfpPage& e = page.entry;
+    memset(&e, 0, sizeof(e));
+    e.vertexCount = (uint32_t)globals.size();
+    e.lodCount = (uint32_t)lods.size() + 1;
+    uint32_t corners = 0;
+    for (uint32_t l = 0; l < e.lodCount; ++l) {
+        const std::vector<glm::uvec3>& lf = l == 0 ? localFaces : lods[l - 1].faces;
+        e.lods[l].firstIndex = corners;
+        e.lods[l].indexCount = (uint32_t)lf.size() * 3;
+        e.lods[l].error = l == 0 ? 0.0f : lods[l - 1].error;
+        corners += e.lods[l].indexCount;
+    }
+
+    glm::vec3 lo = localPositions[0], hi = localPositions[0];
+    for (auto& p : localPositions) { lo = glm::min(lo, p); hi = glm::max(hi, p); }
+    glm::vec3 center = (lo + hi) * 0.5f;
+    for (auto& p : localPositions) e.radius = std::max(e.radius, glm::length(p - center));
+    for (int k = 0; k < 3; ++k) e.center[k] = center[k];
+
+    e.size = (uint32_t)(globals.size() * sizeof(SmfbVertex) + corners * sizeof(uint16_t));
+    page.blob.resize(e.size);
+    SmfbVertex* vertices = (SmfbVertex*)page.blob.data();
+    for (size_t v = 0; v < globals.size(); ++v) {
+        quantize_position(localPositions[v], bmin, extent, vertices[v].pos);
+        vertices[v].pad = 0;
+        oct_encode(normals[globals[v]], vertices[v].normal);
+    }
+    uint16_t* indices = (uint16_t*)(vertices + globals.size());
+    for (uint32_t l = 0; l < e.lodCount; ++l) {
+        const std::vector<glm::uvec3>& lf = l == 0 ? localFaces : lods[l - 1].faces;
+        for (auto& f : lf)
+            for (int k = 0; k < 3; ++k) *indices++ = (uint16_t)f[k];
+    }
+    return page;
+}
+
+// Converts `smfPath` into the paged file `outPath` (written to outPath.tmp
+// first, then renamed). Scratch files live next to the output.
+inline bool build_paged_mesh(const std::string& smfPath, const std::string& outPath, const PageBuildOptions& options) {
+    MappedFile source;
+    if (!source.open(smfPath)) {
+        std::cerr << "Cannot open file: " << smfPath << "\n";
+        return false;
+    }
+    ThreadPool& pool = thread_pool();
+
+    // parse straight into file-backed arrays, as load_smf does into vectors
+    std::vector<const char*> cuts = smf_split_lines(source.data(), source.end(), pool.size() + 1);
+    size_t chunks = cuts.size() - 1;
+    std::vector<size_t> vfirst(chunks + 1, 0), ffirst(chunks + 1, 0);
+    pool.parallel_for(chunks, [&](size_t c) { smf_count_records(cuts[c], cuts[c + 1], vfirst[c + 1], ffirst[c + 1]); });
+    for (size_t c = 0; c < chunks; ++c) {
+        vfirst[c + 1] += vfirst[c];
+        ffirst[c + 1] += ffirst[c];
+    }
+    const size_t vertexCount = vfirst[chunks], faceCount = ffirst[chunks];
+    if (vertexCount == 0 || faceCount == 0) {
+        std::cerr << "No geometry in " << smfPath << "\n";
+        return false;
+    }
+    ScratchMappedFile positionFile, faceFile, sortedFile, normalFile, ownerFile;
+    if (!positionFile.create(outPath + ".pos.tmp", vertexCount * sizeof(glm::vec3))
+        || !faceFile.create(outPath + ".faces.tmp", faceCount * sizeof(glm::uvec3))
+        || !sortedFile.create(outPath + ".pages.tmp", faceCount * sizeof(glm::uvec3))
+        || !normalFile.create(outPath + ".normals.tmp", vertexCount * sizeof(glm::vec3))
+        || !ownerFile.create(outPath + ".owner.tmp", vertexCount * sizeof(uint32_t))) {
+        std::cerr << "Cannot create scratch files next to " << outPath << "\n";
+        return false;
+    }
+    glm::vec3* positions = positionFile.as<glm::vec3>();
+    glm::uvec3* faces = faceFile.as<glm::uvec3>();
+    glm::uvec3* sorted = sortedFile.as<glm::uvec3>();
+    glm::vec3* normals = normalFile.as<glm::vec3>(); // zero-filled by the OS
+    uint32_t* owner = ownerFile.as<uint32_t>();
+    std::vector<char> ok(chunks, 0);
+    pool.parallel_for(chunks, [&](size_t c) {
+        ok[c] = smf_parse_records(cuts[c], cuts[c + 1], positions + vfirst[c], faces + ffirst[c]) &&
+            smf_validate_faces(faces + ffirst[c], ffirst[c + 1] - ffirst[c], vertexCount);
+    });
+    source.close();
+    for (char c : ok) {
+        if (!c) {
+            std::cerr << "Malformed SMF record or face index out of range in " << smfPath << "\n";
+            return false;
+        }
+    }
+
+    // bounds, in blocks so every pass streams through the scratch arrays
+    const size_t block = 1u << 16;
+    size_t vblocks = (vertexCount + block - 1) / block;
+    std::vector<glm::vec3> blockMin(vblocks), blockMax(vblocks);
+    std::vector<double> blockSum(vblocks * 3, 0.0);
+    pool.parallel_for(vblocks, [&](size_t b) {
+        size_t end = std::min(vertexCount, (b + 1) * block);
+        blockMin[b] = blockMax[b] = positions[b * block];
+        for (size_t i = b * block; i < end; ++i) {
+            blockMin[b] = glm::min(blockMin[b], positions[i]);
+            blockMax[b] = glm::max(blockMax[b], positions[i]);
+            for (int k = 0; k < 3; ++k) blockSum[b * 3 + k] += positions[i][k];
+        }
+    });
+    MeshBounds bounds;
+    bounds.bmin = blockMin[0];
+    bounds.bmax = blockMax[0];
+    double sum[3] = { 0.0, 0.0, 0.0 };
+    for (size_t b = 0; b < vblocks; ++b) {
+        bounds.bmin = glm::min(bounds.bmin, blockMin[b]);
+        bounds.bmax = glm::max(bounds.bmax, blockMax[b]);
+        for (int k = 0; k < 3; ++k) sum[k] += blockSum[b * 3 + k];
+    }
+    for (int k = 0; k < 3; ++k) bounds.centroid[k] = (float)(sum[k] / (double)vertexCount);
+    std::vector<float> blockRadius(vblocks, 0.0f);
+    pool.parallel_for(vblocks, [&](size_t b) {
+        size_t end = std::min(vertexCount, (b + 1) * block);
+        for (size_t i = b * block; i < end; ++i)
+            blockRadius[b] = std::max(blockRadius[b], glm::length(positions[i] - bounds.centroid));
+    });
+    for (float r : blockRadius) bounds.radius = std::max(bounds.radius, r);
+
+    // face histogram over the grid, one partial histogram per chunk
+    PageGrid grid;
+    grid.origin = bounds.bmin;
+    glm::vec3 extent = aabb_quantize_extent(bounds.bmin, bounds.bmax);
+    grid.cellScale = glm::vec3((float)SMFP_GRID) / extent;
+    const size_t cells = (size_t)SMFP_GRID * SMFP_GRID * SMFP_GRID;
+    size_t parts = std::min<size_t>(pool.size() + 1, (faceCount + block - 1) / block);
+    std::vector<std::vector<uint32_t>> partial(parts, std::vector<uint32_t>(cells, 0));
+    pool.parallel_for(parts, [&](size_t t) {
+        size_t begin = faceCount * t / parts, end = faceCount * (t + 1) / parts;
+        for (size_t i = begin; i < end; ++i) partial[t][grid.face_cell(positions, faces[i])]++;
+    });
+    const uint32_t n = SMFP_GRID + 1;
+    std::vector<uint64_t> sums((size_t)n * n * n, 0);
+    for (uint32_t z = 0; z < SMFP_GRID; ++z)
+        for (uint32_t y = 0; y < SMFP_GRID; ++y)
+            for (uint32_t x = 0; x < SMFP_GRID; ++x) {
+                uint64_t c = 0;
+                for (auto& p : partial) c += p[(z * SMFP_GRID + y) * SMFP_GRID + x];
+                auto s = [&](uint32_t i, uint32_t j, uint32_t k) -> uint64_t& { return sums[((size_t)k * n + j) * n + i]; };
+                s(x + 1, y + 1, z + 1) = c + s(x, y + 1, z + 1) + s(x + 1, y, z + 1) + s(x + 1, y + 1, z)
+                    - s(x, y, z + 1) - s(x, y + 1, z) - s(x + 1, y, z) + s(x, y, z);
+            }
+    partial.clear();
+    partial.shrink_to_fit();
+
+    // 21845 * 3 corners always fit 16-bit local indices
+    uint32_t budget = std::min<uint32_t>(21845, std::max<uint32_t>(64, options.pageFaces));
+    std::vector<uint32_t> cellPage(cells, 0), pageFaceCount;
+    PageOctree octree = { sums, budget, cellPage, pageFaceCount };
+    const uint32_t lo[3] = { 0, 0, 0 }, hi[3] = { SMFP_GRID, SMFP_GRID, SMFP_GRID };
+    octree.split(lo, hi);
+    const size_t pageCount = pageFaceCount.size();
+
+    // bucket the faces by page; note which vertices cross a page border and
+    // accumulate the vertex normals on the way (one sequential pass)
+    std::vector<uint64_t> pageFirst(pageCount + 1, 0);
+    for (size_t p = 0; p < pageCount; ++p) pageFirst[p + 1] = pageFirst[p] + pageFaceCount[p];
+    std::vector<uint64_t> cursor(pageFirst.begin(), pageFirst.end() - 1);
+    std::vector<uint32_t> cellFilled(cells, 0); // faces placed per cell, for oversized cells
+    pool.parallel_for(vblocks, [&](size_t b) {
+        size_t end = std::min(vertexCount, (b + 1) * block);
+        for (size_t i = b * block; i < end; ++i) owner[i] = SMFP_VERTEX_UNUSED;
+    });
+    for (size_t i = 0; i < faceCount; ++i) {
+        const glm::uvec3& f = faces[i];
+        uint32_t cell = grid.face_cell(positions, f);
+        uint32_t page = cellPage[cell] + cellFilled[cell]++ / budget;
+        sorted[cursor[page]++] = f;
+
+        glm::vec3 p0 = positions[f.x], p1 = positions[f.y], p2 = positions[f.z];
+        glm::vec3 fn = glm::cross(p1 - p0, p2 - p0);
+        float len = glm::length(fn);
+        if (options.normalWeighting != NORMAL_WEIGHT_AREA && len > 0.0f) fn /= len;
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = f[k];
+            float w = 1.0f;
+            if (options.normalWeighting == NORMAL_WEIGHT_ANGLE) {
+                glm::vec3 a = positions[f[(k + 1) % 3]] - positions[v], c = positions[f[(k + 2) % 3]] - positions[v];
+                float la = glm::length(a), lc = glm::length(c);
+                w = la > 0.0f && lc > 0.0f ? std::acos(std::max(-1.0f, std::min(1.0f, glm::dot(a, c) / (la * lc)))) : 0.0f;
+            }
+            normals[v] += fn * w;
+            if (owner[v] == SMFP_VERTEX_UNUSED) owner[v] = page;
+            else if (owner[v] != page) owner[v] = SMFP_VERTEX_SHARED;
+        }
+    }
+    pool.parallel_for(vblocks, [&](size_t b) {
+        size_t end = std::min(vertexCount, (b + 1) * block);
+        for (size_t i = b * block; i < end; ++i) {
+            float len2 = glm::dot(normals[i], normals[i]);
+            if (len2 > 0.0f) normals[i] /= std::sqrt(len2);
+        }
+    });
+    faceFile.close();
+
+    // pages in parallel batches, appended in order; the table goes last and
+    // the header is rewritten once every offset is known
+    std::string tmp = outPath + ".tmp";
+    FILE* out = fopen(tmp.c_str(), "wb");
+    if (!out) {
+        std::cerr << "Cannot write " << outPath << "\n";
+        return false;
+    }
+    SmfpHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "SMFP", 4);
+    h.version = SMFP_VERSION;
+    h.vertexCount = vertexCount;
+    h.faceCount = faceCount;
+    h.pageCount = (uint32_t)pageCount;
+    h.flags = smfb_weight_flags(options.normalWeighting);
+    for (int k = 0; k < 3; ++k) {
+        h.centroid[k] = bounds.centroid[k];
+        h.boundsMin[k] = bounds.bmin[k];
+        h.boundsMax[k] = bounds.bmax[k];
+    }
+    h.maxRadius = bounds.radius;
+    bool written = fwrite(&h, sizeof(h), 1, out) == 1;
+    uint64_t offset = sizeof(h);
+
+    std::vector<SmfpPage> table(pageCount);
+    const size_t batch = (pool.size() + 1) * 4;
+    std::vector<BuiltPage> built(batch);
+    static const char zeros[16] = {};
+    for (size_t first = 0; first < pageCount && written; first += batch) {
+        size_t count = std::min(batch, pageCount - first);
+        pool.parallel_for(count, [&](size_t i) {
+            size_t p = first + i;
+            built[i] = build_page(sorted + pageFirst[p], (size_t)(pageFirst[p + 1] - pageFirst[p]), positions, normals,
+                owner, bounds.bmin, extent, options.lodLevels);
+        });
+        for (size_t i = 0; i < count && written; ++i) {
+            SmfpPage& e = built[i].entry;
+            uint64_t aligned = smfb_align(offset);
+            written = fwrite(zeros, 1, (size_t)(aligned - offset), out) == aligned - offset
+                && fwrite(built[i].blob.data(), 1, built[i].blob.size(), out) == built[i].blob.size();
+            e.offset = aligned;
+            offset = aligned + e.size;
+            const SmfbLod& last = e.lods[e.lodCount - 1];
+            h.maxPageVertices = std::max(h.maxPageVertices, e.vertexCount);
+            h.maxPageIndices = std::max(h.maxPageIndices, last.firstIndex + last.indexCount);
+            table[first + i] = e;
+            built[i] = BuiltPage();
+        }
+    }
+    uint64_t aligned = smfb_align(offset);
+    h.pageTableOffset = aligned;
+    h.fileSize = aligned + pageCount * sizeof(SmfpPage);
+    written = written && fwrite(zeros, 1, (size_t)(aligned - offset), out) == aligned - offset
+        && fwrite(table.data(), sizeof(SmfpPage), pageCount, out) == pageCount;
+    rewind(out);
+    written = written && fwrite(&h, sizeof(h), 1, out) == 1;
+    written = (fclose(out) == 0) && written;
+    if (written) {
+        std::remove(outPath.c_str()); // rename does not replace on Windows
+        written = std::rename(tmp.c_str(), outPath.c_str()) == 0;
+    }
+    if (!written) {
+        std::remove(tmp.c_str());
+        std::cerr << "Cannot write " << outPath << "\n";
+        return false;
+    }
+    std::cout << smfPath << ": " << faceCount << " triangles in " << pageCount << " pages (up to "
+        << h.maxPageVertices << " vertices / " << h.maxPageIndices << " indices each)\n";
+    return true;
+}
@@ -0,0 +1,239 @@
+// mesh_simplify.h
+// Quadric error metric simplification (Garland & Heckbert 1997) producing a
+// chain of levels of detail.
+//
+// Collapses are half-edge collapses: a vertex is merged into one of its
+// neighbours instead of a new optimal position, so every level indexes the
+// same vertex array and LODs only cost index buffer space. Collapses run in
+// passes: all edge costs are computed, then the cheapest edges are collapsed
+// greedily as long as their neighbourhoods do not overlap, the faces are
+// remapped, and the next pass starts from the result. Borders and vertex
+// fans come from the mesh adjacency (mesh_adjacency.h): the caller's for the
+// input faces, rebuilt for each pass after that.
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "mesh_adjacency.h"
+
+// Symmetric 4x4 quadric: sum of squared distances to a set of planes.
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+    void add_plane(double a, double b, double c, double d, double w) {
+        a2 += w * a * a; ab += w * a * b; ac += w * a * c; ad += w * a * d;
+        b2 += w * b * b; bc += w * b * c; bd += w * b * d;
+        c2 += w * c * c; cd += w * c * d;
+        d2 += w * d * d;
+    }
+
+    void add(const Quadric& q) {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+        bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+    }
+
+    double error(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+            + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+            + c2 * z * z + 2 * cd * z + d2;
+        return std::max(0.0, e);
+    }
+};
+
+struct LodLevel {
+    std::vector<glm::uvec3> faces;
+    float error = 0.0f; // world-space deviation bound: sqrt of the worst collapse cost
+};
+
+// boundary edges carry a perpendicular plane with this weight, so open
+// borders do not shrink
+const double QEM_BOUNDARY_WEIGHT = 10.0;
+
+// `adjacency`: that of `faces`
+inline std::vector<Quadric> compute_vertex_quadrics(const std::vector<glm::vec3>& positions,
+    const std::vector<glm::uvec3>& faces, const AdjacencyView& adjacency)
+{
+    std::vector<Quadric> q(positions.size());
+    for (uint32_t t = 0; t < (uint32_t)faces.size(); ++t) {
+        const glm::uvec3& f = faces[t];
+        glm::vec3 p0 = positions[f.x], p1 = positions[f.y], p2 = positions[f.z];
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float len = glm::length(n);
+        if (len <= 0.0f) continue;
+        n /= len;
+        Quadric plane;
+        plane.add_plane(n.x, n.y, n.z, -glm::dot(n, p0), 1.0);
+        for (int k = 0; k < 3; ++k) q[f[k]].add(plane);
+
+        // border constraint planes through boundary edges of this face
+        for (int k = 0; k < 3; ++k) {
+            if (!adjacency.is_boundary(t * 3 + k)) continue;
+            uint32_t a = f[k], b = f[(k + 1) % 3];
+            glm::vec3 e = positions[b] - positions[a];
+            glm::vec3 m = glm::cross(e, n);
+            float ml = glm::length(m);
+            if (ml <= 0.0f) continue;
+            m /= ml;
+            Quadric border;
+            border.add_plane(m.x, m.y, m.z, -glm::dot(m, positions[a]), QEM_BOUNDARY_WEIGHT);
+            q[a].add(border);
+            q[b].add(border);
+        }
+    }
+    return q;
+}
+
+// One pass of non-overlapping collapses. Returns false when nothing could
+// be collapsed. `maxCost` grows with the worst accepted collapse. `pinned`
+// (optional, one flag per vertex) marks vertices that must never move, e.g.
+// the ones a mesh piece shares with its neighbours. `adjacency`: that of
+// `faces`, built here when null.
+inline bool simplify_pass(const std::vector<glm::vec3>& positions, std::vector<glm::uvec3>& faces,
+    std::vector<Quadric>& quadrics, size_t targetFaces, double& maxCost, const std::vector<char>* pinned = nullptr,
+    const AdjacencyView* adjacency = nullptr)
+{
+    const size_t vertexCount = positions.size();
+
+    // connectivity of the current faces (collapses along a border create new border edges)
+    MeshAdjacency built;
+    if (!adjacency) built = build_mesh_adjacency(faces.data(), faces.size(), vertexCount);
+    const AdjacencyView adj = adjacency ? *adjacency : built.view();
+    std::vector<char> boundaryVertex(vertexCount, 0);
+    for (uint32_t c = 0; c < (uint32_t)faces.size() * 3; ++c)
+        if (adj.is_boundary(c)) {
+            boundaryVertex[faces[c / 3][c % 3]] = 1;
+            boundaryVertex[faces[c / 3][AdjacencyView::next(c) % 3]] = 1;
+        }
+
+    struct Collapse { double cost; uint32_t from, to; };
+    std::vector<Collapse> candidates;
+    candidates.reserve(faces.size() * 3 / 2);
+    for (uint32_t t = 0; t < (uint32_t)faces.size(); ++t) {
+        const glm::uvec3& f = faces[t];
+        for (int k = 0; k < 3; ++k) {
+            uint32_t a = f[k], b = f[(k + 1) % 3];
+            bool borderEdge = adj.is_boundary(t * 3 + k);
+            if (a > b && !borderEdge) continue; // interior edges are seen twice; take one
+            Quadric q = quadrics[a];
+            q.add(quadrics[b]);
+            // a boundary vertex may only slide along its border
+            bool aMovable = (!boundaryVertex[a] || borderEdge) && !(pinned && (*pinned)[a]);
+            bool bMovable = (!boundaryVertex[b] || borderEdge) && !(pinned && (*pinned)[b]);
+            double costAB = aMovable ? q.error(positions[b]) : 1e300;
+            double costBA = bMovable ? q.error(positions[a]) : 1e300;
+            if (!aMovable && !bMovable) continue;
+            if (costAB <= costBA) candidates.push_back({ costAB, a, b });
+            else candidates.push_back({ costBA, b, a });
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+    std::vector<uint32_t> remap(vertexCount);
+    for (uint32_t v = 0; v < (uint32_t)vertexCount; ++v) remap[v] = v;
+    std::vector<char> locked(vertexCount, 0);
+    size_t liveFaces = faces.size();
+    bool collapsed = false;
+
+    for (const Collapse& c : candidates) {
+        if (liveFaces <= targetFaces) break;
+        if (locked[c.from] || locked[c.to]) continue;
+
+        // reject collapses that flip (or flatten) a surviving face around `from`
+        bool ok = true;
+        size_t removed = 0;
+        for (const uint32_t* a = adj.corners_begin(c.from); a != adj.corners_end(c.from) && ok; ++a) {
+            const glm::uvec3& f = faces[AdjacencyView::face(*a)];
+            if (f.x == c.to || f.y == c.to || f.z == c.to) { ++removed; continue; }
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; ++k) {
+                p[k] = positions[f[k]];
+                q[k] = f[k] == c.from ? positions[c.to] : p[k];
+            }
+            glm::vec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 n1 = glm::cross(q[1] - q[0], q[2] - q[0]);
+            ok = glm::dot(n0, n1) > 0.0f;
+        }
+        if (!ok || removed == 0) continue;
+
+        remap[c.from] = c.to;
+        quadrics[c.to].add(quadrics[c.from]);
+        maxCost = std::max(maxCost, c.cost);
+        liveFaces -= removed;
+        collapsed = true;
+
+        // the faces around `from` change shape: keep their vertices out of this pass
+        for (const uint32_t* a = adj.corners_begin(c.from); a != adj.corners_end(c.from); ++a) {
+            const glm::uvec3& f = faces[AdjacencyView::face(*a)];
+            locked[f.x] = locked[f.y] = locked[f.z] = 1;
+        }
+    }
+    if (!collapsed) return false;
+
+    size_t out = 0;
+    for (size_t i = 0; i < faces.size(); ++i) {
+        glm::uvec3 f(remap[faces[i].x], remap[faces[i].y], remap[faces[i].z]);
+        if (f.x == f.y || f.y == f.z || f.z == f.x) continue;
+        faces[out++] = f;
+    }
+    faces.resize(out);
+    return true;
+}
+
+// Simplifies toward `targetFaces`; stops early when valid collapses run out
+// (a pass that removes under 0.5% of the faces counts as stalled).
+// `adjacency`: that of the input faces, for the first pass (optional).
+inline void simplify_mesh(const std::vector<glm::vec3>& positions, std::vector<glm::uvec3>& faces,
+    std::vector<Quadric>& quadrics, size_t targetFaces, double& maxCost, const std::vector<char>* pinned = nullptr,
+    const AdjacencyView* adjacency = nullptr)
+{
+    while (faces.size() > targetFaces) {
+        size_t before = faces.size();
+        if (!simplify_pass(positions, faces, quadrics, targetFaces, maxCost, pinned, adjacency)) break;
+        adjacency = nullptr; // the faces changed
+        if (faces.size() > targetFaces && (before - faces.size()) * 200 < before) break;
+    }
+}
+
+// Coarser levels below the input mesh (level 0, not included): each has
+// about a quarter of the previous one's faces. Stops after `levels` levels,
+// when a level would drop below `minFaces`, or when simplification stalls.
+// `pinned` as in simplify_pass; `adjacency`: that of `faces`, built here
+// when null.
+inline std::vector<LodLevel> build_lod_chain(const std::vector<glm::vec3>& positions,
+    const std::vector<glm::uvec3>& faces, unsigned levels, size_t minFaces = 64, const std::vector<char>* pinned = nullptr,
+    const AdjacencyView* adjacency = nullptr)
+{
+    std::vector<LodLevel> chain;
+    if (levels == 0 || faces.empty()) return chain;
+
+    MeshAdjacency built;
+    if (!adjacency) built = build_mesh_adjacency(faces.data(), faces.size(), positions.size());
+    const AdjacencyView adj = adjacency ? *adjacency : built.view();
+    std::vector<Quadric> quadrics = compute_vertex_quadrics(positions, faces, adj);
+
+    std::vector<glm::uvec3> current = faces;
+    double maxCost = 0.0;
+    const AdjacencyView* first = &adj; // of `current` until the first pass changes it
+    for (unsigned l = 1; l <= levels; ++l) {
+        size_t target = current.size() / 4;
+        if (target < minFaces) break;
+        size_t before = current.size();
+        simplify_mesh(positions, current, quadrics, target, maxCost, pinned, first);
+        first = nullptr;
+        if (current.size() * 10 > before * 9) break; // less than 10% gained: not worth a level
+
+        LodLevel level;
+        level.faces = current;
+        level.error = (float)std::sqrt(maxCost);
+        chain.push_back(level);
+    }
+    return chain;
+}
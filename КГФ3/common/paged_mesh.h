@@ -0,0 +1,350 @@
+// paged_mesh.h
+// Streams a paged mesh (.smfp, mesh_pages.h) through a fixed-size GPU pool.
+//
+// The pool is one vertex and one index buffer cut into equal slots, each
+// big enough for the largest page with all its levels, so GPU memory is the
+// pool size no matter how large the mesh is. Every frame the page spheres
+// are culled (frustum_cull.h) and each visible page picks a level the same
+// way the instanced scene does. Resident pages are drawn right away, in one
+// glMultiDrawElementsBaseVertex; missing ones are queued nearest first for a
+// worker thread, which copies the page out of the mapped file (the page
+// faults happen there, not on the GL thread) and hands it back through an
+// SPSC queue. The GL thread uploads a few arrivals per frame into free
+// slots, evicting the least recently drawn page when none is left. Pages
+// that have not arrived yet are simply missing for those frames.
+
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frustum_cull.h"
+#include "gl_mesh.h"
+#include "mesh_pages.h"
+#include "scene.h"
+#include "spsc_queue.h"
+
+const size_t PAGED_MESH_DEFAULT_POOL = 256u << 20; // bytes
+
+class PagedMesh {
+public:
+    ~PagedMesh() { stop_worker(); } // GL objects go with destroy()
+
+    // poolBytes: GPU budget for vertices + indices. notify: called on the
+    // worker thread after each loaded page (e.g. glfwPostEmptyEvent).
+    bool open(const std::string& path, size_t poolBytes = PAGED_MESH_DEFAULT_POOL, std::function<void()> notify = nullptr) {
+        destroy();
+        if (!open_paged_mesh(path, file_)) return false;
+        path_ = path;
+        notify_ = notify;
+        const SmfpHeader& h = *file_.header;
+        slotVertices_ = std::max<uint32_t>(1, h.maxPageVertices);
+        slotIndices_ = std::max<uint32_t>(3, h.maxPageIndices);
+        size_t slotBytes = slotVertices_ * sizeof(SmfbVertex) + slotIndices_ * sizeof(uint16_t);
+        slotCount_ = (uint32_t)std::max<size_t>(1, std::min<size_t>(poolBytes / slotBytes, file_.pageCount()));
+
+        glGenVertexArrays(1, &vao_);
+        glGenBuffers(1, &vbo_);
+        glGenBuffers(1, &ebo_);
+        glBindVertexArray(vao_);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)slotCount_ * slotVertices_ * sizeof(SmfbVertex), nullptr, GL_STATIC_DRAW);
+        bind_vertex_attributes(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)slotCount_ * slotIndices_ * sizeof(uint16_t), nullptr, GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // pages are centered on the mesh centroid, like a single scene instance
+        model_ = glm::translate(glm::mat4(1.0f), -file_.centroid());
+        std::vector<BoundingSphere> spheres(file_.pageCount());
+        for (size_t i = 0; i < spheres.size(); ++i) {
+            const SmfpPage& p = file_.page(i);
+            spheres[i].center = glm::vec3(p.center[0], p.center[1], p.center[2]) - file_.centroid();
+            spheres[i].radius = p.radius;
+        }
+        bounds_ = spheres;
+        bvh_.build(spheres);
+
+        pageSlot_.assign(file_.pageCount(), NO_SLOT);
+        inFlight_.reset(new std::atomic<uint8_t>[file_.pageCount()]);
+        for (size_t i = 0; i < file_.pageCount(); ++i) inFlight_[i] = 0;
+        visibleFrame_.assign(file_.pageCount(), 0);
+        slotPage_.assign(slotCount_, NO_PAGE);
+        slotUsed_.assign(slotCount_, 0);
+        freeSlots_.clear();
+        for (uint32_t s = slotCount_; s-- > 0;) freeSlots_.push_back(s);
+
+        stop_ = false;
+        worker_ = std::thread([this] { run(); });
+        std::cerr << path << ": " << file_.pageCount() << " pages, GPU pool of " << slotCount_ << " ("
+            << (slotCount_ * slotBytes >> 20) << " MiB)\n";
+        return true;
+    }
+
+    bool is_open() const { return file_.header != nullptr; }
+    float radius() const { return is_open() ? file_.maxRadius() : 0.0f; }
+
+    // Culls the pages, picks their levels, uploads up to `uploadBudget`
+    // arrived pages and queues the missing visible ones. Call once per frame
+    // before draw().
+    void update(const glm::mat4& viewProj, const LodSelection& lod, bool cull, int uploadBudget = 16) {
+        if (!is_open()) return;
+        ++frame_;
+        visible_.clear();
+        if (cull) bvh_.cull(frustum_from_matrix(viewProj), visible_);
+        else for (uint32_t i = 0; i < (uint32_t)file_.pageCount(); ++i) visible_.push_back(i);
+
+        // touch first, so this frame's pages are never the ones evicted below
+        for (uint32_t p : visible_) {
+            visibleFrame_[p] = frame_;
+            if (pageSlot_[p] != NO_SLOT) slotUsed_[pageSlot_[p]] = frame_;
+        }
+        upload_arrivals(uploadBudget);
+
+        counts_.clear();
+        offsets_.clear();
+        baseVertices_.clear();
+        std::vector<std::pair<float, uint32_t>> missing;
+        for (uint32_t p : visible_) {
+            uint32_t slot = pageSlot_[p];
+            if (slot == NO_SLOT) {
+                if (!inFlight_[p]) missing.push_back({ glm::length(bounds_[p].center - lod.eye), p });
+                continue;
+            }
+            slotUsed_[slot] = frame_;
+            const SmfbLod& l = file_.page(p).lods[select_level(p, lod)];
+            counts_.push_back((GLsizei)l.indexCount);
+            offsets_.push_back((const void*)(((size_t)slot * slotIndices_ + l.firstIndex) * sizeof(uint16_t)));
+            baseVertices_.push_back((GLint)(slot * slotVertices_));
+            drawnTriangles_ += l.indexCount / 3;
+        }
+
+        // the request list is replaced every frame: what is no longer visible
+        // is dropped before it is read. Nothing new is read while loaded
+        // pages still wait for a slot
+        std::sort(missing.begin(), missing.end());
+        if (!parked_.empty()) missing.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            requests_.clear();
+            for (size_t i = 0; i < missing.size() && i < MAX_REQUESTS; ++i) requests_.push_back(missing[i].second);
+        }
+        if (!missing.empty()) cv_.notify_one();
+    }
+
+    // The resident visible pages with the bound program. The instance
+    // attributes are not arrays here, so their constant values carry the model.
+    void draw() const {
+        if (!is_open() || counts_.empty()) return;
+        glm::mat4 model = model_ * file_.dequantizeMatrix();
+        for (GLuint c = 0; c < 4; ++c) glVertexAttrib4fv(INSTANCE_MODEL_LOCATION + c, &model[c][0]);
+        for (GLuint c = 0; c < 3; ++c)
+            glVertexAttrib3f(INSTANCE_NORMAL_LOCATION + c, c == 0 ? 1.0f : 0.0f, c == 1 ? 1.0f : 0.0f, c == 2 ? 1.0f : 0.0f);
+        glBindVertexArray(vao_);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts_.data(), GL_UNSIGNED_SHORT, offsets_.data(),
+            (GLsizei)counts_.size(), baseVertices_.data());
+        glBindVertexArray(0);
+    }
+
+    // loaded pages waiting for update() (on-demand redraw); the worker posts
+    // `notify` for each one
+    bool has_arrivals() const { return !arrivals_.empty(); }
+
+    size_t page_count() const { return file_.pageCount(); }
+    size_t visible_count() const { return visible_.size(); }
+    size_t drawn_count() const { return counts_.size(); }
+    size_t resident_count() const { return slotCount_ - freeSlots_.size(); }
+    size_t slot_count() const { return slotCount_; }
+    uint64_t uploads() const { return uploads_; }
+    uint64_t evictions() const { return evictions_; }
+    uint64_t drawn_triangles() const { return drawnTriangles_; } // summed over all frames
+
+    void destroy() {
+        stop_worker();
+        std::unique_ptr<Arrival> a;
+        while (arrivals_.pop(a)) {}
+        parked_.clear();
+        if (vao_) {
+            glDeleteVertexArrays(1, &vao_);
+            glDeleteBuffers(1, &vbo_);
+            glDeleteBuffers(1, &ebo_);
+        }
+        vao_ = vbo_ = ebo_ = 0;
+        file_.header = nullptr;
+        file_.pages = nullptr;
+        file_.mapped.close();
+    }
+
+private:
+    void stop_worker() {
+        if (!worker_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        worker_.join();
+    }
+
+    static const uint32_t NO_SLOT = 0xFFFFFFFFu;
+    static const uint32_t NO_PAGE = 0xFFFFFFFFu;
+    static const size_t MAX_REQUESTS = 256;
+
+    struct Arrival {
+        uint32_t page = 0;
+        std::vector<char> blob;
+    };
+
+    // Coarsest level whose projected error stays within the budget (see select_lod).
+    uint32_t select_level(uint32_t p, const LodSelection& sel) const {
+        const SmfpPage& page = file_.page(p);
+        if (!sel.enabled || page.lodCount <= 1) return 0;
+        float pixelsPerUnit = sel.pixelsPerUnit;
+        if (sel.perspective) {
+            float dist = glm::length(bounds_[p].center - sel.eye) - bounds_[p].radius;
+            if (dist <= 1e-4f) return 0;
+            pixelsPerUnit /= dist;
+        }
+        uint32_t level = 0;
+        while (level + 1 < page.lodCount && page.lods[level + 1].error * pixelsPerUnit <= sel.maxErrorPixels) ++level;
+        return level;
+    }
+
+    // Parked pages first, then new arrivals. A page that finds every slot
+    // drawn this frame is parked with its data (still in flight, so it is
+    // not read again) until a slot frees up or it leaves the view.
+    void upload_arrivals(int budget) {
+        int n = 0;
+        size_t kept = 0;
+        for (size_t i = 0; i < parked_.size(); ++i) {
+            std::unique_ptr<Arrival>& a = parked_[i];
+            if (visibleFrame_[a->page] != frame_) inFlight_[a->page] = 0;
+            else if (n < budget && upload(*a)) ++n;
+            else parked_[kept++] = std::move(a);
+        }
+        parked_.resize(kept);
+
+        std::unique_ptr<Arrival> a;
+        for (; n < budget && arrivals_.pop(a); ++n) {
+            if (upload(*a)) continue;
+            if (!warnedFull_) std::cerr << path_ << ": page pool too small for the visible pages\n";
+            warnedFull_ = true;
+            parked_.push_back(std::move(a));
+        }
+    }
+
+    // false when there is no slot for it
+    bool upload(const Arrival& a) {
+        uint32_t p = a.page;
+        if (pageSlot_[p] == NO_SLOT) { // else requested twice
+            uint32_t slot = take_slot();
+            if (slot == NO_SLOT) return false;
+            const SmfpPage& page = file_.page(p);
+            const SmfbLod& last = page.lods[page.lodCount - 1];
+            size_t vertexBytes = page.vertexCount * sizeof(SmfbVertex);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+            glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)((size_t)slot * slotVertices_ * sizeof(SmfbVertex)),
+                (GLsizeiptr)vertexBytes, a.blob.data());
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ebo_); // the element binding belongs to the VAO
+            glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)((size_t)slot * slotIndices_ * sizeof(uint16_t)),
+                (GLsizeiptr)((last.firstIndex + last.indexCount) * sizeof(uint16_t)), a.blob.data() + vertexBytes);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            pageSlot_[p] = slot;
+            slotPage_[slot] = p;
+            slotUsed_[slot] = frame_;
+            ++uploads_;
+        }
+        inFlight_[p] = 0;
+        return true;
+    }
+
+    // A free slot, or the least recently drawn one if it was not drawn this frame.
+    uint32_t take_slot() {
+        if (!freeSlots_.empty()) {
+            uint32_t s = freeSlots_.back();
+            freeSlots_.pop_back();
+            return s;
+        }
+        uint32_t oldest = 0;
+        for (uint32_t s = 1; s < slotCount_; ++s)
+            if (slotUsed_[s] < slotUsed_[oldest]) oldest = s;
+        if (slotUsed_[oldest] == frame_) return NO_SLOT;
+        pageSlot_[slotPage_[oldest]] = NO_SLOT;
+        slotPage_[oldest] = NO_PAGE;
+        ++evictions_;
+        return oldest;
+    }
+
+    void run() {
+        for (;;) {
+            uint32_t p;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+                if (stop_) return;
+                p = requests_.front();
+                requests_.erase(requests_.begin());
+            }
+            if (inFlight_[p].exchange(1)) continue;
+            std::unique_ptr<Arrival> a(new Arrival());
+            a->page = p;
+            const SmfpPage& page = file_.page(p);
+            a->blob.assign(file_.page_data(p), file_.page_data(p) + page.size);
+            // the queue only fills up if the GL thread stops updating
+            while (!arrivals_.push(std::move(a))) {
+                if (stop_) return;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (notify_) notify_();
+        }
+    }
+
+    std::string path_;
+    PagedMeshFile file_;
+    std::function<void()> notify_;
+    glm::mat4 model_ = glm::mat4(1.0f);
+    std::vector<BoundingSphere> bounds_; // world space
+    CullBvh bvh_;
+
+    GLuint vao_ = 0, vbo_ = 0, ebo_ = 0;
+    uint32_t slotVertices_ = 0, slotIndices_ = 0, slotCount_ = 0;
+    std::vector<uint32_t> pageSlot_;  // per page, NO_SLOT when not resident
+    std::vector<uint32_t> slotPage_;
+    std::vector<uint64_t> slotUsed_;  // frame the slot was last drawn
+    std::vector<uint64_t> visibleFrame_; // per page, last frame it was visible
+    std::vector<std::unique_ptr<Arrival>> parked_; // loaded, waiting for a slot
+    std::vector<uint32_t> freeSlots_;
+    uint64_t frame_ = 0;
+
+    std::vector<uint32_t> visible_;
+    std::vector<GLsizei> counts_;
+    std::vector<const void*> offsets_;
+    std::vector<GLint> baseVertices_;
+    bool warnedFull_ = false;
+    uint64_t uploads_ = 0, evictions_ = 0, drawnTriangles_ = 0;
+
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<uint32_t> requests_; // nearest first
+    std::atomic<bool> stop_{ false };
+    std::unique_ptr<std::atomic<uint8_t>[]> inFlight_; // taken by the worker, not yet uploaded
+    SpscQueue<std::unique_ptr<Arrival>, 64> arrivals_;
+};
@@ -0,0 +1,154 @@
+// parallel.h
+// Small fixed-size thread pool shared by the loading / preprocessing passes.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // threads == 0 uses one worker per hardware thread.
+    explicit ThreadPool(unsigned threads = 0) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < threads; ++i)
+            workers_.emplace_back([this] { worker_loop(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return (unsigned)workers_.size(); }
+
+    template <class F>
+    auto submit(F&& f) -> std::future<decltype(f())> {
+        using R = decltype(f());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace_back([task] { (*task)(); });
+        }
+        cv_.notify_one();
+        return result;
+    }
+
+    // Runs fn(i) for every i in [0, count) and returns when all calls are done.
+    // The calling thread takes part, so this is safe to nest inside a task.
+    void parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+        if (count == 0) return;
+        if (count == 1 || workers_.empty()) {
+            for (size_t i = 0; i < count; ++i) fn(i);
+            return;
+        }
+
+        struct State {
+            std::atomic<size_t> next{ 0 };
+            std::atomic<size_t> done{ 0 };
+            std::mutex mutex;
+            std::condition_variable cv;
+        };
+        auto state = std::make_shared<State>();
+        const size_t total = count;
+
+        // Helpers may start after the loop is already finished, so they only
+        // touch the shared state and never the caller's stack.
+        auto run = [state, total](const std::function<void(size_t)>& body) {
+            size_t i;
+            while ((i = state->next.fetch_add(1)) < total) {
+                body(i);
+                if (state->done.fetch_add(1) + 1 == total) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->cv.notify_all();
+                }
+            }
+        };
+
+        auto body = std::make_shared<std::function<void(size_t)>>(fn);
+        size_t helpers = std::min<size_t>(count - 1, workers_.size());
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t h = 0; h < helpers; ++h)
+                tasks_.emplace_back([run, body] { run(*body); });
+        }
+        cv_.notify_all();
+
+        run(fn);
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cv.wait(lock, [&] { return state->done.load() == total; });
+    }
+
+private:
+    void worker_loop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                if (stop_ && tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
+
+// Process-wide pool, created on first use.
+inline ThreadPool& thread_pool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+// Sorts [data, data + count) on the pool: power-of-two chunks are sorted in
+// parallel, then merged pairwise, each round's merges again in parallel.
+// Equal elements end up in no particular order; callers that need the same
+// result for every thread count make the keys unique (e.g. add an index).
+template <typename T, typename Less = std::less<T>>
+inline void parallel_sort(T* data, size_t count, Less less = Less()) {
+    ThreadPool& pool = thread_pool();
+    const size_t minChunk = 1u << 15; // below this the merges cost more than they save
+    size_t chunks = 1;
+    while (chunks < pool.size() + 1 && count / (chunks * 2) >= minChunk) chunks *= 2;
+    if (chunks == 1) {
+        std::sort(data, data + count, less);
+        return;
+    }
+    auto bound = [&](size_t c) { return count * c / chunks; };
+    pool.parallel_for(chunks, [&](size_t c) { std::sort(data + bound(c), data + bound(c + 1), less); });
+
+    std::vector<T> scratch(count);
+    T* src = data;
+    T* dst = scratch.data();
+    for (size_t width = 1; width < chunks; width *= 2) {
+        pool.parallel_for(chunks / (width * 2), [&](size_t m) {
+            size_t lo = bound(m * 2 * width), mid = bound(m * 2 * width + width), hi = bound((m + 1) * 2 * width);
+            std::merge(src + lo, src + mid, src + mid, src + hi, dst + lo, less);
+        });
+        std::swap(src, dst);
+    }
+    if (src != data) std::copy(src, src + count, data);
+}
@@ -0,0 +1,271 @@
+// program_cache.h
+// Builds the viewers' GLSL programs without stalling startup on the driver.
+//
+// Every linked program is saved as a glGetProgramBinary blob under the cache
+// directory, keyed by a hash of its sources plus the GL vendor, renderer and
+// version strings, and later runs load it back with glProgramBinary instead
+// of compiling. A blob the driver rejects (e.g. after an update it did not
+// advertise in the version string) is simply rebuilt from source.
+//
+// request() only issues the work; it never queries a status. With
+// GL_KHR_parallel_shader_compile the driver compiles all requested programs
+// on its own threads, and ready() polls GL_COMPLETION_STATUS_KHR without
+// blocking; wait() blocks for one program and reports its errors. Request
+// everything first and wait afterwards, so the compiles overlap.
+
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+#define PROGRAM_CACHE_BINARIES 1
+#endif
+
+// Whether the context exposes `name` (GL 3.0+ indexed extension list).
+inline bool gl_has_extension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if (ext && strcmp(ext, name) == 0) return true;
+    }
+    return false;
+}
+
+inline uint64_t program_cache_hash(const char* data, size_t size, uint64_t h = 0xcbf29ce484222325ull) {
+    for (size_t i = 0; i < size; ++i) h = (h ^ (unsigned char)data[i]) * 0x100000001b3ull;
+    return h;
+}
+
+// On-disk blob: this header, then `length` bytes of driver binary.
+struct ProgramBinaryHeader {
+    char magic[4];   // "CGFP"
+    uint32_t version;
+    uint64_t key;    // sources + driver
+    uint32_t format; // glGetProgramBinary's binaryFormat
+    uint32_t length;
+};
+
+const uint32_t PROGRAM_BINARY_VERSION = 1;
+
+class ProgramCache {
+public:
+    // dir: where blobs live ("" = no disk cache). Call with a current context.
+    void init(const std::string& dir) {
+        dir_ = dir;
+        const char* vendor = (const char*)glGetString(GL_VENDOR);
+        const char* renderer = (const char*)glGetString(GL_RENDERER);
+        const char* version = (const char*)glGetString(GL_VERSION);
+        driver_ = std::string(vendor ? vendor : "") + "|" + (renderer ? renderer : "") + "|" + (version ? version : "");
+
+        binaries_ = false;
+#ifdef PROGRAM_CACHE_BINARIES
+        bool supported = gl_has_extension("GL_ARB_get_program_binary");
+#ifdef GL_VERSION_4_1
+        supported = supported || GLAD_GL_VERSION_4_1;
+#endif
+        GLint formats = 0;
+        if (supported) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        binaries_ = !dir_.empty() && formats > 0;
+#endif
+        if (binaries_) make_directory(dir_);
+
+        parallel_ = gl_has_extension("GL_KHR_parallel_shader_compile");
+        if (parallel_) {
+            typedef void (*MaxThreadsProc)(GLuint);
+            MaxThreadsProc maxThreads = (MaxThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+            if (maxThreads) maxThreads(0xFFFFFFFFu); // as many as the driver likes
+        }
+    }
+
+    // Starts building a program; the id is valid right away, usable once
+    // ready() or wait() says so. `name` is only for messages.
+    GLuint request(const char* vsrc, const char* fsrc, const char* name) {
+        Entry e;
+        e.name = name;
+        e.key = program_cache_hash(vsrc, strlen(vsrc) + 1);
+        e.key = program_cache_hash(fsrc, strlen(fsrc) + 1, e.key);
+        e.key = program_cache_hash(driver_.data(), driver_.size(), e.key);
+        e.program = glCreateProgram();
+        if (load_binary(e)) {
+            ++hits_;
+            e.state = Entry::DONE;
+        }
+        else {
+            e.shaders[0] = compile(GL_VERTEX_SHADER, vsrc);
+            e.shaders[1] = compile(GL_FRAGMENT_SHADER, fsrc);
+            glAttachShader(e.program, e.shaders[0]);
+            glAttachShader(e.program, e.shaders[1]);
+#ifdef PROGRAM_CACHE_BINARIES
+            if (binaries_) glProgramParameteri(e.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+            glLinkProgram(e.program);
+            ++misses_;
+        }
+        entries_.push_back(e);
+        return e.program;
+    }
+
+    // Non-blocking with the parallel compile extension; otherwise finishes
+    // the program (and may block) since nothing else can tell.
+    bool ready(GLuint program) {
+        Entry* e = find(program);
+        if (!e || e->state == Entry::DONE) return true;
+        if (parallel_) {
+            GLint done = GL_FALSE;
+            glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done) return false;
+        }
+        finish(*e);
+        return true;
+    }
+
+    // Blocks until `program` is built; logs any errors. Returns it for chaining.
+    GLuint wait(GLuint program) {
+        Entry* e = find(program);
+        if (e && e->state != Entry::DONE) finish(*e);
+        return program;
+    }
+
+    bool parallel() const { return parallel_; }
+    bool binaries() const { return binaries_; }
+    int hits() const { return hits_; }
+    int misses() const { return misses_; }
+
+private:
+    struct Entry {
+        enum State { PENDING, DONE };
+        GLuint program = 0;
+        GLuint shaders[2] = {};
+        std::string name;
+        uint64_t key = 0;
+        State state = PENDING;
+    };
+
+    Entry* find(GLuint program) {
+        for (auto& e : entries_)
+            if (e.program == program) return &e;
+        return nullptr;
+    }
+
+    static GLuint compile(GLenum type, const char* src) {
+        GLuint s = glCreateShader(type);
+        glShaderSource(s, 1, &src, nullptr);
+        glCompileShader(s);
+        return s;
+    }
+
+    // The first status query: reports errors, then stores the binary.
+    void finish(Entry& e) {
+        e.state = Entry::DONE;
+        GLint ok = GL_FALSE;
+        glGetProgramiv(e.program, GL_LINK_STATUS, &ok);
+        if (!ok) {
+            char buf[1024];
+            for (GLuint s : e.shaders) {
+                GLint compiled = GL_TRUE;
+                glGetShaderiv(s, GL_COMPILE_STATUS, &compiled);
+                if (compiled) continue;
+                glGetShaderInfoLog(s, sizeof(buf), nullptr, buf);
+                std::cerr << "Shader compile error (" << e.name << "): " << buf << "\n";
+            }
+            glGetProgramInfoLog(e.program, sizeof(buf), nullptr, buf);
+            std::cerr << "Program link error (" << e.name << "): " << buf << "\n";
+        }
+        else save_binary(e);
+        for (GLuint& s : e.shaders) {
+            if (!s) continue;
+            glDetachShader(e.program, s);
+            glDeleteShader(s);
+            s = 0;
+        }
+    }
+
+    std::string path(const Entry& e) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.glbin", (unsigned long long)e.key);
+        return dir_ + "/" + name;
+    }
+
+    bool load_binary(Entry& e) {
+#ifdef PROGRAM_CACHE_BINARIES
+        if (!binaries_) return false;
+        FILE* f = fopen(path(e).c_str(), "rb");
+        if (!f) return false;
+        ProgramBinaryHeader h;
+        std::vector<char> blob;
+        bool ok = fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, "CGFP", 4) == 0
+            && h.version == PROGRAM_BINARY_VERSION && h.key == e.key;
+        if (ok) {
+            blob.resize(h.length);
+            ok = fread(blob.data(), 1, blob.size(), f) == blob.size();
+        }
+        fclose(f);
+        if (!ok) return false;
+        glProgramBinary(e.program, (GLenum)h.format, blob.data(), (GLsizei)blob.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(e.program, GL_LINK_STATUS, &linked);
+        if (linked) return true;
+        // the driver no longer takes it: start over from source
+        glDeleteProgram(e.program);
+        e.program = glCreateProgram();
+#endif
+        return false;
+    }
+
+    void save_binary(const Entry& e) {
+#ifdef PROGRAM_CACHE_BINARIES
+        if (!binaries_ || !e.shaders[0]) return; // loaded from the cache already
+        GLint length = 0;
+        glGetProgramiv(e.program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+        std::vector<char> blob((size_t)length);
+        GLenum format = 0;
+        glGetProgramBinary(e.program, length, &length, &format, blob.data());
+        ProgramBinaryHeader h;
+        memcpy(h.magic, "CGFP", 4);
+        h.version = PROGRAM_BINARY_VERSION;
+        h.key = e.key;
+        h.format = format;
+        h.length = (uint32_t)length;
+        FILE* f = fopen(path(e).c_str(), "wb");
+        if (!f) { std::cerr << "Cannot write program cache " << path(e) << "\n"; return; }
+        bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(blob.data(), 1, (size_t)length, f) == (size_t)length;
+        fclose(f);
+        if (!ok) remove(path(e).c_str());
+#endif
+    }
+
+    static void make_directory(const std::string& dir) {
+#ifdef _WIN32
+        _mkdir(dir.c_str());
+#else
+        mkdir(dir.c_str(), 0755);
+#endif
+    }
+
+    std::string dir_;
+    std::string driver_;
+    bool binaries_ = false;
+    bool parallel_ = false;
+    int hits_ = 0, misses_ = 0;
+    std::vector<Entry> entries_;
+};
@@ -0,0 +1,160 @@
+// render_target.h
+// Offscreen scene target with MSAA and a render scale, plus the dynamic
+// resolution controller that picks the scale from measured GPU time.
+//
+// The scene renders at round(scale * window) pixels into multisampled
+// colour / depth renderbuffers; present() resolves the samples into a
+// single-sample copy of the same size (a multisample blit cannot scale) and
+// then stretches that onto the window with a linear blit. Both blits are
+// skipped when they would be plain copies, so scale 1 without MSAA never
+// needs the target at all and the caller draws straight into the window.
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+#include "frame_profiler.h"
+
+// render size for a window size and scale, never below one pixel
+inline int scaled_size(int size, float scale) {
+    return std::max(1, (int)std::lround(size * scale));
+}
+
+struct ScaledTarget {
+    GLuint fbo = 0, color = 0, depth = 0;
+    GLuint resolveFbo = 0, resolveColor = 0; // only with samples > 1
+    int width = 0, height = 0, samples = 0;
+
+    // (Re)allocates for the given render size and sample count (0 / 1 = no
+    // MSAA, clamped to GL_MAX_SAMPLES); cheap when nothing changed.
+    bool resize(int w, int h, int requestedSamples) {
+        GLint maxSamples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        int s = requestedSamples > 1 ? std::min(requestedSamples, (int)maxSamples) : 0;
+        if (fbo && w == width && h == height && s == samples) return true;
+        destroy();
+        width = w; height = h; samples = s;
+
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, w, h);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, w, h);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+        if (ok && samples > 1) {
+            glGenRenderbuffers(1, &resolveColor);
+            glBindRenderbuffer(GL_RENDERBUFFER, resolveColor);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+            glGenFramebuffers(1, &resolveFbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, resolveFbo);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveColor);
+            ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!ok) std::cerr << "Scaled render target incomplete (" << w << "x" << h << ", " << samples << " samples)\n";
+        return ok;
+    }
+
+    void bind() const { glBindFramebuffer(GL_FRAMEBUFFER, fbo); }
+
+    // Resolves and scales the colour onto [0, w) x [0, h) of `target`
+    // (0 = window) and leaves it bound.
+    void present(GLuint target, int w, int h) const {
+        GLuint source = fbo;
+        if (samples > 1) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFbo);
+            glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            source = resolveFbo;
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, w, h, GL_COLOR_BUFFER_BIT,
+            w == width && h == height ? GL_NEAREST : GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+
+    void destroy() {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+        glDeleteFramebuffers(1, &resolveFbo);
+        glDeleteRenderbuffers(1, &resolveColor);
+        fbo = color = depth = resolveFbo = resolveColor = 0;
+        width = height = samples = 0;
+    }
+};
+
+// Keeps the GPU frame time under a budget by moving the render scale.
+// GPU time of the fill-bound passes goes roughly with the pixel count, i.e.
+// with scale^2, so one correction step aims straight at the scale that
+// would have met the budget. The scale moves in DYNAMIC_RES_STEP steps and
+// only when the smoothed time leaves the band [low, 1] x budget, and after
+// each change the samples still in flight (rendered at the old scale) are
+// ignored, so it does not oscillate or resize the targets every frame.
+const float DYNAMIC_RES_STEP = 0.05f;
+
+class DynamicResolution {
+public:
+    // budgetMs <= 0 disables the controller; scale starts at maxScale
+    void init(double budgetMs, float minScale = 0.5f, float maxScale = 1.0f) {
+        budgetMs_ = budgetMs;
+        minScale_ = std::min(minScale, maxScale);
+        maxScale_ = maxScale;
+        scale_ = maxScale;
+    }
+
+    bool enabled() const { return budgetMs_ > 0.0; }
+    float scale() const { return scale_; }
+    unsigned changes() const { return changes_; }
+
+    // Feeds the newest GPU time of `profiler` (its collection has to be on)
+    // and returns the scale for the frame about to be rendered.
+    float update(const FrameProfiler& profiler) {
+        uint64_t frame;
+        double gpuMs;
+        if (!enabled() || !profiler.latest_gpu(frame, gpuMs) || frame == lastSample_) return scale_;
+        lastSample_ = frame;
+        if (frame < settleFrame_ || gpuMs <= 0.0) return scale_;
+
+        smoothedMs_ = smoothedMs_ < 0.0 ? gpuMs : smoothedMs_ + SMOOTHING * (gpuMs - smoothedMs_);
+        if (smoothedMs_ <= budgetMs_ && smoothedMs_ >= budgetMs_ * LOW_FRACTION) return scale_;
+
+        // aim between the band's edges, so the new time lands inside it
+        double target = budgetMs_ * (1.0 + LOW_FRACTION) * 0.5;
+        float ideal = scale_ * (float)std::sqrt(target / smoothedMs_);
+        float next = std::round(ideal / DYNAMIC_RES_STEP) * DYNAMIC_RES_STEP;
+        next = std::min(maxScale_, std::max(minScale_, next));
+        if (next != scale_) {
+            scale_ = next;
+            ++changes_;
+            settleFrame_ = profiler.frame_index();
+            smoothedMs_ = -1.0;
+        }
+        return scale_;
+    }
+
+private:
+    static constexpr double SMOOTHING = 0.25;    // exponential average weight of a new sample
+    static constexpr double LOW_FRACTION = 0.75; // below this share of the budget, scale back up
+
+    double budgetMs_ = 0.0;
+    float minScale_ = 0.5f, maxScale_ = 1.0f;
+    float scale_ = 1.0f;
+    double smoothedMs_ = -1.0;
+    uint64_t lastSample_ = UINT64_MAX;
+    uint64_t settleFrame_ = 0; // first frame rendered at the current scale
+    unsigned changes_ = 0;
+};
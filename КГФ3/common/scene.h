@@ -0,0 +1,334 @@
+// scene.h
+// Several meshes, each drawn as any number of instances.
+//
+// Per-instance model and normal matrices live in a vertex buffer attached to
+// the mesh's VAO with an attribute divisor of 1, so every unique mesh is one
+// glDrawElementsInstanced call and the programs only take the view-projection
+// matrix. A single mesh with one instance renders exactly as before. The
+// uploaded model matrices include the mesh's position dequantization
+// (vertex_pack.h); `instances` keeps the plain object-to-world ones.
+//
+// Every frame the instance bounding spheres are culled against the view
+// frustum (frustum_cull.h) and only the visible instances are uploaded.
+// Each visible instance also picks a level of detail: the coarsest one whose
+// deviation, projected at the instance's distance, stays under a pixel
+// budget. The buffer is sorted by level, one instanced draw per (mesh, level).
+//
+// Instance lists stream through a fenced ring (stream_buffer.h) instead of
+// being orphaned. Meshes made dynamic get their vertices streamed the same
+// way, rewritten by the caller every frame.
+
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frustum_cull.h"
+#include "gl_mesh.h"
+#include "mesh_cache.h"
+#include "stream_buffer.h"
+
+// Instance attributes: a mat4 takes four consecutive locations, a mat3 three.
+const GLuint INSTANCE_MODEL_LOCATION = 2;   // 2..5
+const GLuint INSTANCE_NORMAL_LOCATION = 6;  // 6..8
+
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normalMatrix; // transpose(inverse(mat3(model)))
+};
+
+static_assert(sizeof(InstanceData) == 100, "instance attributes assume tightly packed matrices");
+
+inline InstanceData make_instance(const glm::mat4& model) {
+    InstanceData d;
+    d.model = model;
+    d.normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+    return d;
+}
+
+struct SceneMesh {
+    std::string path;
+    CachedMesh mesh;
+    GpuMesh gpu;
+    StreamBuffer instanceStream;
+    StreamBuffer vertexStream; // dynamic geometry only, see scene_mesh_make_dynamic
+    std::vector<InstanceData> instances;
+    std::vector<InstanceData> visible; // this frame's survivors, as uploaded, sorted by LOD
+    std::vector<GLsizei> lodFirst, lodDraw; // per level: range in `visible`
+    bool placeholder = false; // bounding box standing in while the mesh loads
+};
+
+struct Scene {
+    std::vector<std::unique_ptr<SceneMesh>> meshes; // CachedMesh may hold a mapping, so no copies
+    float radius = 1.0f; // bounding radius of all instances around the origin
+
+    // culling: one BVH over all instances; item i is instance
+    // instanceIndex[i] of mesh instanceMesh[i]
+    bool cull = true;
+    CullBvh bvh;
+    std::vector<uint32_t> instanceMesh, instanceIndex;
+    std::vector<BoundingSphere> bounds;
+    std::vector<uint32_t> visibleIds;
+    std::vector<uint32_t> drawKeys, uploadedKeys; // id << 4 | level
+    bool uploaded = false;
+    uint32_t layoutVersion = 0; // bumped whenever the instances change (gpu_culling.h rebuilds on it)
+};
+
+// Per-frame inputs of the LOD choice.
+struct LodSelection {
+    bool enabled = true;
+    glm::vec3 eye = glm::vec3(0.0f);
+    bool perspective = true;
+    // pixels per world unit: at distance 1 for perspective
+    // (viewportHeight / (2 tan(fovy / 2))), everywhere for ortho
+    float pixelsPerUnit = 1.0f;
+    float maxErrorPixels = 1.0f;
+};
+
+const uint32_t SCENE_MAX_LODS = 16; // level must fit the 4 key bits
+
+// Coarsest level whose projected error stays within the budget.
+inline uint32_t select_lod(const CachedMesh& mesh, const BoundingSphere& bounds, const LodSelection& sel) {
+    uint32_t levels = (uint32_t)std::min<size_t>(mesh.lodCount(), SCENE_MAX_LODS);
+    if (!sel.enabled || levels <= 1) return 0;
+    float scale = mesh.maxRadius() > 0.0f ? bounds.radius / mesh.maxRadius() : 1.0f;
+    float pixelsPerUnit = sel.pixelsPerUnit;
+    if (sel.perspective) {
+        float dist = glm::length(bounds.center - sel.eye) - bounds.radius;
+        if (dist <= 1e-4f) return 0; // the camera is inside the bounds
+        pixelsPerUnit /= dist;
+    }
+    uint32_t level = 0;
+    while (level + 1 < levels && mesh.lod(level + 1).error * scale * pixelsPerUnit <= sel.maxErrorPixels) ++level;
+    return level;
+}
+
+// Bounding sphere of a mesh under `model`: the transformed centroid, radius
+// scaled by the largest axis scale.
+inline BoundingSphere instance_bounds(const CachedMesh& mesh, const glm::mat4& model) {
+    float scale = std::max(glm::length(glm::vec3(model[0])),
+        std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    BoundingSphere s;
+    s.center = glm::vec3(model * glm::vec4(mesh.centroid(), 1.0f));
+    s.radius = mesh.maxRadius() * scale;
+    return s;
+}
+
+// Rebuilds the culling hierarchy; call whenever the instances change.
+inline void scene_build_bvh(Scene& scene) {
+    std::vector<BoundingSphere>& spheres = scene.bounds;
+    spheres.clear();
+    scene.instanceMesh.clear();
+    scene.instanceIndex.clear();
+    for (uint32_t m = 0; m < (uint32_t)scene.meshes.size(); ++m) {
+        const SceneMesh& sm = *scene.meshes[m];
+        for (uint32_t i = 0; i < (uint32_t)sm.instances.size(); ++i) {
+            spheres.push_back(instance_bounds(sm.mesh, sm.instances[i].model));
+            scene.instanceMesh.push_back(m);
+            scene.instanceIndex.push_back(i);
+        }
+    }
+    scene.bvh.build(spheres);
+    scene.uploaded = false;
+    ++scene.layoutVersion;
+}
+
+// Places `copies` instances of every mesh on a square grid in the XY plane,
+// each centered on its centroid and turned about Z by a golden-angle step so
+// neighbours differ. One mesh with one copy stays centered, unrotated.
+inline void scene_layout_grid(Scene& scene, int copies) {
+    float cellRadius = 0.0f;
+    for (auto& m : scene.meshes) cellRadius = std::max(cellRadius, m->mesh.maxRadius());
+    const float spacing = cellRadius * 2.2f;
+    const int total = (int)scene.meshes.size() * std::max(1, copies);
+    const int side = (int)std::ceil(std::sqrt((float)total));
+
+    scene.radius = cellRadius;
+    int cell = 0;
+    for (auto& m : scene.meshes) {
+        m->instances.clear();
+        for (int c = 0; c < std::max(1, copies); ++c, ++cell) {
+            glm::vec3 offset((cell % side - (side - 1) * 0.5f) * spacing,
+                (cell / side - (side - 1) * 0.5f) * spacing, 0.0f);
+            float angle = total > 1 ? cell * 2.39996323f : 0.0f;
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), offset);
+            model = glm::rotate(model, angle, glm::vec3(0.0f, 0.0f, 1.0f));
+            model = glm::translate(model, -m->mesh.centroid());
+            m->instances.push_back(make_instance(model));
+            scene.radius = std::max(scene.radius, glm::length(offset) + m->mesh.maxRadius());
+        }
+    }
+    scene_build_bvh(scene);
+}
+
+// Instance as the vertex shader sees it: positions arrive in [0, 1] and the
+// dequantization is the innermost transform. The normal matrix stays that of
+// the plain model matrix: normals are directions, not scaled to the AABB.
+inline InstanceData gpu_instance(const SceneMesh& m, const InstanceData& d) {
+    InstanceData g = d;
+    g.model = d.model * m.mesh.dequantizeMatrix();
+    return g;
+}
+
+// Points the instance attributes of the bound VAO at the instance buffer
+// (bound to GL_ARRAY_BUFFER), starting at byte `base`. GL 3.3 has no base
+// instance, so every LOD group re-points them instead.
+inline void bind_instance_attributes(size_t base) {
+    const GLsizei stride = sizeof(InstanceData);
+    for (GLuint c = 0; c < 4; ++c)
+        glVertexAttribPointer(INSTANCE_MODEL_LOCATION + c, 4, GL_FLOAT, GL_FALSE, stride,
+            (void*)(base + offsetof(InstanceData, model) + c * sizeof(glm::vec4)));
+    for (GLuint c = 0; c < 3; ++c)
+        glVertexAttribPointer(INSTANCE_NORMAL_LOCATION + c, 3, GL_FLOAT, GL_FALSE, stride,
+            (void*)(base + offsetof(InstanceData, normalMatrix) + c * sizeof(glm::vec3)));
+}
+
+// Uploads one mesh and its instance buffer.
+inline void scene_upload_mesh(SceneMesh& m) {
+    m.gpu = upload_indexed_mesh(m.mesh);
+    m.visible.clear();
+    for (auto& d : m.instances) m.visible.push_back(gpu_instance(m, d));
+    m.instanceStream.create(m.instances.size() * sizeof(InstanceData));
+    memcpy(m.instanceStream.map(), m.visible.data(), m.visible.size() * sizeof(InstanceData));
+    m.instanceStream.unmap();
+
+    glBindVertexArray(m.gpu.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m.instanceStream.buffer());
+    for (GLuint loc = INSTANCE_MODEL_LOCATION; loc < INSTANCE_NORMAL_LOCATION + 3; ++loc) {
+        glEnableVertexAttribArray(loc);
+        glVertexAttribDivisor(loc, 1);
+    }
+    bind_instance_attributes(m.instanceStream.offset());
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    size_t levels = std::min<size_t>(m.mesh.lodCount(), SCENE_MAX_LODS);
+    m.lodFirst.assign(levels, 0);
+    m.lodDraw.assign(levels, 0);
+    m.lodDraw[0] = (GLsizei)m.instances.size();
+}
+
+inline void scene_destroy_mesh(SceneMesh& m) {
+    m.instanceStream.destroy();
+    m.vertexStream.destroy();
+    destroy_gpu_mesh(m.gpu);
+}
+
+// Culls the instances against `viewProj`, picks their LODs and uploads the
+// visible ones grouped by level. The buffers are only rewritten when the
+// visible set or a level changed since last frame.
+inline void scene_cull(Scene& scene, const glm::mat4& viewProj, const LodSelection& lod) {
+    scene.visibleIds.clear();
+    if (scene.cull) scene.bvh.cull(frustum_from_matrix(viewProj), scene.visibleIds);
+    else for (uint32_t i = 0; i < (uint32_t)scene.instanceMesh.size(); ++i) scene.visibleIds.push_back(i);
+
+    scene.drawKeys.clear();
+    for (uint32_t id : scene.visibleIds) {
+        const SceneMesh& m = *scene.meshes[scene.instanceMesh[id]];
+        scene.drawKeys.push_back(id << 4 | select_lod(m.mesh, scene.bounds[id], lod));
+    }
+
+    if (scene.uploaded && scene.drawKeys == scene.uploadedKeys) return;
+    scene.uploadedKeys = scene.drawKeys;
+    scene.uploaded = true;
+
+    // counting sort by level within each mesh
+    for (auto& m : scene.meshes) std::fill(m->lodDraw.begin(), m->lodDraw.end(), 0);
+    for (uint32_t key : scene.drawKeys) scene.meshes[scene.instanceMesh[key >> 4]]->lodDraw[key & 15]++;
+    for (auto& m : scene.meshes) {
+        GLsizei next = 0;
+        for (size_t l = 0; l < m->lodDraw.size(); ++l) { m->lodFirst[l] = next; next += m->lodDraw[l]; }
+        m->visible.resize(next);
+        std::fill(m->lodDraw.begin(), m->lodDraw.end(), 0);
+    }
+    for (uint32_t key : scene.drawKeys) {
+        uint32_t id = key >> 4, level = key & 15;
+        SceneMesh& m = *scene.meshes[scene.instanceMesh[id]];
+        m.visible[m.lodFirst[level] + m.lodDraw[level]++] = gpu_instance(m, m.instances[scene.instanceIndex[id]]);
+    }
+
+    // into the next ring region; the GPU may still be drawing the previous ones
+    for (auto& m : scene.meshes) {
+        if (m->visible.empty()) continue;
+        memcpy(m->instanceStream.map(), m->visible.data(), m->visible.size() * sizeof(InstanceData));
+        m->instanceStream.unmap();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Dynamic geometry: after scene_upload_mesh, gives the mesh a vertex ring so its
+// vertices can be rewritten every frame. The indices (and LODs) stay static.
+inline void scene_mesh_make_dynamic(SceneMesh& m) {
+    m.vertexStream.create(m.mesh.vertexCount() * sizeof(SmfbVertex));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Returns vertexCount() vertices to fill for the next frame (write-only).
+// Positions are quantized to the mesh AABB, so they must stay inside it.
+inline SmfbVertex* scene_mesh_begin_vertices(SceneMesh& m) { return (SmfbVertex*)m.vertexStream.map(); }
+
+// Points the mesh's VAO at the vertices just written.
+inline void scene_mesh_end_vertices(SceneMesh& m) {
+    m.vertexStream.unmap();
+    glBindVertexArray(m.gpu.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m.vertexStream.buffer());
+    bind_vertex_attributes(m.vertexStream.offset());
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// One instanced draw per unique mesh and level, of whatever survived culling.
+// Fences the stream regions the draws read.
+inline void draw_scene(Scene& scene) {
+    for (auto& m : scene.meshes) {
+        glBindVertexArray(m->gpu.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m->instanceStream.buffer());
+        for (size_t l = 0; l < m->lodDraw.size(); ++l) {
+            if (m->lodDraw[l] == 0) continue;
+            const SmfbLod& lod = m->mesh.lod(l);
+            bind_instance_attributes(m->instanceStream.offset() + m->lodFirst[l] * sizeof(InstanceData));
+            glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)lod.indexCount, m->gpu.indexType,
+                (void*)((size_t)lod.firstIndex * m->mesh.indexSize()), m->lodDraw[l]);
+        }
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for (auto& m : scene.meshes) {
+        m->instanceStream.fence();
+        m->vertexStream.fence();
+    }
+}
+
+// vertices / triangles of the whole scene, every instance at full detail
+inline size_t scene_vertex_count(const Scene& scene) {
+    size_t n = 0;
+    for (auto& m : scene.meshes) n += m->mesh.vertexCount() * m->instances.size();
+    return n;
+}
+
+inline size_t scene_triangle_count(const Scene& scene) {
+    size_t n = 0;
+    for (auto& m : scene.meshes) n += m->mesh.faceCount() * m->instances.size();
+    return n;
+}
+
+// "a.smf,b.smf" for reports
+inline std::string scene_name(const Scene& scene) {
+    std::string name;
+    for (auto& m : scene.meshes) name += (name.empty() ? "" : ",") + m->path;
+    return name;
+}
+
+inline void destroy_scene(Scene& scene) {
+    for (auto& m : scene.meshes) scene_destroy_mesh(*m);
+    scene.meshes.clear();
+}
@@ -0,0 +1,68 @@
+// shader_variant.h
+// Specializes the viewers' lighting shaders on the C++ side.
+//
+// A ShaderVariant names everything that is fixed for a program: shading
+// model, light count, where the normal comes from, which shadow map light
+// 0 samples (shadow_map.h) and, for the deferred lighting passes, the size
+// of the material table the G-buffer indexes. The builder turns it
+// into #defines in front of the GLSL, and into a SUM_LIGHTS macro that spells
+// out one calcLight call per light, so each program is compiled with its
+// configuration folded in: no uniform-driven branches and no light loop. The
+// variant is part of the source, so the program cache keys each one apart.
+
+#pragma once
+
+#include <initializer_list>
+#include <string>
+
+enum ShadingModel { SHADING_GOURAUD, SHADING_PHONG, SHADING_FLAT };
+
+enum NormalSource {
+    NORMALS_OCTAHEDRAL,       // per-vertex attribute, oct-encoded (vertex_pack.h)
+    NORMALS_FROM_DERIVATIVES, // face normal from dFdx / dFdy of the position
+};
+
+enum ShadowKind { SHADOW_NONE, SHADOW_DIRECTIONAL, SHADOW_POINT, SHADOW_KIND_COUNT };
+
+struct ShaderVariant {
+    ShadingModel model;
+    int lightCount;
+    NormalSource normals;
+    ShadowKind shadow; // of light 0
+    int materialCount; // deferred: entries of the material table; 0 = one material block
+};
+
+// Flat shading needs no vertex normals; the other models read them. Shadows
+// are looked up per fragment, so Gouraud never gets them.
+constexpr ShaderVariant make_shader_variant(ShadingModel model, int lightCount, ShadowKind shadow = SHADOW_NONE) {
+    return { model, lightCount, model == SHADING_FLAT ? NORMALS_FROM_DERIVATIVES : NORMALS_OCTAHEDRAL,
+        model == SHADING_GOURAUD ? SHADOW_NONE : shadow, 0 };
+}
+
+// Deferred lighting passes: Phong from the G-buffer's normals, with the
+// material picked per pixel from a table of `materialCount`.
+constexpr ShaderVariant make_deferred_variant(int lightCount, int materialCount) {
+    return { SHADING_PHONG, lightCount, NORMALS_OCTAHEDRAL, SHADOW_NONE, materialCount };
+}
+
+// "#version" line, the variant's #defines, then the chunks in order. Every
+// switch is defined as 0 or 1, so the GLSL can test them with #if.
+inline std::string shader_variant_source(const ShaderVariant& v, std::initializer_list<const char*> chunks) {
+    std::string s = "#version 330 core\n";
+    s += "#define LIGHT_COUNT " + std::to_string(v.lightCount) + "\n";
+    s += "#define MATERIAL_COUNT " + std::to_string(v.materialCount) + "\n";
+    s += std::string("#define SHADING_GOURAUD ") + (v.model == SHADING_GOURAUD ? "1" : "0") + "\n";
+    s += std::string("#define SHADING_PHONG ") + (v.model == SHADING_PHONG ? "1" : "0") + "\n";
+    s += std::string("#define SHADING_FLAT ") + (v.model == SHADING_FLAT ? "1" : "0") + "\n";
+    s += std::string("#define NORMALS_OCTAHEDRAL ") + (v.normals == NORMALS_OCTAHEDRAL ? "1" : "0") + "\n";
+    s += std::string("#define SHADOW_DIRECTIONAL ") + (v.shadow == SHADOW_DIRECTIONAL ? "1" : "0") + "\n";
+    s += std::string("#define SHADOW_POINT ") + (v.shadow == SHADOW_POINT ? "1" : "0") + "\n";
+    s += "#define SUM_LIGHTS(pos, N) (vec3(0.0)";
+    for (int i = 0; i < v.lightCount; ++i) {
+        const char* visibility = i == 0 && v.shadow != SHADOW_NONE ? "shadowVisibility(pos, N)" : "1.0";
+        s += " + calcLight(lights[" + std::to_string(i) + "], pos, N, " + visibility + ")";
+    }
+    s += ")\n";
+    for (const char* c : chunks) s += c;
+    return s;
+}
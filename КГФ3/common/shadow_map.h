@@ -0,0 +1,190 @@
+// shadow_map.h
+// Depth maps for one shadow-casting light, re-rendered only when they change.
+//
+// A directional light (along the direction from the origin to the light)
+// gets one orthographic 2D map fitted around the scene radius; a point light
+// gets a depth cube map rendered with six 90-degree faces. Both textures use
+// GL_COMPARE_REF_TO_TEXTURE with linear filtering, so every lookup through a
+// sampler2DShadow / samplerCubeShadow is already a 2x2 PCF tap; the shaders
+// add a few more taps on top.
+//
+// The map only depends on the light, the shadow kind and the geometry, not on
+// the camera. needs_update() compares those against what the current map was
+// rendered with (the scene's layoutVersion stands in for the geometry), so
+// the usual interaction, moving the camera, costs no shadow pass at all.
+// Geometry that changes without a layout change (--deform) calls
+// invalidate() each frame.
+
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+#include "shader_variant.h"
+
+class ShadowMap {
+public:
+    static const int DEFAULT_SIZE = 2048;
+
+    // size: texels per side of the 2D map and of each cube face; textures
+    // are allocated on first use of each kind
+    bool create(int size = DEFAULT_SIZE) {
+        size_ = size;
+        glGenFramebuffers(1, &fbo_);
+        return fbo_ != 0;
+    }
+
+    bool needs_update(ShadowKind kind, const glm::vec3& lightPos, float sceneRadius, uint32_t layoutVersion) const {
+        return dirty_ || kind != kind_ || lightPos != lightPos_ || sceneRadius != sceneRadius_
+            || layoutVersion != layoutVersion_;
+    }
+
+    // The geometry moved in a way layoutVersion does not track.
+    void invalidate() { dirty_ = true; }
+
+    // Renders the map for `kind`. draw(viewProj, eye) must draw every caster
+    // with a depth-only program; it is called once per face with the shadow
+    // FBO and viewport set. Leaves the default framebuffer bound.
+    template <class DrawCasters>
+    void update(ShadowKind kind, const glm::vec3& lightPos, float sceneRadius, uint32_t layoutVersion, DrawCasters draw) {
+        if (kind == SHADOW_NONE || !allocate(kind)) return;
+        kind_ = kind;
+        lightPos_ = lightPos;
+        sceneRadius_ = sceneRadius;
+        layoutVersion_ = layoutVersion;
+        dirty_ = false;
+        ++updates_;
+
+        float r = sceneRadius * 1.05f;
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+        glViewport(0, 0, size_, size_);
+        // slope-scaled bias against acne; the shaders add a normal offset
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        if (kind == SHADOW_DIRECTIONAL) {
+            glm::vec3 dir = glm::length(lightPos) > 1e-4f ? glm::normalize(lightPos) : glm::vec3(0.0f, 0.0f, 1.0f);
+            glm::vec3 up = std::fabs(dir.z) > 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+            glm::vec3 eye = dir * (r * 2.0f);
+            nearFar_ = glm::vec2(r * 0.5f, r * 3.5f);
+            glm::mat4 viewProj = glm::ortho(-r, r, -r, r, nearFar_.x, nearFar_.y)
+                * glm::lookAt(eye, glm::vec3(0.0f), up);
+            // world -> [0, 1] texture coordinates and depth
+            matrix_ = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f))
+                * viewProj;
+            normalOffset_ = 1.5f * 2.0f * r / size_;
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, map2d_, 0);
+            if (check()) {
+                glClear(GL_DEPTH_BUFFER_BIT);
+                draw(viewProj, eye);
+            }
+        }
+        else {
+            // the far plane reaches the far side of the scene from the light
+            nearFar_ = glm::vec2(std::max(1e-3f, r * 0.01f), glm::length(lightPos) + r * 1.5f);
+            glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, nearFar_.x, nearFar_.y);
+            // GL cube face orientation: +X, -X, +Y, -Y, +Z, -Z
+            static const glm::vec3 dirs[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+            static const glm::vec3 ups[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+            normalOffset_ = 1.5f * 2.0f * nearFar_.y * 0.5f / size_; // a texel at half the far distance
+            for (int f = 0; f < 6; ++f) {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, cube_, 0);
+                if (!check()) break;
+                glClear(GL_DEPTH_BUFFER_BIT);
+                draw(proj * glm::lookAt(lightPos, lightPos + dirs[f], ups[f]), lightPos);
+            }
+        }
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Binds the map of the current kind (uShadowMap or uShadowCube).
+    void bind(GLuint unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        if (kind_ == SHADOW_DIRECTIONAL) glBindTexture(GL_TEXTURE_2D, map2d_);
+        else if (kind_ == SHADOW_POINT) glBindTexture(GL_TEXTURE_CUBE_MAP, cube_);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    int size() const { return size_; }
+    ShadowKind kind() const { return kind_; }
+    const glm::mat4& matrix() const { return matrix_; }     // directional: world -> shadow coords
+    const glm::vec3& light_position() const { return lightPos_; }
+    const glm::vec2& near_far() const { return nearFar_; }  // point: the cube faces' depth range
+    float normal_offset() const { return normalOffset_; }   // world units, about 1.5 texels
+    uint64_t updates() const { return updates_; }           // shadow passes rendered so far
+
+    void destroy() {
+        glDeleteFramebuffers(1, &fbo_);
+        glDeleteTextures(1, &map2d_);
+        glDeleteTextures(1, &cube_);
+        fbo_ = map2d_ = cube_ = 0;
+        kind_ = SHADOW_NONE;
+    }
+
+private:
+    bool allocate(ShadowKind kind) {
+        if (kind == SHADOW_DIRECTIONAL && !map2d_) {
+            glGenTextures(1, &map2d_);
+            glBindTexture(GL_TEXTURE_2D, map2d_);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size_, size_, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+            set_compare(GL_TEXTURE_2D);
+            // outside the map counts as lit
+            const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, white);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        if (kind == SHADOW_POINT && !cube_) {
+            glGenTextures(1, &cube_);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cube_);
+            for (int f = 0; f < 6; ++f)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_DEPTH_COMPONENT24, size_, size_, 0,
+                    GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+            set_compare(GL_TEXTURE_CUBE_MAP);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+            glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS); // PCF taps cross face edges
+        }
+        if (!fbo_ || (kind == SHADOW_DIRECTIONAL ? !map2d_ : !cube_)) return false;
+        // depth only
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return true;
+    }
+
+    static void set_compare(GLenum target) {
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+
+    static bool check() {
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) return true;
+        std::cerr << "Shadow map framebuffer incomplete\n";
+        return false;
+    }
+
+    int size_ = DEFAULT_SIZE;
+    GLuint fbo_ = 0, map2d_ = 0, cube_ = 0;
+    ShadowKind kind_ = SHADOW_NONE;
+    glm::vec3 lightPos_ = glm::vec3(0.0f);
+    float sceneRadius_ = -1.0f;
+    uint32_t layoutVersion_ = 0;
+    bool dirty_ = true;
+    glm::mat4 matrix_ = glm::mat4(1.0f);
+    glm::vec2 nearFar_ = glm::vec2(0.1f, 1.0f);
+    float normalOffset_ = 0.0f;
+    uint64_t updates_ = 0;
+};
@@ -0,0 +1,232 @@
+// smf_loader.h
+// Shared SMF loader for both viewers.
+// The file is memory-mapped and parsed in place: no getline / istringstream,
+// no locale, and the output vectors are sized from a counting pre-pass.
+// Large files are split at line boundaries and the chunks parsed in parallel,
+// straight into the SoA arrays of a Mesh (mesh.h).
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mesh.h"
+#include "parallel.h"
+
+// --- byte-level number parsing ---
+inline bool smf_is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char* smf_skip_spaces(const char* p, const char* end) {
+    while (p < end && smf_is_space(*p)) ++p;
+    return p;
+}
+
+inline const char* smf_skip_line(const char* p, const char* end) {
+    const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+    return nl ? nl + 1 : end;
+}
+
+// Returns the position after the number, or nullptr if there is none.
+inline const char* smf_parse_uint(const char* p, const char* end, unsigned& out) {
+    p = smf_skip_spaces(p, end);
+    if (p < end && *p == '+') ++p;
+    if (p == end || (unsigned)(*p - '0') > 9) return nullptr;
+    uint64_t v = 0;
+    while (p < end && (unsigned)(*p - '0') <= 9) v = v * 10 + (unsigned)(*p++ - '0');
+    out = (unsigned)v;
+    return p;
+}
+
+inline const char* smf_parse_float(const char* p, const char* end, float& out) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    p = smf_skip_spaces(p, end);
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+
+    uint64_t mantissa = 0;
+    int exp10 = 0, digits = 0;
+    bool any = false;
+    for (; p < end && (unsigned)(*p - '0') <= 9; ++p, any = true) {
+        if (digits < 19) { mantissa = mantissa * 10 + (unsigned)(*p - '0'); if (mantissa) ++digits; }
+        else ++exp10; // drop digits beyond uint64 precision
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && (unsigned)(*p - '0') <= 9; ++p, any = true) {
+            if (digits < 19) { mantissa = mantissa * 10 + (unsigned)(*p - '0'); if (mantissa) ++digits; --exp10; }
+        }
+    }
+    if (!any) return nullptr;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool eneg = false;
+        if (q < end && (*q == '-' || *q == '+')) eneg = (*q++ == '-');
+        if (q < end && (unsigned)(*q - '0') <= 9) {
+            int e = 0;
+            while (q < end && (unsigned)(*q - '0') <= 9) { if (e < 10000) e = e * 10 + (*q - '0'); ++q; }
+            exp10 += eneg ? -e : e;
+            p = q;
+        }
+    }
+
+    double v = (double)mantissa;
+    while (exp10 > 22) { v *= 1e22; exp10 -= 22; }
+    while (exp10 < -22) { v /= 1e22; exp10 += 22; }
+    v = exp10 >= 0 ? v * pow10[exp10] : v / pow10[-exp10];
+    out = (float)(neg ? -v : v);
+    return p;
+}
+
+// --- record parsing ---
+
+// Counts 'v' and 'f' records in [begin, end); used to reserve before parsing.
+inline void smf_count_records(const char* begin, const char* end, size_t& vcount, size_t& fcount) {
+    vcount = fcount = 0;
+    for (const char* p = begin; p < end; p = smf_skip_line(p, end)) {
+        p = smf_skip_spaces(p, end);
+        if (end - p < 2 || !smf_is_space(p[1])) continue;
+        if (*p == 'v') ++vcount;
+        else if (*p == 'f') ++fcount;
+    }
+}
+
+// Parses the records in [begin, end) into the given slices, which must hold
+// exactly the counts returned by smf_count_records for the same range.
+// Face indices are converted from SMF's 1-based to 0-based. They are global
+// to the file, so a chunk needs no offset beyond where its slice starts.
+// Other record types (comments, bind, colors, ...) are skipped, as before.
+// Returns false on a malformed 'v' or 'f' record. `position(x, y, z)` stores
+// the vertices in order.
+template <typename PositionSink>
+inline bool smf_parse_records_into(const char* begin, const char* end, PositionSink position, glm::uvec3* faces) {
+    for (const char* p = begin; p < end; p = smf_skip_line(p, end)) {
+        p = smf_skip_spaces(p, end);
+        if (end - p < 2 || !smf_is_space(p[1])) continue;
+
+        if (*p == 'v') {
+            float x, y, z;
+            const char* q = p + 1;
+            if (!(q = smf_parse_float(q, end, x)) || !(q = smf_parse_float(q, end, y)) ||
+                !(q = smf_parse_float(q, end, z))) return false;
+            position(x, y, z);
+        }
+        else if (*p == 'f') {
+            unsigned a, b, c;
+            const char* q = p + 1;
+            if (!(q = smf_parse_uint(q, end, a)) || !(q = smf_parse_uint(q, end, b)) ||
+                !(q = smf_parse_uint(q, end, c))) return false;
+            *faces++ = glm::uvec3(a - 1, b - 1, c - 1);
+        }
+    }
+    return true;
+}
+
+inline bool smf_parse_records(const char* begin, const char* end, glm::vec3* positions, glm::uvec3* faces) {
+    return smf_parse_records_into(begin, end, [&](float x, float y, float z) { *positions++ = glm::vec3(x, y, z); },
+        faces);
+}
+
+inline bool smf_parse_records(const char* begin, const char* end, float* px, float* py, float* pz, glm::uvec3* faces) {
+    return smf_parse_records_into(begin, end, [&](float x, float y, float z) { *px++ = x; *py++ = y; *pz++ = z; },
+        faces);
+}
+
+// Every face must reference an existing vertex (SMF indices start at 1).
+inline bool smf_validate_faces(const glm::uvec3* faces, size_t faceCount, size_t vertexCount) {
+    for (size_t i = 0; i < faceCount; ++i) {
+        const glm::uvec3& f = faces[i];
+        if (f.x >= vertexCount || f.y >= vertexCount || f.z >= vertexCount) return false;
+    }
+    return true;
+}
+
+// Files below this size are parsed on the calling thread; above it the
+// thread start-up cost is negligible compared to the parse itself.
+const size_t SMF_PARALLEL_MIN_BYTES = 4u << 20;
+
+// Splits [begin, end) into at most `count` ranges that start at line beginnings.
+inline std::vector<const char*> smf_split_lines(const char* begin, const char* end, size_t count) {
+    std::vector<const char*> cuts;
+    cuts.push_back(begin);
+    size_t total = (size_t)(end - begin);
+    for (size_t i = 1; i < count; ++i) {
+        const char* p = begin + total * i / count;
+        if (p <= cuts.back()) continue;
+        p = smf_skip_line(p - 1, end); // next line start at or after p
+        if (p >= end) break;
+        if (p > cuts.back()) cuts.push_back(p);
+    }
+    cuts.push_back(end);
+    return cuts;
+}
+
+// --- SMF model loading ---
+// threads == 0 picks automatically: one chunk for small files, otherwise one
+// chunk per pool thread (parsed on thread_pool()). threads == 1 forces serial.
+// `out` is allocated once, from the counting pass.
+inline bool load_smf(const std::string& filename, Mesh& out, unsigned threads = 0) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        std::cerr << "Cannot open file: " << filename << "\n";
+        return false;
+    }
+
+    if (threads == 0)
+        threads = file.size() < SMF_PARALLEL_MIN_BYTES ? 1 : thread_pool().size() + 1;
+    std::vector<const char*> cuts = smf_split_lines(file.data(), file.end(), threads);
+    size_t chunks = cuts.size() - 1;
+
+    // pass 1: per-chunk record counts, prefix-summed into output offsets
+    std::vector<size_t> vfirst(chunks + 1, 0), ffirst(chunks + 1, 0);
+    thread_pool().parallel_for(chunks, [&](size_t c) {
+        smf_count_records(cuts[c], cuts[c + 1], vfirst[c + 1], ffirst[c + 1]);
+    });
+    for (size_t c = 0; c < chunks; ++c) {
+        vfirst[c + 1] += vfirst[c];
+        ffirst[c + 1] += ffirst[c];
+    }
+
+    // pass 2: every chunk parses straight into its own slice of the output
+    Mesh mesh;
+    if (!mesh.allocate(vfirst[chunks], ffirst[chunks])) {
+        std::cerr << "Out of memory loading " << filename << "\n";
+        return false;
+    }
+    std::vector<char> ok(chunks, 0);
+    thread_pool().parallel_for(chunks, [&](size_t c) {
+        size_t v = vfirst[c];
+        ok[c] = smf_parse_records(cuts[c], cuts[c + 1], mesh.px + v, mesh.py + v, mesh.pz + v,
+            mesh.faces() + ffirst[c]) &&
+            smf_validate_faces(mesh.faces() + ffirst[c], ffirst[c + 1] - ffirst[c], mesh.vertexCount);
+    });
+    for (size_t c = 0; c < chunks; ++c) {
+        if (!ok[c]) {
+            std::cerr << "Malformed SMF record or face index out of range in " << filename << "\n";
+            return false;
+        }
+    }
+
+    out = std::move(mesh);
+    return true;
+}
+
+inline bool load_smf(const std::string& filename,
+    std::vector<glm::vec3>& out_positions,
+    std::vector<glm::uvec3>& out_faces,
+    unsigned threads = 0)
+{
+    Mesh mesh;
+    if (!load_smf(filename, mesh, threads)) return false;
+    out_positions = mesh_positions(mesh);
+    out_faces = mesh_faces(mesh);
+    return true;
+}
@@ -0,0 +1,44 @@
+// spsc_queue.h
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Each side owns one index; the other side only reads it, with
+// acquire / release ordering publishing the slot contents.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // Producer side. Moves from `value` only when there is room.
+    bool push(T&& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity) return false;
+        slots_[tail & (Capacity - 1)] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; false when empty.
+    bool pop(T& out) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return false;
+        out = std::move(slots_[head & (Capacity - 1)]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+
+private:
+    // each index on its own cache line, so the two threads do not false-share
+    std::atomic<size_t> head_{ 0 };
+    char padHead_[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_{ 0 };
+    char padTail_[64 - sizeof(std::atomic<size_t>)];
+    T slots_[Capacity];
+};
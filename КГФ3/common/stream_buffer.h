@@ -0,0 +1,139 @@
+// stream_buffer.h
+// Ring of STREAM_REGIONS regions in one buffer object for data the CPU
+// rewrites every frame (dynamic geometry, per-frame instance lists).
+//
+// With GL 4.4 / ARB_buffer_storage the buffer is allocated immutable and
+// mapped once, persistent and coherent; otherwise every region is mapped
+// unsynchronized when it is written. Either way a fence is placed after the
+// draws that read a region and waited on before the region is written again,
+// so the CPU fills frame N+2 while the GPU still reads frame N and nothing is
+// ever orphaned or implicitly synchronized.
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define STREAM_BUFFER_STORAGE 1
+#endif
+
+inline bool stream_buffer_storage_supported() {
+    bool supported = false;
+#ifdef GL_VERSION_4_4
+    supported = supported || GLAD_GL_VERSION_4_4;
+#endif
+#ifdef GL_ARB_buffer_storage
+    supported = supported || GLAD_GL_ARB_buffer_storage;
+#endif
+    return supported;
+}
+
+class StreamBuffer {
+public:
+    static const int STREAM_REGIONS = 3;
+
+    // regionSize: bytes written per frame. Leaves the buffer bound to GL_ARRAY_BUFFER.
+    bool create(size_t regionSize, bool allowPersistent = true) {
+        destroy();
+        regionSize_ = (regionSize + 255) & ~(size_t)255; // keeps every region offset aligned for any attribute
+        if (regionSize_ == 0) regionSize_ = 256;
+        persistent_ = allowPersistent && stream_buffer_storage_supported();
+
+        glGenBuffers(1, &buffer_);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+        GLsizeiptr total = (GLsizeiptr)(regionSize_ * STREAM_REGIONS);
+#ifdef STREAM_BUFFER_STORAGE
+        if (persistent_) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, total, nullptr, flags);
+            mapped_ = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags);
+            if (!mapped_) {
+                std::cerr << "Persistent mapping failed, streaming through glMapBufferRange\n";
+                glDeleteBuffers(1, &buffer_);
+                glGenBuffers(1, &buffer_);
+                glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+                persistent_ = false;
+            }
+        }
+#endif
+        if (!persistent_) glBufferData(GL_ARRAY_BUFFER, total, nullptr, GL_STREAM_DRAW);
+        region_ = STREAM_REGIONS - 1; // the first map() lands on region 0
+        return buffer_ != 0;
+    }
+
+    // Advances to the next region and returns it for writing (regionSize
+    // bytes, write-only: the memory may be uncached). Blocks only if the GPU
+    // is still reading that region, i.e. more than two frames behind.
+    void* map() {
+        region_ = (region_ + 1) % STREAM_REGIONS;
+        wait(fences_[region_]);
+        if (persistent_) return mapped_ + offset();
+        glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+        return glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr)offset(), (GLsizeiptr)regionSize_,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    }
+
+    // Ends the write started by map(); coherent mappings need nothing.
+    void unmap() {
+        if (persistent_) return;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+
+    // Call after the last draw of the frame that reads the current region.
+    void fence() {
+        if (!buffer_) return;
+        if (fences_[region_]) glDeleteSync(fences_[region_]);
+        fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // byte offset of the region last returned by map()
+    size_t offset() const { return (size_t)region_ * regionSize_; }
+    GLuint buffer() const { return buffer_; }
+    bool persistent() const { return persistent_; }
+    size_t region_size() const { return regionSize_; }
+    // map() calls that had to wait for the GPU
+    uint64_t stalls() const { return stalls_; }
+
+    void destroy() {
+        for (auto& f : fences_) {
+            if (f) glDeleteSync(f);
+            f = nullptr;
+        }
+        if (buffer_) {
+            if (persistent_) {
+                glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+            }
+            glDeleteBuffers(1, &buffer_);
+        }
+        buffer_ = 0;
+        mapped_ = nullptr;
+        persistent_ = false;
+    }
+
+private:
+    void wait(GLsync& f) {
+        if (!f) return;
+        GLenum r = glClientWaitSync(f, 0, 0);
+        if (r == GL_TIMEOUT_EXPIRED) {
+            ++stalls_;
+            do r = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            while (r == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(f);
+        f = nullptr;
+    }
+
+    GLuint buffer_ = 0;
+    size_t regionSize_ = 0;
+    int region_ = 0;
+    bool persistent_ = false;
+    char* mapped_ = nullptr;
+    GLsync fences_[STREAM_REGIONS] = {};
+    uint64_t stalls_ = 0;
+};
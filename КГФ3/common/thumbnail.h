@@ -0,0 +1,320 @@
+// thumbnail.h
+// Batch preview images: asynchronous pixel readback and PNG output.
+//
+// ThumbnailWriter::capture() starts a glReadPixels into one of a small ring
+// of pixel-pack buffers and fences it, so the GL thread goes straight on to
+// the next mesh. poll() maps the buffers whose fence has signalled, copies
+// the pixels out and hands them to an encoder thread that flips the rows
+// (GL reads bottom-up) and writes the PNG. The tree has no zlib, so the PNGs
+// use stored (uncompressed) deflate blocks: valid for every reader, a little
+// larger than a compressed file.
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+inline bool is_directory(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+inline void make_directory(const std::string& dir) {
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+}
+
+inline bool has_smf_extension(const std::string& name) {
+    if (name.size() < 4) return false;
+    std::string ext = name.substr(name.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+    return ext == ".smf";
+}
+
+// The .smf files directly inside `dir`, sorted by name.
+inline std::vector<std::string> list_smf_files(const std::string& dir) {
+    std::vector<std::string> files;
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((dir + "\\*.smf").c_str(), &entry);
+    if (find != INVALID_HANDLE_VALUE) {
+        do
+            if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) files.push_back(dir + "/" + entry.cFileName);
+        while (FindNextFileA(find, &entry));
+        FindClose(find);
+    }
+#else
+    if (DIR* d = opendir(dir.c_str())) {
+        while (dirent* entry = readdir(d)) {
+            std::string path = dir + "/" + entry->d_name;
+            if (has_smf_extension(entry->d_name) && !is_directory(path)) files.push_back(path);
+        }
+        closedir(d);
+    }
+#endif
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// out_dir/name.png for .../name.smf, or name-2.png, name-3.png, ... when an
+// earlier file (same name in another directory) already took it. `taken`
+// holds the names handed out so far, lower case for case-insensitive disks.
+inline std::string thumbnail_path(const std::string& outDir, const std::string& meshPath, std::set<std::string>& taken) {
+    size_t slash = meshPath.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? meshPath : meshPath.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos && dot > 0) name.resize(dot);
+    std::string unique = name;
+    for (int n = 2;; ++n) {
+        std::string key = unique;
+        std::transform(key.begin(), key.end(), key.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+        if (taken.insert(key).second) break;
+        unique = name + "-" + std::to_string(n);
+    }
+    return outDir + "/" + unique + ".png";
+}
+
+inline uint32_t png_crc(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static uint32_t table[256];
+    static bool built = false; // only ever first used on the encoder thread
+    if (!built) {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        built = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// RGBA8 rows, bottomUp as glReadPixels leaves them.
+inline bool write_png(const std::string& path, int width, int height, const uint8_t* rgba, bool bottomUp) {
+    // zlib stream of stored blocks over the filter-0 scanlines
+    const size_t row = (size_t)width * 4;
+    std::vector<uint8_t> raw((row + 1) * height);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* src = rgba + row * (bottomUp ? height - 1 - y : y);
+        raw[(row + 1) * y] = 0;
+        std::copy(src, src + row, raw.begin() + (row + 1) * y + 1);
+    }
+    const size_t maxBlock = 65535;
+    std::vector<uint8_t> z;
+    z.reserve(raw.size() + raw.size() / maxBlock * 5 + 16);
+    z.push_back(0x78); z.push_back(0x01);
+    size_t pos = 0;
+    do {
+        size_t n = std::min(maxBlock, raw.size() - pos);
+        z.push_back(pos + n == raw.size() ? 1 : 0);
+        z.push_back((uint8_t)n); z.push_back((uint8_t)(n >> 8));
+        z.push_back((uint8_t)~n); z.push_back((uint8_t)(~n >> 8));
+        z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + n);
+        pos += n;
+    } while (pos < raw.size());
+    uint32_t a = 1, b = 0;
+    for (uint8_t c : raw) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    uint32_t adler = (b << 16) | a;
+    for (int s = 24; s >= 0; s -= 8) z.push_back((uint8_t)(adler >> s));
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = true;
+    auto chunk = [&](const char* type, const uint8_t* data, size_t size) {
+        uint8_t head[8] = { (uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size,
+            (uint8_t)type[0], (uint8_t)type[1], (uint8_t)type[2], (uint8_t)type[3] };
+        uint32_t crc = png_crc(data, size, png_crc(head + 4, 4));
+        uint8_t tail[4] = { (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc };
+        ok = ok && fwrite(head, 1, 8, f) == 8 && (size == 0 || fwrite(data, 1, size, f) == size) && fwrite(tail, 1, 4, f) == 4;
+    };
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    ok = fwrite(signature, 1, 8, f) == 8;
+    uint8_t ihdr[13] = { (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+        (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+        8, 6, 0, 0, 0 }; // 8-bit RGBA, deflate, adaptive filters, no interlace
+    chunk("IHDR", ihdr, sizeof(ihdr));
+    chunk("IDAT", z.data(), z.size());
+    chunk("IEND", nullptr, 0);
+    ok = fclose(f) == 0 && ok;
+    if (!ok) remove(path.c_str());
+    return ok;
+}
+
+class ThumbnailWriter {
+public:
+    ~ThumbnailWriter() { stop_encoder(); }
+
+    void start() {
+        stop_ = false;
+        encoder_ = std::thread([this] { run(); });
+    }
+
+    // GL thread: reads the colour of `fbo` ([0, w) x [0, h)) for `path`.
+    // Only waits when every buffer of the ring is still in flight.
+    void capture(GLuint fbo, int w, int h, const std::string& path) {
+        Readback& r = ring_[next_];
+        next_ = (next_ + 1) % READBACK_RING;
+        if (r.fence) retire(r, true);
+        size_t bytes = (size_t)w * h * 4;
+        if (!r.pbo) glGenBuffers(1, &r.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+        if (bytes > r.capacity) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+            r.capacity = bytes;
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        r.width = w; r.height = h;
+        r.path = path;
+    }
+
+    // GL thread: passes finished readbacks to the encoder; never blocks.
+    void poll() {
+        for (int i = 0; i < READBACK_RING; ++i) {
+            Readback& r = ring_[(next_ + i) % READBACK_RING]; // oldest first
+            if (r.fence) retire(r, false);
+        }
+    }
+
+    // GL thread: waits for every readback and every PNG, then frees the buffers.
+    void finish() {
+        for (int i = 0; i < READBACK_RING; ++i) {
+            Readback& r = ring_[(next_ + i) % READBACK_RING];
+            if (r.fence) retire(r, true);
+            glDeleteBuffers(1, &r.pbo);
+            r = Readback();
+        }
+        stop_encoder();
+    }
+
+    // a file that never reached capture(), e.g. it did not load
+    void note_failure() { ++failed_; }
+
+    int written() const { return written_; }
+    int failed() const { return failed_; }
+
+private:
+    static const int READBACK_RING = 3;
+
+    struct Readback {
+        GLuint pbo = 0;
+        size_t capacity = 0;
+        GLsync fence = nullptr;
+        int width = 0, height = 0;
+        std::string path;
+    };
+
+    struct Image {
+        int width, height;
+        std::string path;
+        std::vector<uint8_t> pixels;
+    };
+
+    // wait: block until the fence signals, however long the GPU takes
+    void retire(Readback& r, bool wait) {
+        GLenum s = glClientWaitSync(r.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0);
+        while (s == GL_TIMEOUT_EXPIRED && wait) s = glClientWaitSync(r.fence, 0, 1000000000ull);
+        if (s == GL_TIMEOUT_EXPIRED) return;
+        glDeleteSync(r.fence);
+        r.fence = nullptr;
+        if (s == GL_WAIT_FAILED) {
+            std::cerr << "Cannot wait for the read back of " << r.path << "\n";
+            ++failed_;
+            return;
+        }
+
+        Image image;
+        image.width = r.width; image.height = r.height;
+        image.path = r.path;
+        size_t bytes = (size_t)r.width * r.height * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+        const uint8_t* p = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+        if (p) image.pixels.assign(p, p + bytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (!p) {
+            std::cerr << "Cannot read back " << r.path << "\n";
+            ++failed_;
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(image));
+        }
+        cv_.notify_one();
+    }
+
+    void run() {
+        for (;;) {
+            Image image;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (queue_.empty()) return; // stopping, and everything is written
+                image = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            if (write_png(image.path, image.width, image.height, image.pixels.data(), true)) ++written_;
+            else {
+                std::cerr << "Cannot write " << image.path << "\n";
+                ++failed_;
+            }
+        }
+    }
+
+    void stop_encoder() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        if (encoder_.joinable()) encoder_.join();
+    }
+
+    Readback ring_[READBACK_RING];
+    int next_ = 0;
+    std::thread encoder_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Image> queue_;
+    bool stop_ = false;
+    std::atomic<int> written_{ 0 }, failed_{ 0 };
+};
@@ -0,0 +1,77 @@
+// vertex_pack.h
+// Compact vertex encodings used by the .smfb cache and the vertex buffers.
+//
+// Positions are 16-bit unsigned normalized, quantized to the mesh AABB; the
+// GPU reads them as [0, 1] and the offset / scale back to object space is
+// folded into the model matrix (see aabb_dequantize_matrix), so the vertex
+// shader dequantizes for free. Normals are octahedral-encoded (Cigolle et al.
+// 2014) into two 16-bit signed normalized values.
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+inline uint16_t quantize_unorm16(float t) {
+    t = std::min(1.0f, std::max(0.0f, t));
+    return (uint16_t)(t * 65535.0f + 0.5f);
+}
+
+inline int16_t quantize_snorm16(float t) {
+    t = std::min(1.0f, std::max(-1.0f, t));
+    return (int16_t)std::floor(t * 32767.0f + 0.5f);
+}
+
+// AABB extent with empty axes widened to 1, so flat meshes still divide.
+inline glm::vec3 aabb_quantize_extent(const glm::vec3& bmin, const glm::vec3& bmax) {
+    glm::vec3 e = bmax - bmin;
+    for (int i = 0; i < 3; ++i)
+        if (!(e[i] > 0.0f)) e[i] = 1.0f;
+    return e;
+}
+
+inline void quantize_position(const glm::vec3& p, const glm::vec3& bmin, const glm::vec3& extent, uint16_t out[3]) {
+    for (int i = 0; i < 3; ++i) out[i] = quantize_unorm16((p[i] - bmin[i]) / extent[i]);
+}
+
+// Object space position of an encoded [0, 1]^3 position: p = bmin + q * extent.
+inline glm::mat4 aabb_dequantize_matrix(const glm::vec3& bmin, const glm::vec3& extent) {
+    glm::mat4 m(1.0f);
+    m[0][0] = extent.x;
+    m[1][1] = extent.y;
+    m[2][2] = extent.z;
+    m[3] = glm::vec4(bmin.x, bmin.y, bmin.z, 1.0f);
+    return m;
+}
+
+// Unit vector to the octahedron, unfolded onto [-1, 1]^2. A zero vector
+// encodes as (0, 0), which decodes to +Z.
+inline void oct_encode(const glm::vec3& n, int16_t out[2]) {
+    float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    float x = 0.0f, y = 0.0f;
+    if (l1 > 0.0f) {
+        x = n.x / l1;
+        y = n.y / l1;
+        if (n.z < 0.0f) {
+            float fx = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float fy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = fx;
+            y = fy;
+        }
+    }
+    out[0] = quantize_snorm16(x);
+    out[1] = quantize_snorm16(y);
+}
+
+// CPU mirror of the shaders' octDecode().
+inline glm::vec3 oct_decode(const int16_t in[2]) {
+    float x = std::max(-1.0f, in[0] / 32767.0f), y = std::max(-1.0f, in[1] / 32767.0f);
+    glm::vec3 n(x, y, 1.0f - std::fabs(x) - std::fabs(y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
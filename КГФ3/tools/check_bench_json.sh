@@ -0,0 +1,30 @@
+#!/bin/sh
+# check_bench_json.sh
+# Run: tools/check_bench_json.sh ./part2 bound-bunny_200.smf [./part1] [scan.smfp]
+#
+# Under --bench, stdout has to be exactly one JSON object; every diagnostic
+# goes to stderr. Runs short benches with the options that print while
+# loading and pipes each stdout through a JSON parser. Exits non-zero on the
+# first run that fails or prints anything else.
+
+part2="$1"; model="$2"; part1="$3"; paged="$4"
+if [ -z "$part2" ] || [ -z "$model" ]; then
+    echo "Usage: $0 ./part2 model.smf [./part1] [scan.smfp]" >&2
+    exit 2
+fi
+
+check() {
+    echo "== $*" >&2
+    if ! "$@" --bench --bench-frames 20 --bench-size 320x240 2>/dev/null | python3 -m json.tool > /dev/null; then
+        echo "FAILED: $* printed invalid JSON" >&2
+        exit 1
+    fi
+}
+
+check "$part2" "$model"
+check "$part2" --profile --optimize --lods 3 --adjacency "$model"
+check "$part2" --profile --shading 2 --depth-prepass --shadows point "$model"
+check "$part2" --profile --shading 4 --msaa 4 --dynamic-res 8 "$model"
+if [ -n "$paged" ]; then check "$part2" --profile --paged "$paged"; fi
+if [ -n "$part1" ]; then check "$part1" --profile --lods 3 "$model"; fi
+echo "bench JSON ok" >&2
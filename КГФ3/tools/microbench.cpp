@@ -0,0 +1,371 @@
+// microbench.cpp
+// Build: g++ -O2 microbench.cpp -pthread -I/path/to/glm -lbenchmark -o microbench
+//        (add -DMICROBENCH_GL ../cgf3part2/cgf3part2/glad.c -lglfw -lGL -ldl -I/path/to/glad/include for the GL stage)
+// Run:   ./microbench [--max-faces 1000000] [--data-dir DIR] --benchmark_out=baseline.json --benchmark_out_format=json
+//        then compare two baselines with Google Benchmark's tools/compare.py benchmarks old.json new.json
+//
+// Micro-benchmarks of the load and preprocessing stages on synthetic meshes
+// of 10^3, 10^4, ... faces up to --max-faces (at most 10^8; the largest
+// need several GB of memory and disk). Each mesh is a wavy height-field grid,
+// written once as DIR/synthetic_<faces>.smf and reused by later runs:
+//   parse      load_smf, serial and on the thread pool
+//   normals    compute_vertex_normals, per weighting
+//   pack       smfb_pack_vertices: positions + normals -> 12-byte GPU vertices
+//   optimize   optimize_mesh (vertex cache order, then fetch order)
+//   lods       build_lod_chain, 3 levels
+//   adjacency  build_mesh_adjacency
+//   upload / draw (MICROBENCH_GL)  upload_indexed_mesh of the mesh's .smfb
+//              image into a hidden window's context, and indexed draws
+//              into an offscreen target
+// Every run reports faces / s (items) and, where it applies, bytes / s.
+
+#include <benchmark/benchmark.h>
+
+#ifdef MICROBENCH_GL
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../common/mesh.h"
+#include "../common/mesh_adjacency.h"
+#include "../common/mesh_cache.h"
+#include "../common/mesh_normals.h"
+#include "../common/mesh_optimize.h"
+#include "../common/mesh_simplify.h"
+#include "../common/smf_loader.h"
+#ifdef MICROBENCH_GL
+#include "../common/bench.h"
+#include "../common/gl_mesh.h"
+#endif
+
+static std::string dataDir = ".";
+
+// side x side vertices, two faces per cell, for at least `faces` faces
+static size_t grid_side(size_t faces) {
+    return (size_t)std::ceil(std::sqrt((double)faces / 2.0)) + 1;
+}
+
+static std::string synthetic_path(size_t faces) {
+    return dataDir + "/synthetic_" + std::to_string(faces) + ".smf";
+}
+
+// Writes the SMF unless it is already there.
+static bool write_synthetic_smf(size_t faces) {
+    std::string path = synthetic_path(faces);
+    if (FILE* existing = fopen(path.c_str(), "rb")) {
+        fclose(existing);
+        return true;
+    }
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        std::cerr << "Cannot write " << path << "\n";
+        return false;
+    }
+    const size_t side = grid_side(faces);
+    const float step = 1.0f / (float)(side - 1);
+    for (size_t y = 0; y < side; ++y)
+        for (size_t x = 0; x < side; ++x) {
+            float u = x * step, v = y * step;
+            fprintf(f, "v %.6f %.6f %.6f\n", u, v, 0.05f * std::sin(u * 25.0f) * std::cos(v * 19.0f));
+        }
+    for (size_t y = 0; y + 1 < side; ++y)
+        for (size_t x = 0; x + 1 < side; ++x) {
+            unsigned long long a = y * side + x + 1, b = a + 1, c = a + side, d = c + 1; // 1-based
+            fprintf(f, "f %llu %llu %llu\nf %llu %llu %llu\n", a, b, d, a, d, c);
+        }
+    bool ok = fclose(f) == 0;
+    if (!ok) remove(path.c_str());
+    return ok;
+}
+
+// The parsed mesh (with uniform normals) of the size being benchmarked;
+// benchmarks are registered size by size, so only one is kept in memory.
+static const Mesh& synthetic_mesh(size_t faces) {
+    static Mesh mesh;
+    static size_t loaded = 0;
+    if (loaded != faces) {
+        mesh.release();
+        loaded = 0;
+        if (load_smf(synthetic_path(faces), mesh)) {
+            compute_vertex_normals(mesh);
+            loaded = faces;
+        }
+    }
+    return mesh;
+}
+
+// Skips the run when the mesh could not be made.
+static const Mesh* mesh_or_skip(benchmark::State& state) {
+    const Mesh& mesh = synthetic_mesh((size_t)state.range(0));
+    if (!mesh.faceCount) {
+        state.SkipWithError("synthetic mesh unavailable");
+        return nullptr;
+    }
+    return &mesh;
+}
+
+static void BM_Parse(benchmark::State& state, unsigned threads) {
+    const std::string path = synthetic_path((size_t)state.range(0));
+    size_t faces = 0, bytes = 0;
+    for (auto _ : state) {
+        Mesh mesh;
+        if (!load_smf(path, mesh, threads)) {
+            state.SkipWithError("load_smf failed");
+            return;
+        }
+        faces = mesh.faceCount;
+        benchmark::DoNotOptimize(mesh.indices);
+    }
+    if (FILE* f = fopen(path.c_str(), "rb")) {
+        fseek(f, 0, SEEK_END);
+        bytes = (size_t)ftell(f);
+        fclose(f);
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)faces);
+    state.SetBytesProcessed(state.iterations() * (int64_t)bytes);
+}
+
+static void BM_Normals(benchmark::State& state, NormalWeighting weighting) {
+    const Mesh* source = mesh_or_skip(state);
+    if (!source) return;
+    // a copy whose normals are recomputed in place every iteration
+    Mesh mesh;
+    mesh.allocate(source->vertexCount, source->faceCount);
+    std::copy(source->px, source->px + source->vertexCount, mesh.px);
+    std::copy(source->py, source->py + source->vertexCount, mesh.py);
+    std::copy(source->pz, source->pz + source->vertexCount, mesh.pz);
+    std::copy(source->indices, source->indices + source->faceCount * 3, mesh.indices);
+    for (auto _ : state) {
+        compute_vertex_normals(mesh, weighting);
+        benchmark::DoNotOptimize(mesh.nx);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)mesh.faceCount);
+}
+
+static void BM_Pack(benchmark::State& state) {
+    const Mesh* mesh = mesh_or_skip(state);
+    if (!mesh) return;
+    MeshBounds bounds = compute_mesh_bounds(*mesh);
+    glm::vec3 extent = aabb_quantize_extent(bounds.bmin, bounds.bmax);
+    std::vector<SmfbVertex> out(mesh->vertexCount);
+    for (auto _ : state) {
+        smfb_pack_vertices(*mesh, bounds.bmin, extent, 0, mesh->vertexCount, out.data());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)mesh->vertexCount);
+    state.SetBytesProcessed(state.iterations() * (int64_t)(mesh->vertexCount * sizeof(SmfbVertex)));
+    state.counters["vertices"] = (double)mesh->vertexCount;
+}
+
+static void BM_Optimize(benchmark::State& state) {
+    const Mesh* mesh = mesh_or_skip(state);
+    if (!mesh) return;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::uvec3> faces;
+    for (auto _ : state) {
+        state.PauseTiming();
+        positions = mesh_positions(*mesh);
+        faces = mesh_faces(*mesh);
+        state.ResumeTiming();
+        optimize_mesh(positions, faces);
+    }
+    state.counters["acmr_before"] = vertex_cache_stats(mesh_faces(*mesh), mesh->vertexCount).acmr;
+    state.counters["acmr_after"] = vertex_cache_stats(faces, positions.size()).acmr;
+    state.SetItemsProcessed(state.iterations() * (int64_t)mesh->faceCount);
+}
+
+static void BM_Lods(benchmark::State& state) {
+    const Mesh* mesh = mesh_or_skip(state);
+    if (!mesh) return;
+    std::vector<glm::vec3> positions = mesh_positions(*mesh);
+    std::vector<glm::uvec3> faces = mesh_faces(*mesh);
+    size_t coarsest = 0;
+    for (auto _ : state) {
+        std::vector<LodLevel> chain = build_lod_chain(positions, faces, 3);
+        coarsest = chain.empty() ? faces.size() : chain.back().faces.size();
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)faces.size());
+    state.counters["coarsest_faces"] = (double)coarsest;
+}
+
+static void BM_Adjacency(benchmark::State& state) {
+    const Mesh* mesh = mesh_or_skip(state);
+    if (!mesh) return;
+    for (auto _ : state) {
+        MeshAdjacency adj = build_mesh_adjacency(mesh->faces(), mesh->faceCount, mesh->vertexCount);
+        benchmark::DoNotOptimize(adj.opposite.data());
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)mesh->faceCount);
+}
+
+#ifdef MICROBENCH_GL
+// Hidden window whose context the GL stages share, created on first use.
+static bool gl_context() {
+    static GLFWwindow* window = nullptr;
+    static bool tried = false;
+    if (!tried) {
+        tried = true;
+        if (!glfwInit()) return false;
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        window = glfwCreateWindow(64, 64, "microbench", nullptr, nullptr);
+        if (!window) return false;
+        glfwMakeContextCurrent(window);
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) window = nullptr;
+    }
+    return window != nullptr;
+}
+
+// Unshaded positions; all the fragment stage does is write a constant.
+static GLuint draw_program() {
+    static GLuint program = 0;
+    if (program) return program;
+    const char* vs = "#version 330 core\nlayout(location = 0) in vec3 aPos;\n"
+        "void main() { gl_Position = vec4(aPos * 1.8 - 0.9, 1.0); }\n";
+    const char* fs = "#version 330 core\nout vec4 color;\nvoid main() { color = vec4(1.0); }\n";
+    GLuint v = glCreateShader(GL_VERTEX_SHADER), f = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(v, 1, &vs, nullptr); glCompileShader(v);
+    glShaderSource(f, 1, &fs, nullptr); glCompileShader(f);
+    program = glCreateProgram();
+    glAttachShader(program, v); glAttachShader(program, f);
+    glLinkProgram(program);
+    glDeleteShader(v); glDeleteShader(f);
+    return program;
+}
+
+// The .smfb image the viewers upload from (built in memory, not written).
+static bool cached_image(const Mesh& mesh, CachedMesh& out) {
+    std::vector<SmfbLod> table;
+    SmfbHeader h = smfb_layout(mesh, compute_mesh_bounds(mesh), std::vector<LodLevel>(), nullptr, 0, SmfSourceStamp(), 0, 0, table);
+    out.image = smfb_build_image(h, table, mesh, std::vector<LodLevel>(), nullptr);
+    return smfb_attach(out.image.data(), out.image.size(), out);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Includes the driver's copy to the GPU: timed up to glFinish.
+static void BM_Upload(benchmark::State& state) {
+    const Mesh* mesh = mesh_or_skip(state);
+    if (!mesh) return;
+    if (!gl_context()) {
+        state.SkipWithError("no GL context");
+        return;
+    }
+    CachedMesh cached;
+    if (!cached_image(*mesh, cached)) {
+        state.SkipWithError("cannot build the .smfb image");
+        return;
+    }
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        GpuMesh gpu = upload_indexed_mesh(cached);
+        glFinish();
+        state.SetIterationTime(seconds_since(start));
+        destroy_gpu_mesh(gpu);
+    }
+    state.SetBytesProcessed(state.iterations()
+        * (int64_t)(cached.vertexCount() * sizeof(SmfbVertex) + cached.totalIndexCount() * cached.indexSize()));
+    state.SetItemsProcessed(state.iterations() * (int64_t)mesh->faceCount);
+}
+
+// Triangle throughput: DRAWS_PER_ITERATION draws of the whole mesh into a
+// 1920x1080 target, timed up to glFinish.
+static void BM_Draw(benchmark::State& state) {
+    const int DRAWS_PER_ITERATION = 10;
+    const Mesh* mesh = mesh_or_skip(state);
+    if (!mesh) return;
+    if (!gl_context()) {
+        state.SkipWithError("no GL context");
+        return;
+    }
+    CachedMesh cached;
+    if (!cached_image(*mesh, cached)) {
+        state.SkipWithError("cannot build the .smfb image");
+        return;
+    }
+    OffscreenTarget target;
+    if (!target.create(1920, 1080)) {
+        state.SkipWithError("no offscreen target");
+        return;
+    }
+    GpuMesh gpu = upload_indexed_mesh(cached);
+    target.bind();
+    glViewport(0, 0, target.width, target.height);
+    glEnable(GL_DEPTH_TEST);
+    glUseProgram(draw_program());
+    glBindVertexArray(gpu.vao);
+    glFinish();
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        for (int i = 0; i < DRAWS_PER_ITERATION; ++i)
+            glDrawElements(GL_TRIANGLES, gpu.indexCount, gpu.indexType, nullptr);
+        glFinish();
+        state.SetIterationTime(seconds_since(start));
+    }
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    destroy_gpu_mesh(gpu);
+    target.destroy();
+    state.SetItemsProcessed(state.iterations() * DRAWS_PER_ITERATION * (int64_t)mesh->faceCount);
+}
+#endif
+
+int main(int argc, char** argv) {
+    size_t maxFaces = 1000000;
+    // own options first; the rest go to Google Benchmark
+    std::vector<char*> rest = { argv[0] };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--max-faces" && i + 1 < argc) maxFaces = (size_t)std::max(1000.0, std::min(1e8, atof(argv[++i])));
+        else if (arg == "--data-dir" && i + 1 < argc) dataDir = argv[++i];
+        else rest.push_back(argv[i]);
+    }
+    int restCount = (int)rest.size();
+    benchmark::Initialize(&restCount, rest.data());
+    if (benchmark::ReportUnrecognizedArguments(restCount, rest.data())) return 1;
+    benchmark::AddCustomContext("max_faces", std::to_string(maxFaces));
+    benchmark::AddCustomContext("pool_threads", std::to_string(thread_pool().size()));
+
+    // size by size, so synthetic_mesh() parses each mesh only once
+    for (size_t faces = 1000; faces <= maxFaces; faces *= 10) {
+        if (!write_synthetic_smf(faces)) return 1;
+        const int64_t n = (int64_t)faces;
+        auto unit = faces >= 10000000 ? benchmark::kSecond : faces >= 100000 ? benchmark::kMillisecond : benchmark::kMicrosecond;
+        benchmark::RegisterBenchmark("parse/serial", BM_Parse, 1u)->Arg(n)->Unit(unit);
+        benchmark::RegisterBenchmark("parse/pool", BM_Parse, 0u)->Arg(n)->Unit(unit);
+        benchmark::RegisterBenchmark("normals/uniform", BM_Normals, NORMAL_WEIGHT_UNIFORM)->Arg(n)->Unit(unit);
+        benchmark::RegisterBenchmark("normals/area", BM_Normals, NORMAL_WEIGHT_AREA)->Arg(n)->Unit(unit);
+        benchmark::RegisterBenchmark("normals/angle", BM_Normals, NORMAL_WEIGHT_ANGLE)->Arg(n)->Unit(unit);
+        benchmark::RegisterBenchmark("pack", BM_Pack)->Arg(n)->Unit(unit);
+        benchmark::RegisterBenchmark("optimize", BM_Optimize)->Arg(n)->Unit(unit);
+        benchmark::RegisterBenchmark("lods", BM_Lods)->Arg(n)->Unit(unit);
+        benchmark::RegisterBenchmark("adjacency", BM_Adjacency)->Arg(n)->Unit(unit);
+#ifdef MICROBENCH_GL
+        benchmark::RegisterBenchmark("upload", BM_Upload)->Arg(n)->Unit(unit)->UseManualTime();
+        benchmark::RegisterBenchmark("draw", BM_Draw)->Arg(n)->Unit(unit)->UseManualTime();
+#endif
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+#ifdef MICROBENCH_GL
+    glfwTerminate();
+#endif
+    return 0;
+}
@@ -0,0 +1,48 @@
+// smfpage.cpp
+// Build: g++ -O2 smfpage.cpp -pthread -I/path/to/glm -o smfpage
+// Run:   ./smfpage [--page-faces N] [--lods N] [--normals uniform|area|angle] scan.smf [scan.smfp]
+//        then ./part2 --paged scan.smfp    (streams the pages through a fixed GPU pool)
+//
+// Offline conversion of an SMF mesh into the paged .smfp format
+// (common/mesh_pages.h). Works out of core: memory use does not grow with the
+// mesh, the intermediate arrays live in scratch files next to the output.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "../common/mesh_pages.h"
+
+int main(int argc, char** argv) {
+    PageBuildOptions options;
+    std::string input, output;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--page-faces" && i + 1 < argc) options.pageFaces = (uint32_t)std::max(1, atoi(argv[++i]));
+        else if (arg == "--lods" && i + 1 < argc) options.lodLevels = (unsigned)std::max(0, atoi(argv[++i]));
+        else if (arg == "--normals" && i + 1 < argc) {
+            std::string w = argv[++i];
+            options.normalWeighting = w == "area" ? NORMAL_WEIGHT_AREA
+                : w == "angle" ? NORMAL_WEIGHT_ANGLE : NORMAL_WEIGHT_UNIFORM;
+        }
+        else if (input.empty()) input = arg;
+        else output = arg;
+    }
+    if (input.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--page-faces N] [--lods N] [--normals uniform|area|angle]"
+            " model.smf [model.smfp]\n";
+        return -1;
+    }
+    if (output.empty()) {
+        const std::string ext = ".smf";
+        bool smf = input.size() >= ext.size() && input.compare(input.size() - ext.size(), ext.size(), ext) == 0;
+        output = (smf ? input.substr(0, input.size() - ext.size()) : input) + ".smfp";
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (!build_paged_mesh(input, output, options)) return 1;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Wrote " << output << " in " << seconds << " s\n";
+    return 0;
+}